@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "airtime.h"
+
+// length of the window of the duty-cycle limit in us (1 h)
+#define DUTY_CYCLE_WINDOW 3600000000ULL
+// allowed share of the airtime in the window, 1 % in the EU868 band
+#define DUTY_CYCLE_DIVIDER 100
+// airtime which can be used in one window
+#define AIRTIME_BUDGET (DUTY_CYCLE_WINDOW / DUTY_CYCLE_DIVIDER)
+// part of the budget which is only used for urgent frames
+#define ALARM_RESERVE (AIRTIME_BUDGET / 4)
+// amount of data rates of the EU868 band
+#define DATA_RATES 8
+// length of the preamble in symbols
+#define PREAMBLE_SYMBOLS 8
+
+// modulation of one data rate
+typedef struct modulation {
+    uint8_t spreading_factor;
+    uint32_t bandwidth; // bandwidth in Hz
+} modulation;
+
+// modulation of the data rates of the EU868 band, DR7 (FSK) is estimated like DR6
+const modulation data_rates[DATA_RATES] = {
+        {12, 125000}, {11, 125000}, {10, 125000}, {9, 125000},
+        {8, 125000}, {7, 125000}, {7, 250000}, {7, 250000}
+};
+
+airtime_stats airtime_statistics = {0, 0, 0, 0};
+
+// airtime in us which can still be used, refilled with the allowed share of the elapsed time
+uint64_t airtime_budget = AIRTIME_BUDGET;
+// time in us since boot when the budget was updated
+uint64_t airtime_updated = 0;
+
+/**
+ * estimates the time on air of one LoRa frame with coding rate 4/5, explicit header and crc
+ * @param length length of the frame on the air in bytes, including the LoRaWAN overhead
+ * @param data_rate data rate of the EU868 band
+ * @return time on air in us
+ */
+uint32_t airtime_of_frame(int length, uint8_t data_rate) {
+    const modulation *mod = &data_rates[data_rate < DATA_RATES ? data_rate : 0];
+    int sf = mod->spreading_factor;
+    uint32_t symbol_time = (1000000UL << sf) / mod->bandwidth;
+    // low data rate optimization is required if a symbol is longer than 16 ms
+    int low_data_rate = symbol_time > 16000 ? 1 : 0;
+    int bits = 8 * length - 4 * sf + 28 + 16;
+    int divider = 4 * (sf - 2 * low_data_rate);
+    int payload_symbols = 8;
+    if (bits > 0) {
+        payload_symbols += ((bits + divider - 1) / divider) * 5;
+    }
+    // the preamble has 4.25 symbols more than configured
+    return symbol_time * (PREAMBLE_SYMBOLS + payload_symbols) + symbol_time * 17 / 4;
+}
+
+/**
+ * refills the budget with the allowed share of the time since the last update
+ */
+static void update_budget() {
+    uint64_t now = time_us_64();
+    airtime_budget += (now - airtime_updated) / DUTY_CYCLE_DIVIDER;
+    if (airtime_budget > AIRTIME_BUDGET) {
+        airtime_budget = AIRTIME_BUDGET;
+    }
+    airtime_updated = now;
+}
+
+/**
+ * calculates how long a frame has to wait until it can be sent within the duty-cycle limit.
+ * Frames which are not urgent have to leave the alarm reserve in the budget
+ * @param airtime time on air of the frame in us
+ * @param urgent true if the frame may use the alarm reserve
+ * @return waiting time in us, 0 if the frame can be sent immediately
+ */
+uint64_t airtime_wait(uint32_t airtime, bool urgent) {
+    update_budget();
+    uint64_t needed = airtime + (urgent ? 0 : ALARM_RESERVE);
+    if (airtime_budget >= needed) {
+        return 0;
+    }
+    return (needed - airtime_budget) * DUTY_CYCLE_DIVIDER;
+}
+
+/**
+ * subtracts the airtime of a transmission from the budget
+ * @param airtime time on air of the transmission in us
+ * @param urgent true if the transmission was a frame from the alarm reserve
+ */
+void airtime_charge(uint32_t airtime, bool urgent) {
+    update_budget();
+    airtime_budget = airtime_budget > airtime ? airtime_budget - airtime : 0;
+    airtime_statistics.transmissions++;
+    airtime_statistics.total_airtime += airtime;
+    if (urgent) {
+        airtime_statistics.urgent++;
+    }
+}
+
+/**
+ * counts a frame which has to wait for budget
+ */
+void airtime_defer() {
+    airtime_statistics.deferred++;
+}
+
+/**
+ * returns the statistics of the transmit scheduler
+ * @return pointer to the statistics
+ */
+const airtime_stats *airtime_get_stats() {
+    return &airtime_statistics;
+}
+
+/**
+ * prints the used airtime and the remaining budget on the console
+ */
+void airtime_print_stats() {
+    update_budget();
+    printf("transmissions: %u, airtime: %llu ms, deferred: %u, urgent: %u\n", airtime_statistics.transmissions,
+           (unsigned long long) (airtime_statistics.total_airtime / 1000), airtime_statistics.deferred, airtime_statistics.urgent);
+    printf("airtime budget: %llu of %llu ms, reserve: %llu ms\n", (unsigned long long) (airtime_budget / 1000),
+           (unsigned long long) (AIRTIME_BUDGET / 1000), (unsigned long long) (ALARM_RESERVE / 1000));
+}
@@ -0,0 +1,32 @@
+#ifndef UART_IRQ_AIRTIME_H
+#define UART_IRQ_AIRTIME_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// bytes which LoRaWAN adds to the application payload: MHDR, DevAddr, FCtrl, FCnt, FPort and MIC
+#define LORAWAN_OVERHEAD 13
+// length of the join request on the air
+#define JOIN_REQUEST_LENGTH 23
+
+// statistics of the transmit scheduler
+typedef struct airtime_stats {
+    uint32_t transmissions; // amount of transmissions including joins and repeated commands
+    uint64_t total_airtime; // sum of the airtime of all transmissions in us
+    uint32_t deferred; // amount of frames which had to wait for budget
+    uint32_t urgent; // amount of frames which were sent from the alarm reserve
+} airtime_stats;
+
+uint32_t airtime_of_frame(int length, uint8_t data_rate);
+
+uint64_t airtime_wait(uint32_t airtime, bool urgent);
+
+void airtime_charge(uint32_t airtime, bool urgent);
+
+void airtime_defer();
+
+const airtime_stats *airtime_get_stats();
+
+void airtime_print_stats();
+
+#endif //UART_IRQ_AIRTIME_H
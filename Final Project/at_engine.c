@@ -0,0 +1,375 @@
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "provided-libraries/uart.h"
+#include "at_engine.h"
+
+// amount of times a command is sent if the module does not answer
+#define AT_RETRIES 3
+// amount of answers of a command which are needed before its timeout is adapted
+#define AT_MIN_SAMPLES 8
+// shortest adapted timeout in us, a long line needs about 100 ms at 9600 baud
+#define AT_MIN_TIMEOUT 500000
+// the adapted timeout is this factor times the 95th percentile of the observed gaps
+#define AT_TIMEOUT_FACTOR 2
+// waiting time in us before the first repetition of a command, doubled for every further repetition
+#define AT_RETRY_BACKOFF 100000
+// time in us which a command may wait for free space in the transmit buffer
+#define AT_SEND_TIMEOUT 100000
+// amount of commands without answer in a row after which the module is marked unhealthy
+#define AT_BREAKER_THRESHOLD 3
+// time in us during which no command is sent to an unhealthy module
+#define AT_BREAKER_COOLDOWN 60000000
+
+const uint32_t at_histogram_bounds[AT_HISTOGRAM_BUCKETS] = {
+        10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 20000, UINT32_MAX
+};
+
+// state of the AT engine
+typedef struct at_engine {
+    int uart_nr; // UART where the module is connected
+    at_line_handler handler; // called for every received line
+    char line[AT_LINE_LENGTH]; // copy of a line which wraps around the end of the receive ring
+    int buffered; // amount of received bytes which were left in the receive ring by the last poll
+    const char *command; // command which is executed, must stay valid until the command is finished
+    const char *done; // text which marks the last line of the answer, NULL if any line completes the answer
+    uint32_t timeout; // time in us without received characters until the command is sent again
+    uint32_t last_activity; // time when the command was sent or the last character was received
+    uint32_t sent_time; // time when the command was sent the last time
+    uint32_t max_gap; // longest time in us without received characters since the command was sent
+    bool retry_pending; // true if the command is sent again at retry_time
+    uint32_t retry_time; // time when the command is sent again
+    int attempts; // amount of times the command was sent
+    at_command_stats *stats; // response times of the running command, NULL if the table is full
+    enum At_Results result;
+} at_engine;
+
+at_engine engine = {0};
+
+// response times of every command which was sent
+at_command_stats command_stats[AT_COMMAND_CLASSES];
+int command_stats_count = 0;
+
+// circuit breaker: commands without answer in a row and the time until which the module is unhealthy
+int failures_in_row = 0;
+bool breaker_open = false;
+uint32_t breaker_until = 0;
+
+// state of the random generator for the jitter of the retries
+uint32_t jitter_state = 0;
+
+/**
+ * initializes the AT engine
+ * @param uart_nr UART where the module is connected
+ * @param handler function which is called for every received line, may be NULL
+ */
+void at_init(int uart_nr, at_line_handler handler) {
+    engine.uart_nr = uart_nr;
+    engine.handler = handler;
+    engine.buffered = 0;
+    engine.result = AT_IDLE;
+    jitter_state = time_us_32() | 1;
+}
+
+/**
+ * finds the response time statistics of a command, a new entry is created for unknown commands
+ * @param command command including the arguments
+ * @return statistics of the command, NULL if the table is full
+ */
+static at_command_stats *find_stats(const char *command) {
+    char name[AT_CLASS_NAME_LENGTH];
+    int length = 0;
+    while (command[length] != '\0' && command[length] != '=' && command[length] != '\r' &&
+           length < AT_CLASS_NAME_LENGTH - 1) {
+        name[length] = command[length];
+        length++;
+    }
+    name[length] = '\0';
+    for (int i = 0; i < command_stats_count; i++) {
+        if (strcmp(command_stats[i].name, name) == 0) {
+            return &command_stats[i];
+        }
+    }
+    if (command_stats_count >= AT_COMMAND_CLASSES) {
+        return NULL;
+    }
+    at_command_stats *stats = &command_stats[command_stats_count++];
+    memset(stats, 0, sizeof(at_command_stats));
+    strcpy(stats->name, name);
+    return stats;
+}
+
+/**
+ * adds a time to a histogram
+ * @param histogram buckets of the histogram
+ * @param time time in us
+ */
+static void add_to_histogram(uint32_t *histogram, uint32_t time) {
+    int bucket = 0;
+    while (bucket < AT_HISTOGRAM_BUCKETS - 1 && time > at_histogram_bounds[bucket] * 1000) {
+        bucket++;
+    }
+    histogram[bucket]++;
+}
+
+/**
+ * calculates the timeout of a command from the 95th percentile of the observed gaps in its answers
+ * @param stats statistics of the command, may be NULL
+ * @param limit configured timeout in us, which is also the upper limit of the adapted timeout
+ * @return timeout in us
+ */
+static uint32_t adaptive_timeout(const at_command_stats *stats, uint32_t limit) {
+    if (stats == NULL || stats->samples < AT_MIN_SAMPLES) {
+        return limit;
+    }
+    uint32_t needed = stats->samples - stats->samples / 20;
+    uint32_t counted = 0;
+    int bucket = 0;
+    while (bucket < AT_HISTOGRAM_BUCKETS - 1) {
+        counted += stats->gap[bucket];
+        if (counted >= needed) {
+            break;
+        }
+        bucket++;
+    }
+    if (bucket == AT_HISTOGRAM_BUCKETS - 1) {
+        return limit;
+    }
+    uint32_t timeout = at_histogram_bounds[bucket] * 1000 * AT_TIMEOUT_FACTOR;
+    if (timeout < AT_MIN_TIMEOUT) {
+        timeout = AT_MIN_TIMEOUT;
+    }
+    return timeout < limit ? timeout : limit;
+}
+
+/**
+ * calculates the waiting time until a command is sent again: exponential backoff with +-50 % jitter,
+ * so that the module is not hit at a fixed rhythm
+ * @param attempts amount of times the command has been sent
+ * @return waiting time in us
+ */
+static uint32_t retry_backoff(int attempts) {
+    uint32_t backoff = AT_RETRY_BACKOFF << (attempts - 1);
+    // xorshift random generator
+    jitter_state ^= jitter_state << 13;
+    jitter_state ^= jitter_state >> 17;
+    jitter_state ^= jitter_state << 5;
+    return backoff / 2 + jitter_state % backoff;
+}
+
+/**
+ * transmits the running command. It stays valid until the command is finished, so it is sent by DMA without a copy.
+ * If a transmission is still running, the command is queued behind it as a whole
+ * @param command command to send including the line ending
+ */
+static void transmit(const char *command) {
+    int length = (int) strlen(command);
+    if (!uart_write_dma(engine.uart_nr, (const uint8_t *) command, length, NULL) &&
+        !uart_write_timeout(engine.uart_nr, (const uint8_t *) command, length, AT_SEND_TIMEOUT)) {
+        printf("AT command not sent completely: %s", command);
+    }
+}
+
+/**
+ * sends a command to the module, the answer is processed by at_poll.
+ * While the module is marked unhealthy, the command is not sent and at_poll returns AT_UNAVAILABLE
+ * @param command command to send including the line ending, must stay valid until the command is finished
+ * @param done text which marks the last line of the answer, NULL if the first line completes the answer
+ * @param timeout maximum time in us without received characters until the command is sent again,
+ * the timeout is shortened to the observed response times of the command
+ */
+void at_send(const char *command, const char *done, uint32_t timeout) {
+    if (at_cooldown_remaining() > 0) {
+        engine.attempts = 0;
+        engine.result = AT_UNAVAILABLE;
+        return;
+    }
+    engine.command = command;
+    engine.done = done;
+    engine.stats = find_stats(command);
+    engine.timeout = adaptive_timeout(engine.stats, timeout);
+    engine.attempts = 1;
+    engine.retry_pending = false;
+    engine.result = AT_BUSY;
+    engine.last_activity = time_us_32();
+    engine.sent_time = engine.last_activity;
+    engine.max_gap = 0;
+    transmit(command);
+}
+
+/**
+ * records the end of the running command for the statistics and the circuit breaker
+ * @param answered true if the module answered, false if it did not answer after all retries
+ */
+static void finish_command(bool answered) {
+    if (answered) {
+        failures_in_row = 0;
+        breaker_open = false;
+        if (engine.stats != NULL) {
+            engine.stats->samples++;
+            add_to_histogram(engine.stats->response, time_us_32() - engine.sent_time);
+            add_to_histogram(engine.stats->gap, engine.max_gap);
+        }
+    } else {
+        if (engine.stats != NULL) {
+            engine.stats->timeouts++;
+        }
+        failures_in_row++;
+        if (failures_in_row >= AT_BREAKER_THRESHOLD) {
+            // after the cool-down one command is sent again, if it fails the module stays unhealthy
+            breaker_open = true;
+            breaker_until = time_us_32() + AT_BREAKER_COOLDOWN;
+            failures_in_row = AT_BREAKER_THRESHOLD - 1;
+        }
+    }
+}
+
+/**
+ * checks a complete line against the expected answer of the running command
+ * @param line received line without line ending
+ */
+static void process_line(const char *line) {
+    if (engine.handler != NULL) {
+        engine.handler(line);
+    }
+    if (engine.result != AT_BUSY) {
+        return;
+    }
+    if (strstr(line, "ERROR") != NULL) {
+        engine.result = AT_ERROR;
+        finish_command(true);
+    } else if (engine.done == NULL || strstr(line, engine.done) != NULL) {
+        engine.result = AT_OK;
+        finish_command(true);
+    }
+}
+
+/**
+ * processes a line which was found in the receive ring. It is used in place, only a line which wraps around
+ * the end of the ring is copied
+ * @param line view onto the line
+ */
+static void process_ring_line(const rb_line *line) {
+    // empty lines are ignored
+    if (line->length + line->rest_length == 0) {
+        return;
+    }
+    if (line->rest == NULL) {
+        process_line(line->text);
+        return;
+    }
+    int length = line->length < AT_LINE_LENGTH - 1 ? line->length : AT_LINE_LENGTH - 1;
+    int rest_length = line->rest_length < AT_LINE_LENGTH - 1 - length ? line->rest_length : AT_LINE_LENGTH - 1 - length;
+    memcpy(engine.line, line->text, length);
+    memcpy(engine.line + length, line->rest, rest_length);
+    engine.line[length + rest_length] = '\0';
+    process_line(engine.line);
+}
+
+/**
+ * processes all lines which were received since the last call and checks the timeout of the running command.
+ * Has to be called regularly, it never blocks
+ * @return the result of the running command. A final result is only returned once, afterwards the engine is idle
+ */
+enum At_Results at_poll() {
+    rb_line line;
+
+    // characters were received if more is buffered than the last poll left behind
+    if (uart_available(engine.uart_nr) != engine.buffered) {
+        uint32_t now = time_us_32();
+        if (engine.result == AT_BUSY && !engine.retry_pending && now - engine.last_activity > engine.max_gap) {
+            engine.max_gap = now - engine.last_activity;
+        }
+        engine.last_activity = now;
+    }
+    while (uart_read_line(engine.uart_nr, &line)) {
+        process_ring_line(&line);
+        uart_release_line(engine.uart_nr, &line);
+    }
+    engine.buffered = uart_available(engine.uart_nr);
+
+    if (engine.result == AT_BUSY && engine.retry_pending) {
+        if ((int32_t) (time_us_32() - engine.retry_time) >= 0) {
+            // waiting time is over, the command is sent again
+            engine.retry_pending = false;
+            engine.attempts++;
+            engine.last_activity = time_us_32();
+            engine.sent_time = engine.last_activity;
+            engine.max_gap = 0;
+            transmit(engine.command);
+        }
+    } else if (engine.result == AT_BUSY && (time_us_32() - engine.last_activity) > engine.timeout) {
+        if (engine.attempts < AT_RETRIES) {
+            // no answer, the command is sent again after a jittered backoff
+            engine.retry_pending = true;
+            engine.retry_time = time_us_32() + retry_backoff(engine.attempts);
+        } else {
+            engine.result = AT_TIMEOUT;
+            finish_command(false);
+        }
+    }
+
+    enum At_Results result = engine.result;
+    if (result != AT_BUSY) {
+        engine.result = AT_IDLE;
+    }
+    return result;
+}
+
+/**
+ * returns how often the last command was sent, e.g. to account the airtime of repeated transmissions
+ * @return amount of times the command was sent
+ */
+int at_attempts() {
+    return engine.attempts;
+}
+
+/**
+ * returns how long the module is still marked unhealthy after several commands without answer
+ * @return remaining cool-down time in us, 0 if commands are sent to the module
+ */
+uint32_t at_cooldown_remaining() {
+    if (!breaker_open) {
+        return 0;
+    }
+    int32_t remaining = (int32_t) (breaker_until - time_us_32());
+    return remaining > 0 ? remaining : 0;
+}
+
+/**
+ * returns the response time statistics of all commands
+ * @param count pointer where the amount of commands is written to
+ * @return statistics of the commands
+ */
+const at_command_stats *at_get_stats(int *count) {
+    *count = command_stats_count;
+    return command_stats;
+}
+
+/**
+ * prints the response time histograms of all commands on the console
+ */
+void at_print_stats() {
+    for (int i = 0; i < command_stats_count; i++) {
+        at_command_stats *stats = &command_stats[i];
+        printf("%s: %u answers, %u timeouts", stats->name, stats->samples, stats->timeouts);
+        if (stats->samples >= AT_MIN_SAMPLES) {
+            printf(", timeout %u ms", adaptive_timeout(stats, UINT32_MAX) / 1000);
+        }
+        printf("\n");
+        printf("  response ms:");
+        for (int j = 0; j < AT_HISTOGRAM_BUCKETS; j++) {
+            if (stats->response[j] > 0) {
+                if (j < AT_HISTOGRAM_BUCKETS - 1) {
+                    printf(" <=%u:%u", at_histogram_bounds[j], stats->response[j]);
+                } else {
+                    printf(" >%u:%u", at_histogram_bounds[j - 1], stats->response[j]);
+                }
+            }
+        }
+        printf("\n");
+    }
+    if (at_cooldown_remaining() > 0) {
+        printf("LoRa module unhealthy, cool-down %u ms\n", at_cooldown_remaining() / 1000);
+    }
+}
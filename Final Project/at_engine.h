@@ -0,0 +1,55 @@
+#ifndef UART_IRQ_AT_ENGINE_H
+#define UART_IRQ_AT_ENGINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// maximum length of a received line which wraps around the end of the receive ring, longer ones are truncated
+#define AT_LINE_LENGTH 128
+// amount of different commands for which response times are recorded
+#define AT_COMMAND_CLASSES 8
+// maximum length of the name of a command, e.g. at+JOIN
+#define AT_CLASS_NAME_LENGTH 12
+// amount of buckets of the response time histograms
+#define AT_HISTOGRAM_BUCKETS 12
+
+// results of the AT command which is currently executed
+enum At_Results {
+    AT_IDLE, // no command is executed
+    AT_BUSY, // command was sent and the answer is not complete yet
+    AT_OK, // expected answer was received
+    AT_ERROR, // module answered with an error
+    AT_TIMEOUT, // module did not answer after all retries
+    AT_UNAVAILABLE // module is marked unhealthy, the command was not sent
+};
+
+// response times of one command, the bucket i counts the times up to at_histogram_bounds[i]
+typedef struct at_command_stats {
+    char name[AT_CLASS_NAME_LENGTH]; // command without arguments
+    uint32_t samples; // amount of answered commands
+    uint32_t timeouts; // amount of commands without answer after all retries
+    uint32_t response[AT_HISTOGRAM_BUCKETS]; // time from sending until the answer was complete
+    uint32_t gap[AT_HISTOGRAM_BUCKETS]; // longest time without received characters while the command was running
+} at_command_stats;
+
+// upper bounds of the histogram buckets in ms
+extern const uint32_t at_histogram_bounds[AT_HISTOGRAM_BUCKETS];
+
+// function which is called for every line received from the module
+typedef void (*at_line_handler)(const char *line);
+
+void at_init(int uart_nr, at_line_handler handler);
+
+void at_send(const char *command, const char *done, uint32_t timeout);
+
+enum At_Results at_poll();
+
+int at_attempts();
+
+uint32_t at_cooldown_remaining();
+
+const at_command_stats *at_get_stats(int *count);
+
+void at_print_stats();
+
+#endif //UART_IRQ_AT_ENGINE_H
@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "backlog.h"
+#include "eeprom.h"
+
+// size of one EEPROM page, every frame is saved in its own page
+#define PAGE_SIZE 64
+// marks a frame which still has to be sent
+#define FRAME_PENDING 0xA5
+// marks an urgent frame which still has to be sent
+#define FRAME_URGENT 0xA6
+// marks a frame which has been sent, the sequence number stays valid
+#define FRAME_SENT 0x5A
+
+/*
+ * Layout of one page:
+ * byte 0:     FRAME_PENDING, FRAME_URGENT or FRAME_SENT
+ * byte 1-2:   sequence number, big endian
+ * byte 3:     length of the payload
+ * byte 4-:    payload, followed by the crc16 of byte 1 up to the end of the payload, big endian
+ * The frame with the sequence number n is saved in slot n % BACKLOG_SLOTS
+ */
+
+// eeprom address of the first slot of the backlog
+uint16_t eeprom_address_backlog = 0x1000;
+
+// sequence number of the oldest frame which still has to be sent
+uint16_t backlog_head = 0;
+// amount of frames which still have to be sent
+int backlog_pending = 0;
+// bit mask of the slots which contain urgent frames that still have to be sent
+uint32_t backlog_urgent_slots = 0;
+// sequence number of the frame which was read last by backlog_peek
+uint16_t backlog_peeked = 0;
+
+// record of one slot as it is read at startup
+typedef struct backlog_slot {
+    bool valid;
+    bool pending;
+    bool urgent;
+    uint16_t sequence;
+} backlog_slot;
+
+/**
+ * returns the EEPROM address of the slot of a frame
+ * @param sequence sequence number of the frame
+ * @return address of the first byte of the page
+ */
+static uint16_t slot_address(uint16_t sequence) {
+    return eeprom_address_backlog + (sequence % BACKLOG_SLOTS) * PAGE_SIZE;
+}
+
+/**
+ * reads one page of the backlog and checks the crc
+ * @param address address of the page
+ * @param page pointer where the page is written to
+ * @return true if the page contains a valid frame, otherwise false
+ */
+static bool read_page(uint16_t address, uint8_t *page) {
+    read_bytes_from_eeprom(address, page, PAGE_SIZE);
+    if ((page[0] != FRAME_PENDING && page[0] != FRAME_URGENT && page[0] != FRAME_SENT) ||
+        page[3] > BACKLOG_PAYLOAD_LENGTH) {
+        return false;
+    }
+    return crc16(&page[1], page[3] + 5) == 0;
+}
+
+/**
+ * reads all slots of the backlog and finds the frames which still have to be sent.
+ * The sequence numbers continue after the newest frame, even if it has already been sent
+ */
+void backlog_init() {
+    backlog_slot slots[BACKLOG_SLOTS];
+    uint8_t page[PAGE_SIZE];
+    uint16_t next = 0;
+
+    for (int i = 0; i < BACKLOG_SLOTS; i++) {
+        slots[i].valid = read_page(eeprom_address_backlog + i * PAGE_SIZE, page) &&
+                         page[2] % BACKLOG_SLOTS == i;
+        slots[i].pending = page[0] != FRAME_SENT;
+        slots[i].urgent = page[0] == FRAME_URGENT;
+        slots[i].sequence = (page[1] << 8) | page[2];
+    }
+    // the newest frame is the one without a successor in the next slot
+    for (int i = 0; i < BACKLOG_SLOTS; i++) {
+        backlog_slot *successor = &slots[(i + 1) % BACKLOG_SLOTS];
+        if (slots[i].valid && (!successor->valid || successor->sequence != (uint16_t) (slots[i].sequence + 1))) {
+            next = slots[i].sequence + 1;
+            break;
+        }
+    }
+    // pending frames are the newest ones, because they are sent in order
+    backlog_head = next;
+    backlog_pending = 0;
+    backlog_urgent_slots = 0;
+    while (backlog_pending < BACKLOG_SLOTS) {
+        backlog_slot *slot = &slots[(uint16_t) (backlog_head - 1) % BACKLOG_SLOTS];
+        if (!slot->valid || !slot->pending || slot->sequence != (uint16_t) (backlog_head - 1)) {
+            break;
+        }
+        if (slot->urgent) {
+            backlog_urgent_slots |= 1UL << ((uint16_t) (backlog_head - 1) % BACKLOG_SLOTS);
+        }
+        backlog_head--;
+        backlog_pending++;
+    }
+    if (backlog_pending > 0) {
+        printf("%d unsent LoRa frames in backlog\r\n", backlog_pending);
+    }
+}
+
+/**
+ * saves a frame at the end of the backlog with one page write. If the backlog is full, the oldest frame is lost
+ * @param data payload of the frame
+ * @param length length of the payload, at most BACKLOG_PAYLOAD_LENGTH
+ * @param urgent true if the frame may use the airtime which is reserved for alarms
+ * @return true if the frame was saved, otherwise false
+ */
+bool backlog_push(const uint8_t *data, int length, bool urgent) {
+    uint8_t page[PAGE_SIZE];
+    if (length > BACKLOG_PAYLOAD_LENGTH) {
+        return false;
+    }
+    if (backlog_pending >= BACKLOG_SLOTS) {
+        printf("LoRa backlog full, oldest frame dropped\r\n");
+        backlog_urgent_slots &= ~(1UL << (backlog_head % BACKLOG_SLOTS));
+        backlog_head++;
+        backlog_pending--;
+    }
+    uint16_t sequence = backlog_head + backlog_pending;
+    page[0] = urgent ? FRAME_URGENT : FRAME_PENDING;
+    page[1] = sequence >> 8;
+    page[2] = sequence & 0xFF;
+    page[3] = length;
+    memcpy(&page[4], data, length);
+    uint16_t crc = crc16(&page[1], length + 3);
+    page[length + 4] = (uint8_t) (crc >> 8);
+    page[length + 5] = (uint8_t) crc;
+    write_bytes_to_eeprom(slot_address(sequence), page, length + 6);
+    if (urgent) {
+        backlog_urgent_slots |= 1UL << (sequence % BACKLOG_SLOTS);
+    }
+    backlog_pending++;
+    return true;
+}
+
+/**
+ * reads the oldest frame which still has to be sent
+ * @param frame buffer with at least BACKLOG_HEADER_LENGTH + BACKLOG_PAYLOAD_LENGTH bytes,
+ * the sequence number is written in front of the payload
+ * @return length of the frame including the sequence number, 0 if the backlog is empty or the frame is damaged
+ */
+int backlog_peek(uint8_t *frame) {
+    uint8_t page[PAGE_SIZE];
+    if (backlog_pending == 0) {
+        return 0;
+    }
+    backlog_peeked = backlog_head;
+    if (!read_page(slot_address(backlog_head), page) || page[0] == FRAME_SENT) {
+        return 0;
+    }
+    memcpy(frame, &page[1], BACKLOG_HEADER_LENGTH);
+    memcpy(&frame[BACKLOG_HEADER_LENGTH], &page[4], page[3]);
+    return page[3] + BACKLOG_HEADER_LENGTH;
+}
+
+/**
+ * marks the frame which was read last by backlog_peek as sent, only the state byte of the page is written.
+ * Nothing is marked if backlog_push has dropped that frame in the meantime, because then the oldest frame
+ * has not been sent yet
+ */
+void backlog_pop() {
+    uint8_t state = FRAME_SENT;
+    if (backlog_pending == 0 || backlog_head != backlog_peeked) {
+        return;
+    }
+    write_bytes_to_eeprom(slot_address(backlog_head), &state, 1);
+    backlog_urgent_slots &= ~(1UL << (backlog_head % BACKLOG_SLOTS));
+    backlog_head++;
+    backlog_pending--;
+}
+
+/**
+ * returns the amount of frames which still have to be sent
+ * @return amount of frames in the backlog
+ */
+int backlog_count() {
+    return backlog_pending;
+}
+
+/**
+ * checks if an urgent frame waits in the backlog. Then the frames in front of it are sent with the alarm reserve,
+ * so that the urgent frame is not delayed
+ * @return true if at least one urgent frame still has to be sent, otherwise false
+ */
+bool backlog_urgent() {
+    return backlog_urgent_slots != 0;
+}
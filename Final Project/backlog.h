@@ -0,0 +1,26 @@
+#ifndef UART_IRQ_BACKLOG_H
+#define UART_IRQ_BACKLOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// amount of uplink frames which can wait in the EEPROM, power of two so that the slot follows from the sequence number
+#define BACKLOG_SLOTS 32
+// maximum payload of one frame, one frame is saved in one EEPROM page
+#define BACKLOG_PAYLOAD_LENGTH 58
+// length of the sequence number which is sent in front of the payload
+#define BACKLOG_HEADER_LENGTH 2
+
+void backlog_init();
+
+bool backlog_push(const uint8_t *data, int length, bool urgent);
+
+int backlog_peek(uint8_t *frame);
+
+void backlog_pop();
+
+int backlog_count();
+
+bool backlog_urgent();
+
+#endif //UART_IRQ_BACKLOG_H
@@ -0,0 +1,36 @@
+#ifndef UART_IRQ_BOARD_H
+#define UART_IRQ_BOARD_H
+
+#define LED0_PIN 20
+
+#define SW0_PIN 9
+
+#define OPTO_SENSOR 28
+#define PIEZO_SENSOR 27
+
+#define UART_NR 1
+#define UART_TX_PIN 4
+#define UART_RX_PIN 5
+
+#define MOTOR_CONTR_A 2
+#define MOTOR_CONTR_B 3
+#define MOTOR_CONTR_C 6
+#define MOTOR_CONTR_D 13
+
+#define EEPROM_SDA_PIN 16
+#define EEPROM_SCL_PIN 17
+
+// amount of dispenser wheels which are connected to the board, at most STEPPER_MAX_INSTANCES
+#define DISPENSER_COUNT 1
+
+// opto sensor and motor controllers A to D of every dispenser wheel
+#define DISPENSER_PINS { \
+    {OPTO_SENSOR, {MOTOR_CONTR_A, MOTOR_CONTR_B, MOTOR_CONTR_C, MOTOR_CONTR_D}} \
+}
+
+// piezo sensor below the output of every dispenser wheel
+#define DISPENSER_PIEZO_SENSORS { \
+    PIEZO_SENSOR \
+}
+
+#endif //UART_IRQ_BOARD_H
@@ -0,0 +1,20 @@
+#ifndef UART_IRQ_BOARD_HPP
+#define UART_IRQ_BOARD_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "board.h"
+
+// pins of one dispenser wheel, the layout matches stepperpins in stepper.h
+struct WheelPins {
+    uint8_t opto_sensor;
+    uint8_t motor_controllers[4];
+};
+
+// compile-time description of the board, generated from the pin definitions in board.h
+struct Board {
+    static constexpr std::size_t wheel_count = DISPENSER_COUNT;
+    static constexpr WheelPins wheels[wheel_count] = DISPENSER_PINS;
+};
+
+#endif //UART_IRQ_BOARD_HPP
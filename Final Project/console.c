@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "provided-libraries/uart.h"
+#include "board.h"
+#include "console.h"
+#include "profile.h"
+#include "schedule.h"
+#include "power.h"
+#include "airtime.h"
+#include "at_engine.h"
+#include "modem_link.h"
+
+// one command which can be typed on the console
+typedef struct console_command {
+    const char *name;
+    bool arguments; // true if the name is followed by a space and the arguments of the command
+    void (*execute)(const char *arguments);
+} console_command;
+
+#ifdef PROFILING
+/**
+ * prints the durations of the measured scopes
+ * @param arguments not used
+ */
+static void print_profile(const char *arguments) {
+    (void) arguments;
+    profile_print_stats();
+}
+
+/**
+ * clears the profile table and confirms it on the console
+ * @param arguments not used
+ */
+static void reset_profile(const char *arguments) {
+    (void) arguments;
+    profile_reset();
+    printf("profile cleared\n");
+}
+#endif
+
+/**
+ * prints the time spent in every power state
+ * @param arguments not used
+ */
+static void print_power(const char *arguments) {
+    (void) arguments;
+    power_print_stats();
+}
+
+/**
+ * prints the used airtime of the LORA module and the remaining duty-cycle budget
+ * @param arguments not used
+ */
+static void print_airtime(const char *arguments) {
+    (void) arguments;
+    airtime_print_stats();
+}
+
+/**
+ * prints the response times of the AT commands
+ * @param arguments not used
+ */
+static void print_at(const char *arguments) {
+    (void) arguments;
+    at_print_stats();
+}
+
+/**
+ * prints the negotiated speed of the UART of the LORA module and the round-trip times
+ * @param arguments not used
+ */
+static void print_link(const char *arguments) {
+    (void) arguments;
+    link_print_stats();
+}
+
+/**
+ * prints the counters of the UART of the LORA module
+ * @param arguments not used
+ */
+static void print_uart(const char *arguments) {
+    (void) arguments;
+    uart_print_stats(UART_NR);
+}
+
+/**
+ * sets the date and time of the RTC
+ * @param arguments date and time in the format YYYY-MM-DD HH:MM:SS
+ */
+static void set_time(const char *arguments) {
+    int year, month, day, hour, minute, second;
+    if (sscanf(arguments, "%d-%d-%d %d:%d:%d", &year, &month, &day, &hour, &minute, &second) != 6 ||
+        year < 2000 || year > 4095 || month < 1 || month > 12 || day < 1 || day > 31 ||
+        hour > 23 || minute > 59 || second > 59 || hour < 0 || minute < 0 || second < 0) {
+        printf("usage: time YYYY-MM-DD HH:MM:SS\n");
+        return;
+    }
+    datetime_t time = {(int16_t) year, (int8_t) month, (int8_t) day, 0, (int8_t) hour, (int8_t) minute,
+                       (int8_t) second};
+    schedule_set_time(&time);
+}
+
+const console_command console_commands[] = {
+#ifdef PROFILING
+        {"profile", false, print_profile},
+        {"profile reset", false, reset_profile},
+#endif
+        {"stats power", false, print_power},
+        {"stats airtime", false, print_airtime},
+        {"stats at", false, print_at},
+        {"stats link", false, print_link},
+        {"stats uart", false, print_uart},
+        {"time", true, set_time}
+};
+
+// characters of the command which is currently typed
+char console_line[CONSOLE_LINE_LENGTH];
+int console_length = 0;
+
+/**
+ * executes a complete line of the console
+ * @param line line without the line ending
+ */
+static void execute_line(const char *line) {
+    if (line[0] == '\0') {
+        return;
+    }
+    for (unsigned int i = 0; i < sizeof(console_commands) / sizeof(console_command); i++) {
+        const console_command *command = &console_commands[i];
+        size_t length = strlen(command->name);
+        if (!command->arguments && strcmp(line, command->name) == 0) {
+            command->execute("");
+            return;
+        }
+        if (command->arguments && strncmp(line, command->name, length) == 0 && line[length] == ' ') {
+            command->execute(&line[length + 1]);
+            return;
+        }
+    }
+    printf("unknown command: %s\n", line);
+}
+
+/**
+ * Interrupt handler. Triggered when characters were typed on the console, wakes up the processor from deep sleep,
+ * so that the idle task reads them
+ * @param param not used
+ */
+static void console_chars_available(void *param) {
+    (void) param;
+    power_request_wakeup();
+}
+
+/**
+ * registers the wakeup of the console, the console UART has to be initialized before by stdio_init_all
+ */
+void console_init() {
+    stdio_set_chars_available_callback(console_chars_available, NULL);
+}
+
+/**
+ * Task which reads the characters typed on the console and executes a command at the end of its line.
+ * Never blocks, the characters are read whenever the firmware is awake, e.g. from the idle task.
+ * Lines which are longer than CONSOLE_LINE_LENGTH are dropped
+ */
+void console_poll() {
+    int c;
+    while ((c = getchar_timeout_us(0)) != PICO_ERROR_TIMEOUT) {
+        if (c == '\r' || c == '\n') {
+            if (console_length < CONSOLE_LINE_LENGTH) {
+                console_line[console_length] = '\0';
+                execute_line(console_line);
+            }
+            console_length = 0;
+        } else if (console_length < CONSOLE_LINE_LENGTH) {
+            console_line[console_length++] = (char) c;
+        }
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef UART_IRQ_CONSOLE_H
+#define UART_IRQ_CONSOLE_H
+
+// maximum length of a command which is typed on the console
+#define CONSOLE_LINE_LENGTH 32
+
+/*
+ * Console commands, one command per line:
+ * profile          prints the durations of the measured scopes, only built with PROFILING
+ * profile reset    clears the durations of the measured scopes, only built with PROFILING
+ * stats power      prints the time spent in every power state and the wake latency
+ * stats airtime    prints the used airtime and the remaining duty-cycle budget of the LORA module
+ * stats at         prints the response time histograms of the AT commands
+ * stats link       prints the negotiated speed and the round-trip times of the UART of the LORA module
+ * stats uart       prints the counters of the UART of the LORA module
+ * time YYYY-MM-DD HH:MM:SS
+ *                  sets the date and time, no dose is dispensed after a reset until the time is set
+ */
+
+void console_init();
+
+void console_poll();
+
+#endif //UART_IRQ_CONSOLE_H
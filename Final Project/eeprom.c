@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "hardware/i2c.h"
+#include "profile.h"
 
 // wait time which is needed by the module after writing an entry
 #define WAIT_TIME 10
@@ -96,6 +97,7 @@ int calculate_entry_length(const char* entry) {
  * @param length length of the string
  */
 void write_log_entry(char* str, size_t length) {
+    PROFILE_SCOPE(PROFILE_LOG_WRITE);
     uint16_t address;
     uint16_t write_address = 0;
     char entry[64];
@@ -133,4 +135,29 @@ void write_log_entry(char* str, size_t length) {
     to_write[(length + 3)] = (uint8_t) crc;
     i2c_write_blocking(i2c0, EEPROM_ADDR, to_write, sizeof(to_write), false);
     sleep_ms(WAIT_TIME);
+}
+
+/**
+ * reads one entry of the log in the eeprom, the valid entries are written one after another from the start
+ * @param index index of the entry
+ * @param entry buffer with 64 bytes where the entry is written to
+ * @return true if the entry is valid, false at the end of the log
+ */
+bool read_log_entry(int index, char* entry) {
+    if (index < 0 || index >= 2048 / 64) {
+        return false;
+    }
+    read_bytes_from_eeprom(index * 64, (uint8_t*) entry, 64);
+    int entry_size = calculate_entry_length(entry);
+    return entry[0] != '\0' && entry_size != -1 && crc16((uint8_t*) entry, entry_size + 3) == 0;
+}
+
+/**
+ * prints all valid entries of the log in the eeprom
+ */
+void print_log() {
+    char entry[64];
+    for (int i = 0; read_log_entry(i, entry); i++) {
+        printf("%s\n", entry);
+    }
 }
\ No newline at end of file
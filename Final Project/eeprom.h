@@ -1,8 +1,13 @@
-#ifndef UART_IRQ_EEPROM_H
-#define UART_IRQ_EEPROM_H
-
-int write_bytes_to_eeprom(uint16_t address, uint8_t *data, int length);
-void read_bytes_from_eeprom(uint16_t address, uint8_t *data, int length);
-void write_log_entry(char* str, size_t length);
-
-#endif //UART_IRQ_EEPROM_H
+#ifndef UART_IRQ_EEPROM_H
+#define UART_IRQ_EEPROM_H
+
+#include <stdbool.h>
+
+int write_bytes_to_eeprom(uint16_t address, uint8_t *data, int length);
+void read_bytes_from_eeprom(uint16_t address, uint8_t *data, int length);
+void write_log_entry(char* str, size_t length);
+bool read_log_entry(int index, char* entry);
+void print_log();
+uint16_t crc16(const uint8_t *data_p, size_t length);
+
+#endif //UART_IRQ_EEPROM_H
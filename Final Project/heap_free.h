@@ -0,0 +1,10 @@
+#ifndef UART_IRQ_HEAP_FREE_H
+#define UART_IRQ_HEAP_FREE_H
+
+// included in front of every C source of the firmware by the heap-free build, see HEAP_FREE in CMakeLists.txt.
+// The declarations of the allocator are read first, afterwards every use of it is a compile error
+#include <stdlib.h>
+
+#pragma GCC poison malloc calloc realloc free
+
+#endif //UART_IRQ_HEAP_FREE_H
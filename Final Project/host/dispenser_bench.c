@@ -0,0 +1,343 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pico/stdlib.h"
+#include "hardware/i2c.h"
+#include "hardware/watchdog.h"
+#include "provided-libraries/uart.h"
+#include "board.h"
+#include "eeprom.h"
+#include "stepper.h"
+#include "logger.h"
+#include "lora_mod.h"
+#include "backlog.h"
+#include "schedule.h"
+#include "power.h"
+#include "remote_config.h"
+#include "sim.h"
+
+#define BAUD_RATE_EEPROM 100000
+#define BAUD_RATE_UART 9600
+// maximum amount of phases in one run
+#define MAX_PHASES 24
+// length of the log in the EEPROM in entries of 64 bytes
+#define LOG_ENTRIES 32
+// time in us after which the uplink of a dose counts as lost
+#define UPLINK_TIMEOUT 120000000ULL
+
+void clear_log();
+
+// costs of one phase of the dose cycle
+typedef struct phase_result {
+    char name[32];
+    uint64_t virtual_us; // time on the virtual clock of the firmware
+    uint64_t host_cycles; // cycles of the host processor which ran the phase, only comparable on the same machine
+    uint32_t i2c_transactions;
+    uint32_t i2c_bytes; // bytes written and read from the EEPROM
+    uint64_t i2c_bus_us; // time in us during which the I2C bus was busy
+    uint32_t uart_bytes_out; // bytes which were sent to the LoRa module
+    uint32_t uart_bytes_in; // bytes which were received from the LoRa module
+    uint32_t console_bytes;
+    uint64_t console_us; // time in us which the firmware waited for the console
+} phase_result;
+
+// counters at the start of the phase which is currently measured
+typedef struct phase_counters {
+    uint64_t time;
+    uint64_t cycles;
+    i2c_host_stats i2c;
+    uart_stats uart;
+    sim_clock_stats clock;
+} phase_counters;
+
+phase_result results[MAX_PHASES];
+int result_count = 0;
+phase_counters phase_start;
+stepper_t bench_stepper;
+const stepperpins bench_pins[DISPENSER_COUNT] = DISPENSER_PINS;
+// true if every uplink was delivered by the emulated LoRa module in time
+bool uplinks_delivered = true;
+// entry which is written to the log during the wraparound phases, same length as a typical entry of the firmware
+char bench_entry[] = "(86400) Pill dispensed";
+
+/**
+ * reads the cycle counter of the host processor, or the monotonic clock in ns where no cycle counter is available
+ * @return cycles since an arbitrary point
+ */
+static uint64_t host_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+/**
+ * saves all counters at the start of a phase
+ */
+static void begin_phase() {
+    phase_start.i2c = *i2c_host_get_stats();
+    phase_start.uart = *uart_get_stats(UART_NR);
+    phase_start.clock = *sim_get_clock_stats();
+    phase_start.time = sim_now();
+    phase_start.cycles = host_cycles();
+}
+
+/**
+ * records the difference of all counters since begin_phase as the result of a phase
+ * @param name name of the phase in the report
+ */
+static void end_phase(const char *name) {
+    uint64_t cycles = host_cycles() - phase_start.cycles;
+    const i2c_host_stats *i2c = i2c_host_get_stats();
+    const uart_stats *uart = uart_get_stats(UART_NR);
+    const sim_clock_stats *clock = sim_get_clock_stats();
+
+    if (result_count >= MAX_PHASES) {
+        return;
+    }
+    phase_result *result = &results[result_count++];
+    snprintf(result->name, sizeof(result->name), "%s", name);
+    result->virtual_us = sim_now() - phase_start.time;
+    result->host_cycles = cycles;
+    result->i2c_transactions = i2c->transactions - phase_start.i2c.transactions;
+    result->i2c_bytes = i2c->bytes_written + i2c->bytes_read - phase_start.i2c.bytes_written -
+                        phase_start.i2c.bytes_read;
+    result->i2c_bus_us = i2c->bus_time - phase_start.i2c.bus_time;
+    result->uart_bytes_out = uart->bytes_out - phase_start.uart.bytes_out;
+    result->uart_bytes_in = uart->bytes_in - phase_start.uart.bytes_in;
+    result->console_bytes = clock->console_bytes - phase_start.clock.console_bytes;
+    result->console_us = clock->console_time - phase_start.clock.console_time;
+}
+
+/**
+ * records the result of a phase of a dose
+ * @param prefix prefix which tells the doses apart
+ * @param phase name of the phase within the dose
+ */
+static void end_dose_phase(const char *prefix, const char *phase) {
+    char name[32];
+    snprintf(name, sizeof(name), "%s_%s", prefix, phase);
+    end_phase(name);
+}
+
+/**
+ * runs one dose as dispense_doses of main.c does for a wheel which drops its pill, split into the phases
+ * of the dose cycle. The uplink phase ends when the emulated LoRa module has sent the frame with the dose
+ * @param prefix prefix of the phase names
+ */
+static void run_dose(const char *prefix) {
+    begin_phase();
+    schedule_start_dose();
+    start_rotation_by_one_compartment(&bench_stepper);
+    end_dose_phase(prefix, "state_save");
+
+    begin_phase();
+    while (bench_stepper.steps_remaining > 0) {
+        watchdog_update();
+    }
+    end_dose_phase(prefix, "motion");
+
+    begin_phase();
+    finish_rotation_by_one_compartment(&bench_stepper);
+    schedule_mark_served();
+    end_dose_phase(prefix, "finish");
+
+    begin_phase();
+    create_wheel_log(LOG_PILL_DISPENSED, 0);
+    end_dose_phase(prefix, "log");
+
+    // the events are collected during the batch window, so that the phase includes the window and a join if needed
+    begin_phase();
+    uint32_t uplinks = sim_modem_get_stats()->uplinks;
+    uint64_t deadline = sim_now() + UPLINK_TIMEOUT;
+    while ((sim_modem_get_stats()->uplinks == uplinks || backlog_count() > 0) && sim_now() < deadline) {
+        power_sleep_ms(100);
+    }
+    uplinks_delivered &= sim_now() < deadline;
+    end_dose_phase(prefix, "lora_uplink");
+}
+
+/**
+ * runs the phases of the benchmark on the virtual clock, starts from a new EEPROM like the first boot of a dispenser
+ */
+static void run_phases() {
+    begin_phase();
+    i2c_init(i2c0, BAUD_RATE_EEPROM);
+    uart_setup(UART_NR, UART_TX_PIN, UART_RX_PIN, BAUD_RATE_UART);
+    uart_enable_rx_dma(UART_NR);
+    lora_init();
+    power_set_idle_task(lora_poll);
+    stepper_init(&bench_stepper, &bench_pins[0], 0);
+    create_log(LOG_BOOT);
+    schedule_init();
+    remote_config_init();
+    initialize_stepper_data(&bench_stepper);
+    end_phase("boot");
+
+    begin_phase();
+    initialize_stepper(&bench_stepper);
+    end_phase("calibration");
+
+    // the first dose negotiates the UART speed and joins the network, the second one uses the session
+    run_dose("dose");
+    run_dose("dose_joined");
+
+    begin_phase();
+    recalibrate_by_one_compartment(&bench_stepper);
+    end_phase("recalibration");
+
+    // the search for a free slot reads the log from the start, so that the costs grow with the filling level
+    clear_log();
+    begin_phase();
+    write_log_entry(bench_entry, sizeof(bench_entry));
+    end_phase("log_append_first");
+    for (int i = 1; i < LOG_ENTRIES - 1; i++) {
+        write_log_entry(bench_entry, sizeof(bench_entry));
+    }
+    begin_phase();
+    write_log_entry(bench_entry, sizeof(bench_entry));
+    end_phase("log_append_last");
+    begin_phase();
+    write_log_entry(bench_entry, sizeof(bench_entry));
+    end_phase("log_wraparound");
+}
+
+/**
+ * writes the results as JSON, one phase per line, so that reports of two commits can be compared with a diff
+ * @param path path of the file
+ * @return true if the file was written, otherwise false
+ */
+static bool write_json(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        return false;
+    }
+    fprintf(file, "{\n  \"benchmark\": \"dispenser_bench\",\n  \"phases\": [\n");
+    for (int i = 0; i < result_count; i++) {
+        const phase_result *result = &results[i];
+        fprintf(file, "    {\"name\": \"%s\", \"virtual_us\": %llu, \"host_cycles\": %llu, "
+                      "\"i2c_transactions\": %u, \"i2c_bytes\": %u, \"i2c_bus_us\": %llu, \"uart_bytes_out\": %u, "
+                      "\"uart_bytes_in\": %u, \"console_bytes\": %u, \"console_us\": %llu}%s\n", result->name,
+                (unsigned long long) result->virtual_us, (unsigned long long) result->host_cycles,
+                result->i2c_transactions, result->i2c_bytes, (unsigned long long) result->i2c_bus_us,
+                result->uart_bytes_out, result->uart_bytes_in, result->console_bytes,
+                (unsigned long long) result->console_us, i + 1 < result_count ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    return fclose(file) == 0;
+}
+
+/**
+ * reads one number of a phase line of a JSON report
+ * @param line line of the phase
+ * @param key name of the value
+ * @return value, 0 if the line does not contain the key
+ */
+static unsigned long long json_value(const char *line, const char *key) {
+    char pattern[40];
+    snprintf(pattern, sizeof(pattern), "\"%s\": ", key);
+    const char *value = strstr(line, pattern);
+    return value != NULL ? strtoull(value + strlen(pattern), NULL, 10) : 0;
+}
+
+/**
+ * prints the change of the virtual time, the I2C transactions and the UART bytes of every phase
+ * against a report of an earlier run
+ * @param path path of the earlier report
+ * @return true if the report could be read, otherwise false
+ */
+static bool compare_json(const char *path) {
+    char line[512];
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return false;
+    }
+    fprintf(stdout, "\nchanges against %s:\n%-26s %14s %10s %10s %12s\n", path, "phase", "virtual us", "i2c", "uart out",
+            "host cycles");
+    while (fgets(line, sizeof(line), file) != NULL) {
+        const char *name = strstr(line, "\"name\": \"");
+        if (name == NULL) {
+            continue;
+        }
+        name += strlen("\"name\": \"");
+        for (int i = 0; i < result_count; i++) {
+            size_t length = strlen(results[i].name);
+            if (strncmp(name, results[i].name, length) != 0 || name[length] != '"') {
+                continue;
+            }
+            long long old_cycles = (long long) json_value(line, "host_cycles");
+            long long cycles = (long long) results[i].host_cycles - old_cycles;
+            fprintf(stdout, "%-26s %+14lld %+10lld %+10lld %+11.1f%%\n", results[i].name,
+                    (long long) results[i].virtual_us - (long long) json_value(line, "virtual_us"),
+                    (long long) results[i].i2c_transactions - (long long) json_value(line, "i2c_transactions"),
+                    (long long) results[i].uart_bytes_out - (long long) json_value(line, "uart_bytes_out"),
+                    old_cycles > 0 ? 100.0 * cycles / old_cycles : 0.0);
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+/**
+ * Benchmark of a dose cycle: the firmware modules run on the virtual clock of the simulator against the models
+ * of the dispenser wheel, the EEPROM and the LoRa-E5 module, and every phase of calibration, dose, recalibration
+ * and log wraparound is measured on its own. All values except the host cycles are deterministic, so that a change
+ * in the report is caused by a change of the firmware.
+ * usage: dispenser_bench [-v] [--output file] [--compare file]
+ * The report is written to dispenser_bench.json without --output. The exit code is 1 if an uplink was lost
+ */
+int main(int argc, char *argv[]) {
+    sim_wheel_config wheel = {4096, 170, 1365, 0x00, 0xFE, 64, 30000};
+    sim_modem_config modem = {9600, 5, 6000, 2000, NULL};
+    const char *output = "dispenser_bench.json";
+    const char *compare = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) {
+            host_set_verbose(true);
+        } else if (i + 1 >= argc) {
+            fprintf(stderr, "missing value of %s\n", argv[i]);
+            return 1;
+        } else if (strcmp(argv[i], "--output") == 0) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "--compare") == 0) {
+            compare = argv[++i];
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    sim_board_init(&wheel, DISPENSER_COUNT);
+    sim_modem_init(&modem);
+    sim_set_limit(UINT64_MAX);
+    const char *reason = sim_run(run_phases);
+    if (result_count == 0) {
+        fprintf(stderr, "benchmark stopped: %s\n", reason);
+        return 1;
+    }
+
+    fprintf(stdout, "%-26s %12s %12s %6s %7s %10s %8s %7s %8s %10s\n", "phase", "virtual us", "host cycles", "i2c",
+            "bytes", "bus us", "uart out", "in", "console", "console us");
+    for (int i = 0; i < result_count; i++) {
+        const phase_result *result = &results[i];
+        fprintf(stdout, "%-26s %12llu %12llu %6u %7u %10llu %8u %7u %8u %10llu\n", result->name,
+                (unsigned long long) result->virtual_us, (unsigned long long) result->host_cycles,
+                result->i2c_transactions, result->i2c_bytes, (unsigned long long) result->i2c_bus_us,
+                result->uart_bytes_out, result->uart_bytes_in, result->console_bytes,
+                (unsigned long long) result->console_us);
+    }
+    if (!write_json(output)) {
+        fprintf(stderr, "report %s could not be written\n", output);
+        return 1;
+    }
+    if (compare != NULL && !compare_json(compare)) {
+        fprintf(stderr, "report %s could not be read\n", compare);
+        return 1;
+    }
+    return uplinks_delivered ? 0 : 1;
+}
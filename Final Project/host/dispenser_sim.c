@@ -0,0 +1,206 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pico/stdlib.h"
+#include "hardware/i2c.h"
+#include "provided-libraries/uart.h"
+#include "board.h"
+#include "eeprom.h"
+#include "profile.h"
+#include "sim.h"
+
+// time in s after power on when the operator types the time on the console, the calibration is finished by then
+#define SET_TIME_DELAY 60
+
+// main function of main.c, renamed by the build
+int firmware_main();
+
+// command with which the operator sets the time
+char set_time_command[40];
+
+/**
+ * runs the firmware from the reset
+ */
+static void run_firmware() {
+    firmware_main();
+}
+
+/**
+ * returns the real time since an arbitrary point
+ * @return time in us
+ */
+static uint64_t real_time_us() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/**
+ * reads a date and time
+ * @param text date and time in the format YYYY-MM-DD HH:MM:SS
+ * @param seconds pointer where the seconds since 1.1.1970 are written to
+ * @return true if the text is valid, otherwise false
+ */
+static bool parse_time(const char *text, time_t *seconds) {
+    struct tm time = {0};
+    if (sscanf(text, "%d-%d-%d %d:%d:%d", &time.tm_year, &time.tm_mon, &time.tm_mday, &time.tm_hour, &time.tm_min,
+               &time.tm_sec) != 6) {
+        return false;
+    }
+    time.tm_year -= 1900;
+    time.tm_mon -= 1;
+    *seconds = timegm(&time);
+    return true;
+}
+
+/**
+ * lets the operator type the time on the console after power on
+ * @param start true time at power on in seconds since 1.1.1970
+ * @param delay time in s after power on when the time is typed
+ */
+static void set_time_on_console(time_t start, int delay) {
+    time_t now = start + delay;
+    struct tm time;
+    gmtime_r(&now, &time);
+    strftime(set_time_command, sizeof(set_time_command), "time %Y-%m-%d %H:%M:%S\n", &time);
+    sim_console_input((uint64_t) delay * 1000000, set_time_command);
+}
+
+/**
+ * Simulator of the whole dispenser: the unchanged firmware runs on a virtual clock against the models of the
+ * dispenser wheel, the piezo sensor, the EEPROM and the LoRa-E5 module. Waits for the next dose take no real time,
+ * so several days of operation are simulated in a fraction of a second. The same options give the same run.
+ * usage: dispenser_sim [-v] [--log] [--profile] [--eeprom file] [--days n] [--doses n] [--position steps]
+ *                      [--revolution steps] [--pills mask] [--fill mask] [--script file] [--modem-speed baud]
+ *                      [--latency ms] [--join-time ms] [--send-time ms] [--downlink hex]
+ *                      [--start "YYYY-MM-DD HH:MM:SS"] [--time-delay s] [--no-set-time] [--warm-reset file]
+ * Without --eeprom the EEPROM is new, with a file the next run continues with the content of the EEPROM.
+ * With --warm-reset the scratch registers of the watchdog are kept in a file, so that the end of a run is a reset
+ * by the watchdog and the next run with the file starts warm.
+ * The operator types the true time, which is 2024-01-01 00:00:00 at power on without --start, on the console
+ * one minute (--time-delay) after power on. With --no-set-time the time is never set, so no dose is dispensed.
+ * The exit code is 1 if the watchdog expired or the firmware waited without any wakeup source
+ */
+int main(int argc, char *argv[]) {
+    sim_wheel_config wheel = {4096, 170, 1365, 0x00, 0xFE, 64, 30000};
+    sim_modem_config modem = {9600, 5, 6000, 2000, NULL};
+    double days = 3;
+    int doses = 0;
+    bool print_eeprom_log = false;
+    bool print_profile = false;
+    bool set_time = true;
+    int time_delay = SET_TIME_DELAY;
+    time_t start_time;
+    parse_time("2024-01-01 00:00:00", &start_time);
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) {
+            host_set_verbose(true);
+        } else if (strcmp(argv[i], "--log") == 0) {
+            print_eeprom_log = true;
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            print_profile = true;
+        } else if (strcmp(argv[i], "--no-set-time") == 0) {
+            set_time = false;
+        } else if (i + 1 >= argc) {
+            fprintf(stderr, "missing value of %s\n", argv[i]);
+            return 1;
+        } else if (strcmp(argv[i], "--eeprom") == 0) {
+            if (!i2c_host_eeprom_file(argv[++i])) {
+                fprintf(stderr, "EEPROM file %s could not be opened\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--days") == 0) {
+            days = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--doses") == 0) {
+            doses = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--position") == 0) {
+            wheel.position = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--revolution") == 0) {
+            wheel.revolution_steps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--pills") == 0) {
+            wheel.pills = (uint8_t) strtol(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--fill") == 0) {
+            wheel.fill = (uint8_t) strtol(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--script") == 0) {
+            if (!sim_modem_load_script(argv[++i])) {
+                fprintf(stderr, "script %s could not be loaded\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--modem-speed") == 0) {
+            modem.speed = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--latency") == 0) {
+            modem.latency = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--join-time") == 0) {
+            modem.join_time = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--send-time") == 0) {
+            modem.send_time = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--warm-reset") == 0) {
+            sim_watchdog_file(argv[++i]);
+        } else if (strcmp(argv[i], "--downlink") == 0) {
+            modem.downlink = argv[++i];
+        } else if (strcmp(argv[i], "--time-delay") == 0) {
+            time_delay = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--start") == 0) {
+            if (!parse_time(argv[++i], &start_time)) {
+                fprintf(stderr, "start time %s is not valid\n", argv[i]);
+                return 1;
+            }
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    sim_board_init(&wheel, DISPENSER_COUNT);
+    sim_modem_init(&modem);
+    sim_set_operator(true);
+    if (set_time) {
+        set_time_on_console(start_time, time_delay);
+    }
+    sim_stop_after_doses(doses);
+    sim_set_limit((uint64_t) (days * 86400e6));
+
+    uint64_t start = real_time_us();
+    const char *reason = sim_run(run_firmware);
+    uint64_t wall_time = real_time_us() - start;
+    if (!sim_watchdog_save()) {
+        fprintf(stderr, "scratch registers could not be saved\n");
+        return 1;
+    }
+    // the firmware functions which are called for the report must not stop the simulation again
+    sim_set_limit(UINT64_MAX);
+
+    const sim_clock_stats *clock = sim_get_clock_stats();
+    const i2c_host_stats *i2c = i2c_host_get_stats();
+    const uart_stats *uart = uart_get_stats(UART_NR);
+    const sim_modem_stats *lora = sim_modem_get_stats();
+    double virtual_seconds = sim_now() / 1e6;
+    fprintf(stdout, "stopped: %s after %.3f s virtual time, %.3f s real time (%.0fx)\n", reason, virtual_seconds,
+            wall_time / 1e6, wall_time > 0 ? sim_now() / (double) wall_time : 0);
+    for (int i = 0; i < DISPENSER_COUNT; i++) {
+        const sim_wheel_stats *stats = sim_get_wheel_stats(i);
+        fprintf(stdout, "wheel %d: doses %u, pills dropped %u, piezo %u, steps forward %u, backward %u, lost %u, "
+                        "position %d\n", i, stats->doses, stats->pills_dropped, stats->piezo_events,
+                stats->steps_forward, stats->steps_backward, stats->lost_steps, stats->position);
+    }
+    fprintf(stdout, "clock: events %llu, idle waits %u, watchdog expiries %u, console %u bytes\n",
+            (unsigned long long) clock->events, clock->idle_waits, clock->watchdog_expiries, clock->console_bytes);
+    fprintf(stdout, "i2c: transactions %u, written %u, read %u bytes, page writes %u, naks %u\n",
+            i2c->transactions, i2c->bytes_written, i2c->bytes_read, i2c->page_writes, i2c->naks);
+    fprintf(stdout, "uart%d: in %u, out %u bytes; modem: commands %u, scripted %u, unreadable %u, joins %u, "
+                    "uplinks %u\n", UART_NR, uart->bytes_in, uart->bytes_out, lora->commands, lora->scripted,
+            lora->unreadable, lora->joins, lora->uplinks);
+    if (print_eeprom_log) {
+        host_set_verbose(true);
+        print_log();
+    }
+    if (print_profile) {
+        host_set_verbose(true);
+        profile_print_stats();
+    }
+    bool failed = clock->watchdog_expiries > 0 || strcmp(reason, "no wakeup source") == 0;
+    return failed ? 1 : 0;
+}
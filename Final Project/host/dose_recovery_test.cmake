@@ -0,0 +1,28 @@
+# Regression test of a dose which is interrupted by power loss: the first run of the simulator stops while the wheel
+# turns for the dose at 08:00, the second run continues with the same EEPROM half a minute later.
+# The recovery finishes the rotation, so the dose must not be dispensed a second time by the catch-up.
+# usage: cmake -DSIM=<dispenser_sim> -DEEPROM=<file> -P dose_recovery_test.cmake
+
+file(REMOVE ${EEPROM})
+
+# 28800.5 s after midnight the wheel is in the middle of the rotation of the dose at 08:00
+execute_process(COMMAND ${SIM} --eeprom ${EEPROM} --days 0.3333391
+        RESULT_VARIABLE result OUTPUT_VARIABLE output)
+if (NOT result EQUAL 0)
+    message(FATAL_ERROR "first run failed:\n${output}")
+endif ()
+
+# the second run ends after the dose at 14:00
+execute_process(COMMAND ${SIM} --eeprom ${EEPROM} --start "2024-01-01 08:00:30" --days 0.3 -v
+        RESULT_VARIABLE result OUTPUT_VARIABLE output)
+if (NOT result EQUAL 0)
+    message(FATAL_ERROR "second run failed:\n${output}")
+endif ()
+if (output MATCHES "Missed dose dispensed")
+    message(FATAL_ERROR "interrupted dose was dispensed again:\n${output}")
+endif ()
+string(REGEX MATCHALL "\\) (No pill|Pill) dispensed" doses "${output}")
+list(LENGTH doses dose_count)
+if (NOT dose_count EQUAL 1)
+    message(FATAL_ERROR "expected only the dose at 14:00, got ${dose_count} doses:\n${output}")
+endif ()
@@ -0,0 +1,49 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "pico/stdlib.h"
+#include "modem_emulator.h"
+
+/**
+ * Emulated LoRa-E5 module on a pseudo terminal, e.g. to connect a terminal program or another host build.
+ * usage: lora_e5_emulator [--latency ms] [--join-time ms] [--send-time ms] [--loss %] [--join-failure %]
+ *                         [--garbled %] [--session-loss %] [--downlink hex] [--seed n]
+ */
+int main(int argc, char *argv[]) {
+    modem_config config = {50, 6000, 2000, 0, 0, 0, 0, NULL, 1};
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--latency") == 0) {
+            config.latency = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--join-time") == 0) {
+            config.join_time = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--send-time") == 0) {
+            config.send_time = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--loss") == 0) {
+            config.loss = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--join-failure") == 0) {
+            config.join_failure = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--garbled") == 0) {
+            config.garbled = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--session-loss") == 0) {
+            config.session_loss = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--downlink") == 0) {
+            config.downlink = argv[i + 1];
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            config.seed = atoi(argv[i + 1]);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (modem_start(&config) < 0) {
+        fprintf(stderr, "pseudo terminal could not be created\n");
+        return 1;
+    }
+    fprintf(stdout, "LoRa-E5 emulator on %s\n", modem_device());
+    fflush(stdout);
+    while (true) {
+        pause();
+    }
+}
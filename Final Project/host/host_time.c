@@ -0,0 +1,79 @@
+#include <stdarg.h>
+#include <time.h>
+#include "pico/stdlib.h"
+
+// time of the firmware runs this many times faster than the real time, so that long timeouts can be tested quickly
+uint32_t time_scale = 1;
+bool verbose = false;
+// real time in us when the emulated time started
+uint64_t start_time = 0;
+
+/**
+ * returns the real time since an arbitrary point
+ * @return time in us
+ */
+static uint64_t real_time_us() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/**
+ * sets how many times faster than the real time the time of the firmware runs
+ * @param scale factor, 1 for real time
+ */
+void host_set_time_scale(uint32_t scale) {
+    if (start_time == 0) {
+        start_time = real_time_us();
+    }
+    time_scale = scale > 0 ? scale : 1;
+}
+
+/**
+ * enables the console output of the firmware
+ * @param enable true to show the output
+ */
+void host_set_verbose(bool enable) {
+    verbose = enable;
+}
+
+/**
+ * console output of the firmware
+ */
+int host_printf(const char *format, ...) {
+    if (!verbose) {
+        return 0;
+    }
+    va_list args;
+    va_start(args, format);
+    int result = vprintf(format, args);
+    va_end(args);
+    return result;
+}
+
+/**
+ * returns the emulated time since the start
+ * @return time in us
+ */
+uint64_t time_us_64() {
+    if (start_time == 0) {
+        start_time = real_time_us();
+    }
+    return (real_time_us() - start_time) * time_scale;
+}
+
+uint32_t time_us_32() {
+    return (uint32_t) time_us_64();
+}
+
+void sleep_us(uint64_t us) {
+    struct timespec duration;
+    uint64_t real = us / time_scale;
+    duration.tv_sec = real / 1000000;
+    duration.tv_nsec = (real % 1000000) * 1000;
+    nanosleep(&duration, NULL);
+}
+
+void sleep_ms(uint32_t ms) {
+    sleep_us((uint64_t) ms * 1000);
+}
@@ -0,0 +1,144 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include "hardware/i2c.h"
+
+// size of the emulated 24LC256 EEPROM
+#define EEPROM_SIZE 32768
+#define EEPROM_PAGE_SIZE 64
+#define EEPROM_ADDR 0x50
+// time in us of the internal write cycle, the EEPROM does not acknowledge any transaction meanwhile
+#define EEPROM_WRITE_CYCLE 5000
+// bits on the bus for every byte including the acknowledge bit
+#define BITS_PER_BYTE 9
+
+i2c_inst_t i2c0_inst = {0};
+
+uint8_t eeprom_memory[EEPROM_SIZE];
+bool eeprom_erased = false;
+// address pointer of the EEPROM, set by the first two bytes of a write
+uint16_t eeprom_pointer = 0;
+// file which keeps the content of the EEPROM between two runs, -1 if the content is only kept in memory
+int eeprom_fd = -1;
+// speed of the bus, 0 as long as i2c_init was not called. Then the transactions take no time
+uint i2c_baudrate = 0;
+// time when the current write cycle of the EEPROM is finished
+uint64_t write_cycle_end = 0;
+
+i2c_host_stats i2c_statistics = {0, 0, 0, 0, 0, 0};
+
+/**
+ * fills the emulated EEPROM like a new device
+ */
+static void erase() {
+    if (!eeprom_erased) {
+        memset(eeprom_memory, 0xFF, sizeof(eeprom_memory));
+        eeprom_erased = true;
+    }
+}
+
+/**
+ * keeps the content of the EEPROM in a file, so that a following run starts with the content of this run.
+ * A file which does not exist yet is created with the content of a new device
+ * @param path path of the file
+ * @return true if the file could be opened
+ */
+bool i2c_host_eeprom_file(const char *path) {
+    erase();
+    eeprom_fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (eeprom_fd < 0) {
+        return false;
+    }
+    ssize_t count = pread(eeprom_fd, eeprom_memory, EEPROM_SIZE, 0);
+    if (count < EEPROM_SIZE) {
+        memset(eeprom_memory + (count > 0 ? count : 0), 0xFF, EEPROM_SIZE - (count > 0 ? count : 0));
+        pwrite(eeprom_fd, eeprom_memory, EEPROM_SIZE, 0);
+    }
+    return true;
+}
+
+/**
+ * returns the counters of the emulated bus
+ * @return pointer to the counters
+ */
+const i2c_host_stats *i2c_host_get_stats() {
+    return &i2c_statistics;
+}
+
+/**
+ * sets the speed of the bus, from then on every transaction takes the time which it needs on the real bus
+ * @return the speed in baud
+ */
+uint i2c_init(i2c_inst_t *i2c, uint baudrate) {
+    (void) i2c;
+    i2c_baudrate = baudrate;
+    return baudrate;
+}
+
+/**
+ * counts a transaction and waits for the time it needs on the bus
+ * @param len amount of bytes after the device address
+ * @return false if the EEPROM does not acknowledge because its write cycle is not finished
+ */
+static bool transfer(size_t len) {
+    i2c_statistics.transactions++;
+    if (i2c_baudrate == 0) {
+        return true;
+    }
+    bool acknowledged = time_us_64() >= write_cycle_end;
+    if (!acknowledged) {
+        // only the device address is sent
+        i2c_statistics.naks++;
+        len = 0;
+    }
+    uint64_t duration = (len + 1) * BITS_PER_BYTE * 1000000ull / i2c_baudrate;
+    i2c_statistics.bus_time += duration;
+    sleep_us(duration);
+    return acknowledged;
+}
+
+/**
+ * sets the address pointer and writes the following bytes. Like the real device, the address wraps around
+ * at the end of the page
+ */
+int i2c_write_blocking(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop) {
+    (void) i2c;
+    (void) nostop;
+    erase();
+    if (addr != EEPROM_ADDR || len < 2 || !transfer(len)) {
+        return PICO_ERROR_GENERIC;
+    }
+    i2c_statistics.bytes_written += len;
+    eeprom_pointer = ((src[0] << 8) | src[1]) % EEPROM_SIZE;
+    uint16_t page = eeprom_pointer & ~(EEPROM_PAGE_SIZE - 1);
+    for (size_t i = 2; i < len; i++) {
+        eeprom_memory[page + (eeprom_pointer - page + i - 2) % EEPROM_PAGE_SIZE] = src[i];
+    }
+    if (len > 2) {
+        i2c_statistics.page_writes++;
+        if (i2c_baudrate > 0) {
+            write_cycle_end = time_us_64() + EEPROM_WRITE_CYCLE;
+        }
+        if (eeprom_fd >= 0) {
+            pwrite(eeprom_fd, eeprom_memory + page, EEPROM_PAGE_SIZE, page);
+        }
+    }
+    return (int) len;
+}
+
+/**
+ * reads from the address pointer, sequential reads continue over the page boundaries
+ */
+int i2c_read_blocking(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst, size_t len, bool nostop) {
+    (void) i2c;
+    (void) nostop;
+    erase();
+    if (addr != EEPROM_ADDR || !transfer(len)) {
+        return PICO_ERROR_GENERIC;
+    }
+    i2c_statistics.bytes_read += len;
+    for (size_t i = 0; i < len; i++) {
+        dst[i] = eeprom_memory[eeprom_pointer];
+        eeprom_pointer = (eeprom_pointer + 1) % EEPROM_SIZE;
+    }
+    return (int) len;
+}
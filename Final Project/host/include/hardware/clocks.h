@@ -0,0 +1,57 @@
+#ifndef UART_IRQ_HOST_HARDWARE_CLOCKS_H
+#define UART_IRQ_HOST_HARDWARE_CLOCKS_H
+
+// replacement of the clock generators for the host build. The simulator does not model the frequencies,
+// the registers only keep what the firmware writes
+
+#include "pico/stdlib.h"
+
+#define MHZ 1000000
+#define XOSC_MHZ 12
+
+#define CLOCKS_SLEEP_EN0_BITS 0xffffffffu
+#define CLOCKS_SLEEP_EN0_CLK_SYS_BUSFABRIC_BITS (1u << 4)
+#define CLOCKS_SLEEP_EN0_CLK_SYS_DMA_BITS (1u << 5)
+#define CLOCKS_SLEEP_EN0_CLK_SYS_IO_BITS (1u << 8)
+#define CLOCKS_SLEEP_EN0_CLK_SYS_PADS_BITS (1u << 11)
+#define CLOCKS_SLEEP_EN0_CLK_RTC_RTC_BITS (1u << 21)
+#define CLOCKS_SLEEP_EN0_CLK_SYS_RTC_BITS (1u << 22)
+#define CLOCKS_SLEEP_EN0_CLK_SYS_SRAM0_BITS (1u << 28)
+#define CLOCKS_SLEEP_EN0_CLK_SYS_SRAM1_BITS (1u << 29)
+#define CLOCKS_SLEEP_EN0_CLK_SYS_SRAM2_BITS (1u << 30)
+#define CLOCKS_SLEEP_EN0_CLK_SYS_SRAM3_BITS (1u << 31)
+
+#define CLOCKS_SLEEP_EN1_BITS 0x00007fffu
+#define CLOCKS_SLEEP_EN1_CLK_SYS_SRAM4_BITS (1u << 0)
+#define CLOCKS_SLEEP_EN1_CLK_SYS_SRAM5_BITS (1u << 1)
+#define CLOCKS_SLEEP_EN1_CLK_SYS_TIMER_BITS (1u << 5)
+#define CLOCKS_SLEEP_EN1_CLK_PERI_UART0_BITS (1u << 6)
+#define CLOCKS_SLEEP_EN1_CLK_SYS_UART0_BITS (1u << 7)
+#define CLOCKS_SLEEP_EN1_CLK_PERI_UART1_BITS (1u << 8)
+#define CLOCKS_SLEEP_EN1_CLK_SYS_UART1_BITS (1u << 9)
+#define CLOCKS_SLEEP_EN1_CLK_SYS_WATCHDOG_BITS (1u << 12)
+
+#define CLOCKS_CLK_REF_CTRL_SRC_VALUE_XOSC_CLKSRC 0x2
+#define CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLK_REF 0x0
+#define CLOCKS_CLK_RTC_CTRL_AUXSRC_VALUE_XOSC_CLKSRC 0x3
+#define CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLK_SYS 0x0
+
+enum clock_index {
+    clk_gpout0 = 0, clk_gpout1, clk_gpout2, clk_gpout3, clk_ref, clk_sys, clk_peri, clk_usb, clk_adc, clk_rtc,
+    CLK_COUNT
+};
+
+typedef struct clocks_hw_t {
+    uint32_t sleep_en0;
+    uint32_t sleep_en1;
+} clocks_hw_t;
+
+extern clocks_hw_t clocks_registers;
+#define clocks_hw (&clocks_registers)
+
+bool clock_configure(enum clock_index clk_index, uint32_t src, uint32_t auxsrc, uint32_t src_freq, uint32_t freq);
+void clock_stop(enum clock_index clk_index);
+void clocks_init();
+uint32_t clock_get_hz(enum clock_index clk_index);
+
+#endif //UART_IRQ_HOST_HARDWARE_CLOCKS_H
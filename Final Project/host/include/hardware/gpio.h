@@ -0,0 +1,43 @@
+#ifndef UART_IRQ_HOST_HARDWARE_GPIO_H
+#define UART_IRQ_HOST_HARDWARE_GPIO_H
+
+// replacement of the GPIO driver for the host build, the pins are connected to the models of the simulator
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GPIO_IN false
+#define GPIO_OUT true
+
+#define GPIO_IRQ_LEVEL_LOW 0x1u
+#define GPIO_IRQ_LEVEL_HIGH 0x2u
+#define GPIO_IRQ_EDGE_FALL 0x4u
+#define GPIO_IRQ_EDGE_RISE 0x8u
+
+enum gpio_function {
+    GPIO_FUNC_XIP = 0, GPIO_FUNC_SPI = 1, GPIO_FUNC_UART = 2, GPIO_FUNC_I2C = 3, GPIO_FUNC_PWM = 4,
+    GPIO_FUNC_SIO = 5, GPIO_FUNC_PIO0 = 6, GPIO_FUNC_PIO1 = 7, GPIO_FUNC_GPCK = 8, GPIO_FUNC_USB = 9,
+    GPIO_FUNC_NULL = 0x1f
+};
+
+typedef void (*gpio_irq_callback_t)(unsigned int gpio, uint32_t event_mask);
+
+void gpio_init(unsigned int gpio);
+void gpio_set_dir(unsigned int gpio, bool out);
+void gpio_pull_up(unsigned int gpio);
+void gpio_set_function(unsigned int gpio, enum gpio_function function);
+void gpio_put(unsigned int gpio, bool value);
+bool gpio_get(unsigned int gpio);
+void gpio_set_mask(uint32_t mask);
+void gpio_clr_mask(uint32_t mask);
+void gpio_set_irq_enabled_with_callback(unsigned int gpio, uint32_t events, bool enabled, gpio_irq_callback_t callback);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //UART_IRQ_HOST_HARDWARE_GPIO_H
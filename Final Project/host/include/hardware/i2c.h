@@ -0,0 +1,34 @@
+#ifndef UART_IRQ_HOST_HARDWARE_I2C_H
+#define UART_IRQ_HOST_HARDWARE_I2C_H
+
+// replacement of the I2C driver for the host build, the bus is connected to an emulated 24LC256 EEPROM
+
+#include "pico/stdlib.h"
+
+#define PICO_ERROR_GENERIC (-1)
+
+typedef struct i2c_inst {
+    int index;
+} i2c_inst_t;
+
+// counters of the emulated bus
+typedef struct i2c_host_stats {
+    uint32_t transactions; // write and read transactions
+    uint32_t bytes_written; // bytes after the device address, including the address pointer
+    uint32_t bytes_read;
+    uint32_t page_writes; // writes which started a write cycle of the EEPROM
+    uint32_t naks; // transactions which were not acknowledged because the EEPROM was busy
+    uint64_t bus_time; // time in us which the transactions took on the bus
+} i2c_host_stats;
+
+extern i2c_inst_t i2c0_inst;
+#define i2c0 (&i2c0_inst)
+
+uint i2c_init(i2c_inst_t *i2c, uint baudrate);
+int i2c_write_blocking(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop);
+int i2c_read_blocking(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst, size_t len, bool nostop);
+
+bool i2c_host_eeprom_file(const char *path);
+const i2c_host_stats *i2c_host_get_stats();
+
+#endif //UART_IRQ_HOST_HARDWARE_I2C_H
@@ -0,0 +1,21 @@
+#ifndef UART_IRQ_HOST_HARDWARE_PLL_H
+#define UART_IRQ_HOST_HARDWARE_PLL_H
+
+// replacement of the PLLs for the host build
+
+#include "pico/stdlib.h"
+
+typedef struct pll_hw_t {
+    bool running;
+} pll_hw_t;
+
+typedef pll_hw_t *PLL;
+
+extern pll_hw_t pll_sys_registers;
+extern pll_hw_t pll_usb_registers;
+#define pll_sys (&pll_sys_registers)
+#define pll_usb (&pll_usb_registers)
+
+void pll_deinit(PLL pll);
+
+#endif //UART_IRQ_HOST_HARDWARE_PLL_H
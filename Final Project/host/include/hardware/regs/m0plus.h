@@ -0,0 +1,9 @@
+#ifndef UART_IRQ_HOST_HARDWARE_REGS_M0PLUS_H
+#define UART_IRQ_HOST_HARDWARE_REGS_M0PLUS_H
+
+#define M0PLUS_SCR_SLEEPDEEP_BITS 0x00000004u
+#define M0PLUS_SYST_CSR_ENABLE_BITS 0x00000001u
+#define M0PLUS_SYST_CSR_CLKSOURCE_BITS 0x00000004u
+#define M0PLUS_SYST_RVR_RELOAD_BITS 0x00ffffffu
+
+#endif //UART_IRQ_HOST_HARDWARE_REGS_M0PLUS_H
@@ -0,0 +1,17 @@
+#ifndef UART_IRQ_HOST_HARDWARE_RTC_H
+#define UART_IRQ_HOST_HARDWARE_RTC_H
+
+// replacement of the RTC for the host build, the RTC runs on the virtual clock of the simulator
+
+#include "pico/stdlib.h"
+#include "pico/util/datetime.h"
+
+typedef void (*rtc_callback_t)(void);
+
+void rtc_init();
+bool rtc_set_datetime(datetime_t *t);
+bool rtc_get_datetime(datetime_t *t);
+void rtc_set_alarm(datetime_t *t, rtc_callback_t user_callback);
+void rtc_disable_alarm();
+
+#endif //UART_IRQ_HOST_HARDWARE_RTC_H
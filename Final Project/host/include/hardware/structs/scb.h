@@ -0,0 +1,15 @@
+#ifndef UART_IRQ_HOST_HARDWARE_STRUCTS_SCB_H
+#define UART_IRQ_HOST_HARDWARE_STRUCTS_SCB_H
+
+// replacement of the system control block of the processor for the host build
+
+#include <stdint.h>
+
+typedef struct armv6m_scb_hw_t {
+    uint32_t scr;
+} armv6m_scb_hw_t;
+
+extern armv6m_scb_hw_t scb_registers;
+#define scb_hw (&scb_registers)
+
+#endif //UART_IRQ_HOST_HARDWARE_STRUCTS_SCB_H
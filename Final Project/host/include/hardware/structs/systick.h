@@ -0,0 +1,19 @@
+#ifndef UART_IRQ_HOST_HARDWARE_STRUCTS_SYSTICK_H
+#define UART_IRQ_HOST_HARDWARE_STRUCTS_SYSTICK_H
+
+// replacement of the SysTick counter of the processor for the host build. The current value is calculated
+// from the virtual clock of the simulator whenever the counter is accessed
+
+#include <stdint.h>
+
+typedef struct systick_hw_t {
+    uint32_t csr;
+    uint32_t rvr;
+    uint32_t cvr;
+    uint32_t calib;
+} systick_hw_t;
+
+systick_hw_t *sim_systick();
+#define systick_hw (sim_systick())
+
+#endif //UART_IRQ_HOST_HARDWARE_STRUCTS_SYSTICK_H
@@ -0,0 +1,19 @@
+#ifndef UART_IRQ_HOST_HARDWARE_WATCHDOG_H
+#define UART_IRQ_HOST_HARDWARE_WATCHDOG_H
+
+// replacement of the watchdog for the host build, an expiry is counted by the simulator instead of a reset
+
+#include "pico/stdlib.h"
+
+typedef struct watchdog_hw_t {
+    uint32_t scratch[8];
+} watchdog_hw_t;
+
+extern watchdog_hw_t watchdog_registers;
+#define watchdog_hw (&watchdog_registers)
+
+void watchdog_enable(uint32_t delay_ms, bool pause_on_debug);
+void watchdog_update();
+bool watchdog_enable_caused_reboot();
+
+#endif //UART_IRQ_HOST_HARDWARE_WATCHDOG_H
@@ -0,0 +1,75 @@
+#ifndef UART_IRQ_HOST_PICO_STDLIB_H
+#define UART_IRQ_HOST_PICO_STDLIB_H
+
+// replacement of the Pico SDK for the host build. The LORA modules only use the time functions,
+// the other functions are implemented by the simulator of the whole dispenser
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include "hardware/gpio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef unsigned int uint;
+
+#define PICO_ERROR_TIMEOUT (-1)
+
+// alarms and repeating timers of the hardware timer
+typedef int32_t alarm_id_t;
+typedef int64_t (*alarm_callback_t)(alarm_id_t id, void *user_data);
+
+typedef struct repeating_timer repeating_timer_t;
+typedef bool (*repeating_timer_callback_t)(repeating_timer_t *timer);
+
+struct repeating_timer {
+    int64_t delay_us;
+    alarm_id_t alarm_id;
+    repeating_timer_callback_t callback;
+    void *user_data;
+};
+
+uint64_t time_us_64();
+uint32_t time_us_32();
+void sleep_ms(uint32_t ms);
+void sleep_us(uint64_t us);
+void tight_loop_contents();
+
+alarm_id_t add_alarm_in_ms(uint32_t ms, alarm_callback_t callback, void *user_data, bool fire_if_past);
+alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback, void *user_data, bool fire_if_past);
+bool cancel_alarm(alarm_id_t alarm_id);
+bool add_repeating_timer_ms(int32_t delay_ms, repeating_timer_callback_t callback, void *user_data,
+                            repeating_timer_t *out);
+bool cancel_repeating_timer(repeating_timer_t *timer);
+
+uint32_t save_and_disable_interrupts();
+void restore_interrupts(uint32_t status);
+void __wfi();
+
+bool stdio_init_all();
+int getchar_timeout_us(uint32_t timeout_us);
+void stdio_set_chars_available_callback(void (*fn)(void *), void *param);
+void uart_default_tx_wait_blocking();
+
+// console UART, the simulator sends the console output independent of the peripheral clock
+typedef struct uart_inst uart_inst_t;
+#define uart_default ((uart_inst_t *) NULL)
+#define PICO_DEFAULT_UART_BAUD_RATE 115200
+uint uart_set_baudrate(uart_inst_t *uart, uint baudrate);
+
+void host_set_time_scale(uint32_t scale);
+void host_set_verbose(bool verbose);
+int host_printf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+#ifdef __cplusplus
+}
+#endif
+
+// console output of the firmware is only shown in verbose mode
+#define printf host_printf
+
+#endif //UART_IRQ_HOST_PICO_STDLIB_H
@@ -0,0 +1,17 @@
+#ifndef UART_IRQ_HOST_PICO_UTIL_DATETIME_H
+#define UART_IRQ_HOST_PICO_UTIL_DATETIME_H
+
+#include <stdint.h>
+
+// date and time of the RTC, a negative field is not part of an alarm comparison
+typedef struct datetime_t {
+    int16_t year;
+    int8_t month;
+    int8_t day;
+    int8_t dotw;
+    int8_t hour;
+    int8_t min;
+    int8_t sec;
+} datetime_t;
+
+#endif //UART_IRQ_HOST_PICO_UTIL_DATETIME_H
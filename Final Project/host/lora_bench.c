@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "pico/stdlib.h"
+#include "modem_emulator.h"
+#include "../lora_mod.h"
+#include "../backlog.h"
+#include "../airtime.h"
+
+// the report of the benchmark is always printed, only the output of the firmware goes through host_printf
+#undef printf
+
+// emulated time runs this many times faster than the real time
+#define TIME_SCALE 20
+// amount of frames which are sent in every scenario
+#define FRAMES 10
+// time in us after which a frame counts as lost
+#define FRAME_DEADLINE 600000000ULL
+// UART where the firmware expects the LORA module
+#define LORA_UART 1
+// fastest data rate, so that the duty-cycle budget does not limit the benchmark
+#define BENCH_DATA_RATE 5
+
+void uart_host_attach(int uart_nr, int fd);
+
+// one fault scenario of the benchmark
+typedef struct scenario {
+    const char *name;
+    modem_config config;
+    bool join_failure_required; // the scenario is only valid if at least one join failed
+} scenario;
+
+const scenario scenarios[] = {
+        {"baseline", {50, 6000, 2000, 0, 0, 0, 0, NULL, 1}, false},
+        {"slow answers", {1500, 6000, 2000, 0, 0, 0, 0, NULL, 2}, false},
+        {"20% lost commands", {50, 6000, 2000, 20, 0, 0, 0, NULL, 3}, false},
+        // the session is lost often, so that the join is repeated and fails several times
+        {"50% join failures", {50, 6000, 2000, 0, 50, 0, 30, NULL, 4}, true},
+        {"5% garbled lines", {50, 6000, 2000, 0, 0, 5, 0, NULL, 5}, false},
+        {"30% session loss", {50, 6000, 2000, 0, 0, 0, 30, NULL, 6}, false},
+        {"dead modem", {50, 6000, 2000, 100, 0, 0, 0, NULL, 7}, false}
+};
+
+/**
+ * sends FRAMES frames through lora_mod against the emulated module and prints the time of every send path
+ * @param test scenario to run
+ */
+static void run_scenario(const scenario *test) {
+    uint8_t payload[] = {0x05, 0x00, 0x01, 0x2A};
+    uint64_t total = 0, minimum = UINT64_MAX, maximum = 0;
+    int sent = 0;
+
+    host_set_time_scale(TIME_SCALE);
+    int fd = modem_start(&test->config);
+    if (fd < 0) {
+        fprintf(stderr, "pseudo terminal could not be created\n");
+        exit(1);
+    }
+    uart_host_attach(LORA_UART, fd);
+    lora_init();
+    lora_set_data_rate(BENCH_DATA_RATE);
+
+    for (int i = 0; i < FRAMES; i++) {
+        payload[2] = i;
+        send_lora_payload(payload, sizeof(payload), true);
+        uint64_t start = time_us_64();
+        while (backlog_count() > 0 && time_us_64() - start < FRAME_DEADLINE) {
+            lora_poll();
+            usleep(200);
+        }
+        if (backlog_count() > 0) {
+            break;
+        }
+        uint64_t duration = time_us_64() - start;
+        total += duration;
+        minimum = duration < minimum ? duration : minimum;
+        maximum = duration > maximum ? duration : maximum;
+        sent++;
+    }
+    modem_stop();
+
+    const modem_stats *modem = modem_get_stats();
+    if (test->join_failure_required && modem->failed_joins == 0) {
+        fprintf(stderr, "%s: no join failed, the scenario does not test join failures\n", test->name);
+        exit(1);
+    }
+    printf("%-20s %5d/%d %9llu %9llu %9llu %8u %6u %6u %8u\n", test->name, sent, FRAMES,
+           sent ? (unsigned long long) (total / sent / 1000) : 0, sent ? (unsigned long long) (minimum / 1000) : 0,
+           (unsigned long long) (maximum / 1000), modem->commands, modem->lost, modem->joins,
+           airtime_get_stats()->transmissions);
+}
+
+/**
+ * Benchmark of the send paths of lora_mod against the emulated LoRa-E5 module under several fault scenarios.
+ * Every scenario runs in its own process, so that it starts with a fresh firmware state.
+ * usage: lora_bench [-v]   -v shows the console output of the firmware
+ */
+int main(int argc, char *argv[]) {
+    host_set_verbose(argc > 1 && strcmp(argv[1], "-v") == 0);
+    int failed = 0;
+    printf("%-20s %7s %9s %9s %9s %8s %6s %6s %8s\n", "scenario", "sent", "avg ms", "min ms", "max ms",
+           "commands", "lost", "joins", "tx");
+    for (unsigned int i = 0; i < sizeof(scenarios) / sizeof(scenario); i++) {
+        fflush(stdout);
+        pid_t child = fork();
+        if (child == 0) {
+            run_scenario(&scenarios[i]);
+            fflush(stdout);
+            _exit(0);
+        }
+        int status;
+        waitpid(child, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            failed = 1;
+        }
+    }
+    return failed;
+}
@@ -0,0 +1,237 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <termios.h>
+#include <unistd.h>
+#include "pico/stdlib.h"
+#include "modem_emulator.h"
+
+#define LINE_LENGTH 256
+
+// state of the emulated LoRa-E5 module
+typedef struct modem {
+    modem_config config;
+    modem_stats stats;
+    int master; // master side of the pseudo terminal
+    pthread_t thread;
+    volatile bool running;
+    bool joined;
+    unsigned int random;
+    char line[LINE_LENGTH];
+    int line_length;
+} modem;
+
+modem emulator;
+
+/**
+ * decides randomly if a fault happens
+ * @param probability probability in percent
+ * @return true if the fault happens
+ */
+static bool chance(uint8_t probability) {
+    return probability > 0 && (uint8_t) (rand_r(&emulator.random) % 100) < probability;
+}
+
+/**
+ * sends one line of an answer, the line may be corrupted
+ * @param line line without line ending
+ */
+static void reply(const char *line) {
+    char out[LINE_LENGTH + 2];
+    int length = snprintf(out, sizeof(out), "%s\r\n", line);
+    if (chance(emulator.config.garbled)) {
+        out[rand_r(&emulator.random) % (length - 2)] = (char) ('!' + rand_r(&emulator.random) % 90);
+    }
+    write(emulator.master, out, length);
+}
+
+/**
+ * answers a join request
+ * @param force true if a new session is started even if the module has already joined
+ */
+static void join(bool force) {
+    emulator.stats.joins++;
+    reply("+JOIN: Start");
+    reply(force ? "+JOIN: FORCE" : "+JOIN: NORMAL");
+    if (emulator.joined && !force) {
+        reply("+JOIN: Joined already");
+    } else {
+        sleep_ms(emulator.config.join_time);
+        if (chance(emulator.config.join_failure)) {
+            emulator.stats.failed_joins++;
+            reply("+JOIN: Join failed");
+        } else {
+            emulator.joined = true;
+            reply("+JOIN: Network joined");
+            reply("+JOIN: NetID 000013 DevAddr 26:0B:12:34");
+        }
+    }
+    reply("+JOIN: Done");
+}
+
+/**
+ * answers an uplink with a hexadecimal payload
+ * @param payload payload in quotes
+ */
+static void send_hex(const char *payload) {
+    char line[LINE_LENGTH];
+    if (chance(emulator.config.session_loss)) {
+        emulator.joined = false;
+    }
+    if (!emulator.joined) {
+        reply("+MSGHEX: Please join network first");
+        return;
+    }
+    if (payload[0] != '"') {
+        reply("+MSGHEX: ERROR(-1)");
+        return;
+    }
+    emulator.stats.uplinks++;
+    reply("+MSGHEX: Start");
+    sleep_ms(emulator.config.send_time);
+    if (emulator.config.downlink != NULL) {
+        snprintf(line, sizeof(line), "+MSGHEX: PORT: 8; RX: \"%s\"", emulator.config.downlink);
+        reply(line);
+    }
+    reply("+MSGHEX: RXWIN1, RSSI -106, SNR 4.0");
+    reply("+MSGHEX: Done");
+}
+
+/**
+ * executes one received command
+ * @param command command without line ending
+ */
+static void execute(const char *command) {
+    char upper[LINE_LENGTH];
+    int i;
+    for (i = 0; command[i] != '\0' && command[i] != '=' && i < LINE_LENGTH - 1; i++) {
+        upper[i] = (char) toupper((unsigned char) command[i]);
+    }
+    upper[i] = '\0';
+    const char *argument = command[i] == '=' ? &command[i + 1] : "";
+
+    emulator.stats.commands++;
+    if (chance(emulator.config.loss)) {
+        emulator.stats.lost++;
+        return;
+    }
+    sleep_ms(emulator.config.latency);
+    if (strcmp(upper, "AT") == 0) {
+        reply("+AT: OK");
+    } else if (strcmp(upper, "AT+MODE") == 0) {
+        reply("+MODE: LWOTAA");
+    } else if (strcmp(upper, "AT+KEY") == 0) {
+        reply("+KEY: APPKEY B8C1C1466DED5D2FB668555B36D152F7");
+    } else if (strcmp(upper, "AT+CLASS") == 0) {
+        reply("+CLASS: A");
+    } else if (strcmp(upper, "AT+PORT") == 0) {
+        char line[LINE_LENGTH];
+        snprintf(line, sizeof(line), "+PORT: %s", argument);
+        reply(line);
+    } else if (strcmp(upper, "AT+UART") == 0) {
+        // the new speed is active after the reset, the pseudo terminal has no speed
+        char line[LINE_LENGTH];
+        snprintf(line, sizeof(line), "+UART: %s", argument);
+        reply(line);
+    } else if (strcmp(upper, "AT+RESET") == 0) {
+        emulator.joined = false;
+        reply("+RESET: OK");
+    } else if (strcmp(upper, "AT+JOIN") == 0) {
+        join(strcasecmp(argument, "FORCE") == 0);
+    } else if (strcmp(upper, "AT+MSGHEX") == 0) {
+        send_hex(argument);
+    } else {
+        // the unknown command is truncated, so that the answer fits into one line
+        char line[LINE_LENGTH];
+        snprintf(line, sizeof(line), "+%.200s: ERROR(-1)", strncmp(upper, "AT+", 3) == 0 ? upper + 3 : upper);
+        reply(line);
+    }
+}
+
+/**
+ * thread of the emulated module, collects the received characters to lines and executes them
+ */
+static void *modem_thread(void *argument) {
+    (void) argument;
+    struct pollfd fd = {emulator.master, POLLIN, 0};
+    char buffer[64];
+
+    while (emulator.running) {
+        if (poll(&fd, 1, 10) <= 0) {
+            continue;
+        }
+        ssize_t count = read(emulator.master, buffer, sizeof(buffer));
+        for (ssize_t i = 0; i < count; i++) {
+            if (buffer[i] == '\n') {
+                emulator.line[emulator.line_length] = '\0';
+                if (emulator.line_length > 0) {
+                    execute(emulator.line);
+                }
+                emulator.line_length = 0;
+            } else if (buffer[i] != '\r' && emulator.line_length < LINE_LENGTH - 1) {
+                emulator.line[emulator.line_length++] = buffer[i];
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * creates a pseudo terminal and starts the emulated module on its master side
+ * @param config behaviour of the module
+ * @return non-blocking file descriptor of the slave side where the firmware is connected, -1 on error
+ */
+int modem_start(const modem_config *config) {
+    struct termios settings;
+
+    memset(&emulator, 0, sizeof(emulator));
+    emulator.config = *config;
+    emulator.random = config->seed;
+    emulator.master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (emulator.master < 0 || grantpt(emulator.master) != 0 || unlockpt(emulator.master) != 0) {
+        return -1;
+    }
+    int slave = open(ptsname(emulator.master), O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (slave < 0) {
+        return -1;
+    }
+    // raw mode, the line endings are passed unchanged and nothing is echoed
+    tcgetattr(slave, &settings);
+    cfmakeraw(&settings);
+    tcsetattr(slave, TCSANOW, &settings);
+
+    emulator.running = true;
+    pthread_create(&emulator.thread, NULL, modem_thread, NULL);
+    return slave;
+}
+
+/**
+ * stops the emulated module
+ */
+void modem_stop() {
+    emulator.running = false;
+    pthread_join(emulator.thread, NULL);
+    close(emulator.master);
+}
+
+/**
+ * returns the path of the slave side of the pseudo terminal, e.g. to connect a terminal program
+ * @return path of the device
+ */
+const char *modem_device() {
+    return ptsname(emulator.master);
+}
+
+/**
+ * returns the counters of the emulated module
+ * @return pointer to the counters
+ */
+const modem_stats *modem_get_stats() {
+    return &emulator.stats;
+}
@@ -0,0 +1,37 @@
+#ifndef UART_IRQ_MODEM_EMULATOR_H
+#define UART_IRQ_MODEM_EMULATOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// behaviour of the emulated LoRa-E5 module, all times are in ms of the emulated time
+typedef struct modem_config {
+    uint32_t latency; // time until the first line of an answer
+    uint32_t join_time; // duration of a join procedure
+    uint32_t send_time; // duration of an uplink including the receive windows
+    uint8_t loss; // probability in percent that a command is not answered at all
+    uint8_t join_failure; // probability in percent that a join fails
+    uint8_t garbled; // probability in percent that a character of an answer line is corrupted
+    uint8_t session_loss; // probability in percent that the network session is lost before an uplink
+    const char *downlink; // hexadecimal payload which is received after every uplink, NULL for no downlink
+    unsigned int seed; // seed of the random faults
+} modem_config;
+
+// counters of the emulated module
+typedef struct modem_stats {
+    uint32_t commands; // amount of received commands
+    uint32_t lost; // commands which were not answered
+    uint32_t joins; // join requests
+    uint32_t failed_joins; // join requests which were answered with a failure
+    uint32_t uplinks; // uplinks which were sent
+} modem_stats;
+
+int modem_start(const modem_config *config);
+
+void modem_stop();
+
+const char *modem_device();
+
+const modem_stats *modem_get_stats();
+
+#endif //UART_IRQ_MODEM_EMULATOR_H
@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sched.h>
+#include "../provided-libraries/ring_buffer.h"
+
+// amount of bytes which go through the ring buffer
+#define STRESS_BYTES 10000000U
+// size of the ring buffer, small so that it wraps and runs full often
+#define RING_SIZE 64
+
+ring_buffer ring;
+unsigned int producer_seed = 1;
+unsigned int consumer_seed = 2;
+// set by the consumer if a byte of the stream was lost, duplicated or changed
+bool stress_failed = false;
+
+/**
+ * value of the byte at a position of the stream, so that lost, duplicated and reordered bytes are detected
+ * @param position position in the stream
+ * @return expected value
+ */
+static uint8_t stream_byte(uint32_t position) {
+    return (uint8_t) (position * 2654435761U >> 24);
+}
+
+/**
+ * writes the stream with single puts, bulk writes and spans of random length
+ */
+static void *producer(void *arg) {
+    (void) arg;
+    uint8_t chunk[RING_SIZE];
+    uint32_t position = 0;
+
+    while (position < STRESS_BYTES) {
+        int length = rand_r(&producer_seed) % RING_SIZE + 1;
+        if (position + length > STRESS_BYTES) {
+            length = STRESS_BYTES - position;
+        }
+        switch (rand_r(&producer_seed) % 3) {
+            case 0:
+                if (rb_put(&ring, stream_byte(position))) {
+                    position++;
+                }
+                break;
+            case 1:
+                for (int i = 0; i < length; i++) {
+                    chunk[i] = stream_byte(position + i);
+                }
+                position += rb_write_bulk(&ring, chunk, length);
+                break;
+            case 2: {
+                int space;
+                uint8_t *span = rb_write_span(&ring, &space);
+                if (space > length) {
+                    space = length;
+                }
+                for (int i = 0; i < space; i++) {
+                    span[i] = stream_byte(position + i);
+                }
+                rb_commit(&ring, space);
+                position += space;
+                break;
+            }
+        }
+        if (rb_full(&ring)) {
+            // gives the consumer a chance to run on a single core
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+/**
+ * reads the stream with single gets, bulk reads, peeks and spans of random length and checks every byte
+ */
+static void *consumer(void *arg) {
+    (void) arg;
+    uint8_t chunk[RING_SIZE];
+    uint32_t position = 0;
+
+    while (position < STRESS_BYTES) {
+        int length = rand_r(&consumer_seed) % RING_SIZE + 1;
+        int count = 0;
+        const uint8_t *data = chunk;
+
+        switch (rand_r(&consumer_seed) % 4) {
+            case 0:
+                if (!rb_empty(&ring)) {
+                    chunk[0] = rb_get(&ring);
+                    count = 1;
+                }
+                break;
+            case 1:
+                count = rb_read_bulk(&ring, chunk, length);
+                break;
+            case 2:
+                // peeked data has to stay in the buffer
+                count = rb_peek(&ring, chunk, length);
+                for (int i = 0; i < count; i++) {
+                    if (chunk[i] != stream_byte(position + i)) {
+                        printf("peek mismatch at byte %u\n", position + i);
+                        stress_failed = true;
+                        return NULL;
+                    }
+                }
+                count = 0;
+                break;
+            case 3:
+                data = rb_read_span(&ring, &count);
+                if (count > length) {
+                    count = length;
+                }
+                break;
+        }
+        for (int i = 0; i < count; i++) {
+            if (data[i] != stream_byte(position + i)) {
+                printf("mismatch at byte %u\n", position + i);
+                stress_failed = true;
+                return NULL;
+            }
+        }
+        if (data != chunk) {
+            rb_consume(&ring, count);
+        }
+        position += count;
+        if (rb_empty(&ring)) {
+            sched_yield();
+        }
+    }
+    stress_failed |= !rb_empty(&ring);
+    return NULL;
+}
+
+/**
+ * runs a producer and a consumer thread on the same ring buffer and checks that the stream arrives unchanged
+ * @return 0 if the stream arrived unchanged, otherwise 1
+ */
+int main() {
+    pthread_t producer_thread;
+    pthread_t consumer_thread;
+
+    rb_alloc(&ring, RING_SIZE);
+    pthread_create(&producer_thread, NULL, producer, NULL);
+    pthread_create(&consumer_thread, NULL, consumer, NULL);
+    pthread_join(producer_thread, NULL);
+    pthread_join(consumer_thread, NULL);
+    rb_free(&ring);
+
+    printf("ring buffer stress: %u bytes, %s\n", STRESS_BYTES, stress_failed ? "FAILED" : "ok");
+    return stress_failed ? 1 : 0;
+}
@@ -0,0 +1,91 @@
+#ifndef UART_IRQ_SIM_H
+#define UART_IRQ_SIM_H
+
+// simulator of the whole dispenser on the host: virtual clock, dispenser wheels, piezo sensors, button
+// and scripted LoRa-E5 module. The firmware runs unchanged against the replaced Pico SDK in host/include
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// maximum amount of events which can be pending at the same time
+#define SIM_MAX_EVENTS 64
+// time in us which every access to the hardware in a polling loop takes
+#define SIM_POLL_COST 1
+// frequency of the system clock in Hz while the PLL runs, the SysTick counter counts with it
+#define SIM_SYS_CLOCK 125000000
+
+// called when an event of the virtual clock is due, in interrupt context
+typedef void (*sim_handler)(void *data);
+
+// physical properties of one dispenser wheel
+typedef struct sim_wheel_config {
+    int revolution_steps; // half steps of one revolution
+    int opto_width; // steps in which the opto sensor is blocked, centered at point zero
+    int position; // steps after point zero at power on
+    uint8_t pills; // compartments which contain a pill at power on, bit 1 to 7
+    uint8_t fill; // compartments which the operator fills with a pill when the firmware asks for it
+    int drop_lead; // steps before the center of a compartment where its pill falls through the hole
+    uint32_t fall_time; // time in us from the drop until the piezo sensor detects the pill
+} sim_wheel_config;
+
+// counters of one dispenser wheel
+typedef struct sim_wheel_stats {
+    int position; // steps after point zero
+    uint32_t steps_forward;
+    uint32_t steps_backward;
+    uint32_t lost_steps; // phase changes which skipped a step of the driver sequence
+    uint32_t doses; // compartments which reached the hole for the first time after filling
+    uint32_t pills_dropped;
+    uint32_t piezo_events; // pills which were reported by the piezo sensor interrupt
+} sim_wheel_stats;
+
+// behaviour of the scripted LoRa-E5 module, all times are in ms
+typedef struct sim_modem_config {
+    int speed; // speed of the UART of the module at power on
+    uint32_t latency; // time until the first line of an answer
+    uint32_t join_time; // duration of a join procedure
+    uint32_t send_time; // duration of an uplink including the receive windows
+    const char *downlink; // hexadecimal payload which is received after every uplink, NULL for no downlink
+} sim_modem_config;
+
+// counters of the scripted LoRa-E5 module
+typedef struct sim_modem_stats {
+    uint32_t commands; // received commands
+    uint32_t scripted; // commands which were answered by the script
+    uint32_t unreadable; // commands and answers which were lost because the speeds did not match
+    uint32_t joins;
+    uint32_t uplinks;
+} sim_modem_stats;
+
+// counters of the virtual clock
+typedef struct sim_clock_stats {
+    uint64_t events; // events which were handled
+    uint32_t idle_waits; // calls of __wfi
+    uint32_t watchdog_expiries; // times the watchdog would have reset the processor
+    uint32_t console_bytes; // bytes of the console output
+    uint64_t console_time; // time in us which the firmware waited for the console output
+} sim_clock_stats;
+
+uint64_t sim_now();
+void sim_advance(uint64_t us);
+uint32_t sim_schedule(uint64_t time, sim_handler handler, void *data);
+bool sim_cancel(uint32_t id);
+void sim_set_limit(uint64_t time);
+void sim_request_stop(const char *reason);
+const char *sim_run(void (*firmware)(void));
+const sim_clock_stats *sim_get_clock_stats();
+void sim_console_input(uint64_t time, const char *text);
+void sim_watchdog_file(const char *path);
+bool sim_watchdog_save();
+
+void sim_board_init(const sim_wheel_config *wheel, int wheel_count);
+void sim_press_button(uint64_t time, uint32_t duration);
+void sim_set_operator(bool enabled);
+void sim_stop_after_doses(uint32_t doses);
+const sim_wheel_stats *sim_get_wheel_stats(int wheel);
+
+void sim_modem_init(const sim_modem_config *config);
+bool sim_modem_load_script(const char *path);
+const sim_modem_stats *sim_modem_get_stats();
+
+#endif //UART_IRQ_SIM_H
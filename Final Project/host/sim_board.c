@@ -0,0 +1,353 @@
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/pll.h"
+#include "hardware/structs/scb.h"
+#include "board.h"
+#include "stepper.h"
+#include "sim.h"
+
+#define GPIO_COUNT 30
+// time in us the operator keeps the button pressed
+#define PRESS_DURATION 500000
+// time in us the LED has to be on until the operator fills the dispenser and presses the button
+#define OPERATOR_DELAY 1000000
+// time in us the LED has to blink until the operator presses the button to start the dispenser
+#define OPERATOR_BLINK_TIME 10000000
+
+// one dispenser wheel with its stepper motor, opto sensor and piezo sensor
+typedef struct sim_wheel {
+    sim_wheel_config config;
+    sim_wheel_stats stats;
+    stepperpins pins;
+    uint8_t piezo_sensor;
+    uint8_t pills;
+    uint8_t served; // compartments which already reached the hole since the last filling
+    int phase; // step of the driver sequence which is set at the motor controllers, -1 if none
+} sim_wheel;
+
+// driver sequence of the motor controllers A to D, like in stepper_driver.hpp
+const uint8_t sim_half_steps[8] = {0b0001, 0b0011, 0b0010, 0b0110, 0b0100, 0b1100, 0b1000, 0b1001};
+
+const stepperpins sim_wheel_pins[DISPENSER_COUNT] = DISPENSER_PINS;
+const uint8_t sim_piezo_sensors[DISPENSER_COUNT] = DISPENSER_PIEZO_SENSORS;
+
+sim_wheel sim_wheels[DISPENSER_COUNT];
+int sim_wheel_count = 0;
+
+// state of the pins, the inputs are driven by the models
+bool gpio_out[GPIO_COUNT];
+bool gpio_output[GPIO_COUNT];
+bool gpio_pulled_up[GPIO_COUNT];
+uint32_t gpio_irq_events[GPIO_COUNT];
+gpio_irq_callback_t gpio_callback = NULL;
+
+bool button_pressed = false;
+// the operator presses the button when the firmware asks for it, instead of pressing at fixed times
+bool operator_enabled = false;
+uint32_t led_changes = 0;
+// time when the LED started to blink, 0 if it is not blinking
+uint64_t blink_start = 0;
+uint64_t last_led_change = 0;
+
+uint32_t dose_limit = 0;
+
+clocks_hw_t clocks_registers = {CLOCKS_SLEEP_EN0_BITS, CLOCKS_SLEEP_EN1_BITS};
+armv6m_scb_hw_t scb_registers = {0};
+pll_hw_t pll_sys_registers = {true};
+pll_hw_t pll_usb_registers = {true};
+
+/**
+ * returns the position of a wheel within one revolution
+ * @return steps after point zero, 0 to revolution_steps - 1
+ */
+static int wheel_angle(const sim_wheel *wheel) {
+    int steps = wheel->config.revolution_steps;
+    return ((wheel->stats.position % steps) + steps) % steps;
+}
+
+/**
+ * checks if the opto sensor of a wheel is blocked, the window is centered at point zero
+ * @return true if the wheel is within the window
+ */
+static bool opto_blocked(const sim_wheel *wheel) {
+    int angle = wheel_angle(wheel);
+    int half = wheel->config.opto_width / 2;
+    return angle < half || angle >= wheel->config.revolution_steps - half;
+}
+
+/**
+ * handler of a falling pill, the piezo sensor below the output reports it by an interrupt
+ */
+static void pill_landed(void *data) {
+    sim_wheel *wheel = data;
+    if (gpio_callback != NULL && (gpio_irq_events[wheel->piezo_sensor] & GPIO_IRQ_EDGE_FALL)) {
+        wheel->stats.piezo_events++;
+        gpio_callback(wheel->piezo_sensor, GPIO_IRQ_EDGE_FALL);
+    }
+}
+
+/**
+ * moves a wheel by one step. A pill falls when its compartment reaches the hole, a dose is counted
+ * when a compartment reaches the center of the hole for the first time after filling
+ * @param direction 1 for forward, -1 for backward
+ */
+static void move_wheel(sim_wheel *wheel, int direction) {
+    wheel->stats.position += direction;
+    if (direction < 0) {
+        wheel->stats.steps_backward++;
+        return;
+    }
+    wheel->stats.steps_forward++;
+    int angle = wheel_angle(wheel);
+    int steps = wheel->config.revolution_steps;
+    for (int compartment = 1; compartment < COMPARTMENTS; compartment++) {
+        int center = compartment * steps / COMPARTMENTS;
+        if (angle == center - wheel->config.drop_lead && (wheel->pills & (1 << compartment))) {
+            wheel->pills &= ~(1 << compartment);
+            wheel->stats.pills_dropped++;
+            sim_schedule(sim_now() + wheel->config.fall_time, pill_landed, wheel);
+        }
+        if (angle == center && !(wheel->served & (1 << compartment))) {
+            wheel->served |= 1 << compartment;
+            if (++wheel->stats.doses == dose_limit && wheel == &sim_wheels[0]) {
+                sim_request_stop("doses dispensed");
+            }
+        }
+    }
+}
+
+/**
+ * decodes the step of the driver sequence from the motor controllers of every wheel and turns the wheel
+ * if the step changed by one
+ */
+static void update_wheels() {
+    for (int i = 0; i < sim_wheel_count; i++) {
+        sim_wheel *wheel = &sim_wheels[i];
+        uint8_t pattern = 0;
+        for (int controller = 0; controller < 4; controller++) {
+            if (gpio_out[wheel->pins.motor_controllers[controller]]) {
+                pattern |= 1 << controller;
+            }
+        }
+        int phase = -1;
+        for (int step = 0; step < 8; step++) {
+            if (sim_half_steps[step] == pattern) {
+                phase = step;
+            }
+        }
+        // the rotor does not move while no or an invalid combination of controllers is set
+        if (phase < 0 || phase == wheel->phase) {
+            continue;
+        }
+        if (wheel->phase >= 0) {
+            int difference = (phase - wheel->phase + 8) % 8;
+            if (difference == 1) {
+                move_wheel(wheel, 1);
+            } else if (difference == 7) {
+                move_wheel(wheel, -1);
+            } else {
+                wheel->stats.lost_steps++;
+            }
+        }
+        wheel->phase = phase;
+    }
+}
+
+/**
+ * sets up the dispenser wheels of the board, every wheel starts with the same configuration
+ * @param wheel physical properties of a wheel
+ * @param wheel_count amount of wheels, at most DISPENSER_COUNT
+ */
+void sim_board_init(const sim_wheel_config *wheel, int wheel_count) {
+    sim_wheel_count = wheel_count < DISPENSER_COUNT ? wheel_count : DISPENSER_COUNT;
+    for (int i = 0; i < sim_wheel_count; i++) {
+        // compartments without a pill at power on have been served before, the calibration turns the wheel
+        // before the dispenser is filled and does not count as doses
+        sim_wheels[i] = (sim_wheel) {*wheel, {.position = wheel->position}, sim_wheel_pins[i], sim_piezo_sensors[i],
+                                     wheel->pills, (uint8_t) ~wheel->pills, -1};
+    }
+}
+
+/**
+ * handler which releases the button
+ */
+static void release_button(void *data) {
+    (void) data;
+    button_pressed = false;
+}
+
+/**
+ * handler which presses the button
+ */
+static void press_button(void *data) {
+    button_pressed = true;
+    sim_schedule(sim_now() + (uint64_t) (uintptr_t) data, release_button, NULL);
+}
+
+/**
+ * presses the button at a specific time
+ * @param time time of the virtual clock in us
+ * @param duration time in us until the button is released
+ */
+void sim_press_button(uint64_t time, uint32_t duration) {
+    sim_schedule(time, press_button, (void *) (uintptr_t) duration);
+}
+
+/**
+ * enables the operator, who presses the button once after power on, when the LED blinks for a long time
+ * and every time the LED is on steadily. Before the last press the dispenser is filled again
+ * @param enabled true to enable the operator
+ */
+void sim_set_operator(bool enabled) {
+    operator_enabled = enabled;
+    if (enabled) {
+        sim_press_button(sim_now() + OPERATOR_DELAY, PRESS_DURATION);
+    }
+}
+
+/**
+ * handler of the operator, presses the button if the LED did not change since it was switched on
+ */
+static void operator_check(void *data) {
+    if ((uintptr_t) data != led_changes || !gpio_out[LED0_PIN]) {
+        return;
+    }
+    for (int i = 0; i < sim_wheel_count; i++) {
+        sim_wheels[i].pills = sim_wheels[i].config.fill;
+        sim_wheels[i].served = 0;
+    }
+    press_button((void *) (uintptr_t) PRESS_DURATION);
+}
+
+/**
+ * ends the simulation after some doses, when the firmware waits for the next one
+ * @param limit amount of doses of the first wheel, 0 for no limit
+ */
+void sim_stop_after_doses(uint32_t limit) {
+    dose_limit = limit;
+}
+
+/**
+ * returns the counters of a dispenser wheel
+ * @param wheel index of the wheel
+ * @return pointer to the counters
+ */
+const sim_wheel_stats *sim_get_wheel_stats(int wheel) {
+    return &sim_wheels[wheel].stats;
+}
+
+/**
+ * sets an output pin and informs the models which are connected to it
+ */
+static void set_output(unsigned int gpio, bool value) {
+    if (gpio == LED0_PIN && gpio_out[gpio] != value && operator_enabled) {
+        uint64_t now = sim_now();
+        led_changes++;
+        if (value) {
+            sim_schedule(now + OPERATOR_DELAY, operator_check, (void *) (uintptr_t) led_changes);
+        }
+        // the short blinking of a missing pill is not a request to start
+        if (blink_start == 0 || now - last_led_change > OPERATOR_DELAY) {
+            blink_start = now;
+        } else if (now - blink_start >= OPERATOR_BLINK_TIME) {
+            blink_start = 0;
+            press_button((void *) (uintptr_t) PRESS_DURATION);
+        }
+        last_led_change = now;
+    }
+    gpio_out[gpio] = value;
+}
+
+void gpio_init(unsigned int gpio) {
+    gpio_output[gpio] = false;
+    gpio_out[gpio] = false;
+}
+
+void gpio_set_dir(unsigned int gpio, bool out) {
+    gpio_output[gpio] = out;
+}
+
+void gpio_pull_up(unsigned int gpio) {
+    gpio_pulled_up[gpio] = true;
+}
+
+void gpio_set_function(unsigned int gpio, enum gpio_function function) {
+    (void) gpio;
+    (void) function;
+}
+
+void gpio_put(unsigned int gpio, bool value) {
+    set_output(gpio, value);
+    update_wheels();
+}
+
+void gpio_set_mask(uint32_t mask) {
+    for (unsigned int gpio = 0; gpio < GPIO_COUNT; gpio++) {
+        if (mask & (1u << gpio)) {
+            set_output(gpio, true);
+        }
+    }
+    update_wheels();
+}
+
+void gpio_clr_mask(uint32_t mask) {
+    for (unsigned int gpio = 0; gpio < GPIO_COUNT; gpio++) {
+        if (mask & (1u << gpio)) {
+            set_output(gpio, false);
+        }
+    }
+    update_wheels();
+}
+
+bool gpio_get(unsigned int gpio) {
+    sim_advance(SIM_POLL_COST);
+    if (gpio == SW0_PIN) {
+        return !button_pressed;
+    }
+    for (int i = 0; i < sim_wheel_count; i++) {
+        if (gpio == sim_wheels[i].pins.opto_sensor) {
+            return !opto_blocked(&sim_wheels[i]);
+        }
+    }
+    if (gpio_output[gpio]) {
+        return gpio_out[gpio];
+    }
+    return gpio_pulled_up[gpio];
+}
+
+void gpio_set_irq_enabled_with_callback(unsigned int gpio, uint32_t events, bool enabled,
+                                        gpio_irq_callback_t callback) {
+    gpio_callback = callback;
+    if (enabled) {
+        gpio_irq_events[gpio] |= events;
+    } else {
+        gpio_irq_events[gpio] &= ~events;
+    }
+}
+
+bool clock_configure(enum clock_index clk_index, uint32_t src, uint32_t auxsrc, uint32_t src_freq, uint32_t freq) {
+    (void) clk_index;
+    (void) src;
+    (void) auxsrc;
+    (void) src_freq;
+    (void) freq;
+    return true;
+}
+
+void clock_stop(enum clock_index clk_index) {
+    (void) clk_index;
+}
+
+void clocks_init() {
+    pll_sys->running = true;
+    pll_usb->running = true;
+}
+
+uint32_t clock_get_hz(enum clock_index clk_index) {
+    (void) clk_index;
+    return pll_sys->running ? SIM_SYS_CLOCK : XOSC_MHZ * MHZ;
+}
+
+void pll_deinit(PLL pll) {
+    pll->running = false;
+}
@@ -0,0 +1,577 @@
+#define _DEFAULT_SOURCE
+#include <stdarg.h>
+#include <stdio.h>
+#include <setjmp.h>
+#include <time.h>
+#include "pico/stdlib.h"
+#include "hardware/watchdog.h"
+#include "hardware/rtc.h"
+#include "hardware/pll.h"
+#include "hardware/structs/systick.h"
+#include "hardware/regs/m0plus.h"
+#include "sim.h"
+
+// speed of the console UART, the firmware waits while its output is sent
+#define CONSOLE_BAUD_RATE 115200
+// bits on the console UART for every character, 8N1
+#define CONSOLE_BITS 10
+// characters typed on the console which can wait until the firmware reads them
+#define CONSOLE_INPUT_LENGTH 256
+
+// event of the virtual clock, either a handler of a model or an alarm of the firmware
+typedef struct sim_event {
+    bool used;
+    uint64_t time;
+    uint64_t order; // events at the same time are handled in the order they were scheduled
+    uint32_t id;
+    sim_handler handler;
+    alarm_callback_t alarm;
+    void *data;
+} sim_event;
+
+sim_event sim_events[SIM_MAX_EVENTS];
+// event which is due next, NULL if it has to be searched again
+sim_event *sim_next = NULL;
+uint64_t sim_time = 0;
+uint64_t sim_order = 0;
+uint32_t sim_next_id = 1;
+// time at which the simulation ends
+uint64_t sim_limit = UINT64_MAX;
+
+// events are not handled while the firmware disables the interrupts or an event is handled
+bool interrupts_enabled = true;
+bool in_interrupt = false;
+
+systick_hw_t systick_registers = {0, 0, 0, 0};
+
+jmp_buf sim_stop_jump;
+const char *sim_stop_reason = NULL;
+bool sim_stop_requested = false;
+
+sim_clock_stats sim_clock_statistics = {0, 0, 0, 0, 0};
+
+bool sim_verbose = false;
+// true if the next console output starts a new line
+bool console_line_start = true;
+// characters typed on the console which were not read by the firmware yet
+char console_input[CONSOLE_INPUT_LENGTH];
+int console_input_head = 0;
+int console_input_tail = 0;
+// called in interrupt context when characters were typed, like the receive interrupt of the console UART
+void (*console_callback)(void *param) = NULL;
+void *console_callback_param = NULL;
+
+watchdog_hw_t watchdog_registers;
+bool watchdog_running = false;
+uint64_t watchdog_timeout = 0;
+uint64_t watchdog_fed = 0;
+// file which keeps the scratch registers between two runs, NULL if every run is a cold start
+const char *watchdog_file = NULL;
+// true if the scratch registers were loaded, the run then starts like after a reset by the watchdog
+bool watchdog_reboot = false;
+
+// time of the RTC in seconds since 1.1.1970 at the time rtc_base_time of the virtual clock
+int64_t rtc_base_seconds = 0;
+uint64_t rtc_base_time = 0;
+uint32_t rtc_alarm_event = 0;
+rtc_callback_t rtc_alarm_callback = NULL;
+
+/**
+ * stops the simulation and returns to sim_run
+ * @param reason text which is returned by sim_run
+ */
+static void stop(const char *reason) {
+    sim_stop_reason = reason;
+    longjmp(sim_stop_jump, 1);
+}
+
+/**
+ * counts an expiry of the watchdog if it was not updated in time, the real watchdog would reset the processor
+ */
+static void check_watchdog() {
+    if (watchdog_running && sim_time - watchdog_fed > watchdog_timeout) {
+        sim_clock_statistics.watchdog_expiries++;
+        watchdog_fed = sim_time;
+    }
+}
+
+/**
+ * checks if an event is due before another one
+ * @return true if the first event is handled first
+ */
+static bool earlier(const sim_event *first, const sim_event *second) {
+    return first->time < second->time || (first->time == second->time && first->order < second->order);
+}
+
+/**
+ * finds the event which is due next, the result is kept until the queue changes,
+ * because the polling loops of the firmware ask for it at every access to the hardware
+ * @return the event or NULL if no event is pending
+ */
+static sim_event *next_event() {
+    if (sim_next != NULL) {
+        return sim_next;
+    }
+    for (int i = 0; i < SIM_MAX_EVENTS; i++) {
+        sim_event *event = &sim_events[i];
+        if (event->used && (sim_next == NULL || earlier(event, sim_next))) {
+            sim_next = event;
+        }
+    }
+    return sim_next;
+}
+
+/**
+ * removes an event from the queue
+ */
+static void remove_event(sim_event *event) {
+    event->used = false;
+    if (event == sim_next) {
+        sim_next = NULL;
+    }
+}
+
+/**
+ * adds an event to the queue
+ * @return id of the event, 0 if the queue is full
+ */
+static uint32_t insert(uint64_t time, uint32_t id, sim_handler handler, alarm_callback_t alarm, void *data) {
+    for (int i = 0; i < SIM_MAX_EVENTS; i++) {
+        if (!sim_events[i].used) {
+            sim_events[i] = (sim_event) {true, time, sim_order++, id, handler, alarm, data};
+            if (sim_next != NULL && earlier(&sim_events[i], sim_next)) {
+                sim_next = &sim_events[i];
+            }
+            return id;
+        }
+    }
+    return 0;
+}
+
+/**
+ * handles one event like an interrupt. An alarm of the firmware is scheduled again if its callback asks for it
+ * @param event event which is due
+ */
+static void handle(sim_event *event) {
+    sim_event current = *event;
+    remove_event(event);
+    if (current.time > sim_time) {
+        sim_time = current.time;
+    }
+    check_watchdog();
+    sim_clock_statistics.events++;
+    in_interrupt = true;
+    if (current.handler != NULL) {
+        current.handler(current.data);
+    } else {
+        int64_t delay = current.alarm((alarm_id_t) current.id, current.data);
+        // a positive delay counts from the time the alarm was due, a negative one from now
+        if (delay > 0) {
+            insert(current.time + delay, current.id, NULL, current.alarm, current.data);
+        } else if (delay < 0) {
+            insert(sim_time - delay, current.id, NULL, current.alarm, current.data);
+        }
+    }
+    in_interrupt = false;
+}
+
+/**
+ * returns the time of the virtual clock
+ * @return time in us since the start of the simulation
+ */
+uint64_t sim_now() {
+    return sim_time;
+}
+
+/**
+ * lets the virtual clock run for some time, all events which are due meanwhile are handled in between.
+ * In interrupt context or with disabled interrupts only the time passes
+ * @param us time in us
+ */
+void sim_advance(uint64_t us) {
+    uint64_t target = sim_time + us;
+    sim_event *event;
+    while (interrupts_enabled && !in_interrupt && (event = next_event()) != NULL && event->time <= target &&
+           event->time <= sim_limit) {
+        handle(event);
+    }
+    sim_time = target > sim_time ? target : sim_time;
+    check_watchdog();
+    if (sim_time >= sim_limit && !in_interrupt) {
+        stop("time limit");
+    }
+}
+
+/**
+ * schedules a handler of a model
+ * @param time time of the virtual clock when the handler is called
+ * @param handler handler to call in interrupt context
+ * @param data passed to the handler
+ * @return id of the event, 0 if the queue is full
+ */
+uint32_t sim_schedule(uint64_t time, sim_handler handler, void *data) {
+    return insert(time, sim_next_id++, handler, NULL, data);
+}
+
+/**
+ * removes a pending event
+ * @param id id of the event
+ * @return true if the event was pending
+ */
+bool sim_cancel(uint32_t id) {
+    for (int i = 0; i < SIM_MAX_EVENTS; i++) {
+        if (sim_events[i].used && sim_events[i].id == id) {
+            remove_event(&sim_events[i]);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * sets the time at which the simulation ends
+ * @param time time of the virtual clock in us
+ */
+void sim_set_limit(uint64_t time) {
+    sim_limit = time;
+}
+
+/**
+ * ends the simulation as soon as the firmware goes to deep sleep, so that the current work is finished
+ * @param reason text which is returned by sim_run
+ */
+void sim_request_stop(const char *reason) {
+    if (!sim_stop_requested) {
+        sim_stop_requested = true;
+        sim_stop_reason = reason;
+    }
+}
+
+/**
+ * runs the firmware until the simulation is stopped
+ * @param firmware main function of the firmware
+ * @return the reason why the simulation ended
+ */
+const char *sim_run(void (*firmware)(void)) {
+    if (setjmp(sim_stop_jump) == 0) {
+        firmware();
+        return "firmware returned";
+    }
+    return sim_stop_reason;
+}
+
+/**
+ * returns the counters of the virtual clock
+ * @return pointer to the counters
+ */
+const sim_clock_stats *sim_get_clock_stats() {
+    return &sim_clock_statistics;
+}
+
+uint64_t time_us_64() {
+    sim_advance(SIM_POLL_COST);
+    return sim_time;
+}
+
+uint32_t time_us_32() {
+    return (uint32_t) time_us_64();
+}
+
+void sleep_us(uint64_t us) {
+    sim_advance(us);
+}
+
+void sleep_ms(uint32_t ms) {
+    sim_advance((uint64_t) ms * 1000);
+}
+
+void tight_loop_contents() {
+    sim_advance(SIM_POLL_COST);
+}
+
+alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback, void *user_data, bool fire_if_past) {
+    if (us == 0 && !fire_if_past) {
+        return 0;
+    }
+    alarm_id_t id = (alarm_id_t) sim_next_id++;
+    return insert(sim_time + us, id, NULL, callback, user_data) != 0 ? id : -1;
+}
+
+alarm_id_t add_alarm_in_ms(uint32_t ms, alarm_callback_t callback, void *user_data, bool fire_if_past) {
+    return add_alarm_in_us((uint64_t) ms * 1000, callback, user_data, fire_if_past);
+}
+
+bool cancel_alarm(alarm_id_t alarm_id) {
+    return sim_cancel((uint32_t) alarm_id);
+}
+
+/**
+ * alarm of a repeating timer, calls the callback of the timer and schedules the next call
+ */
+static int64_t repeating_timer_alarm(alarm_id_t id, void *user_data) {
+    (void) id;
+    repeating_timer_t *timer = user_data;
+    // a negative delay of the timer is the time between two starts, a positive one the time between end and start
+    return timer->callback(timer) ? -timer->delay_us : 0;
+}
+
+bool add_repeating_timer_ms(int32_t delay_ms, repeating_timer_callback_t callback, void *user_data,
+                            repeating_timer_t *out) {
+    out->delay_us = (int64_t) delay_ms * 1000;
+    out->callback = callback;
+    out->user_data = user_data;
+    out->alarm_id = add_alarm_in_us(delay_ms < 0 ? -out->delay_us : out->delay_us, repeating_timer_alarm, out, true);
+    return out->alarm_id > 0;
+}
+
+bool cancel_repeating_timer(repeating_timer_t *timer) {
+    return cancel_alarm(timer->alarm_id);
+}
+
+uint32_t save_and_disable_interrupts() {
+    uint32_t status = interrupts_enabled;
+    interrupts_enabled = false;
+    return status;
+}
+
+void restore_interrupts(uint32_t status) {
+    interrupts_enabled = status;
+    // interrupts which became pending meanwhile are handled now
+    sim_advance(0);
+}
+
+/**
+ * waits for the next interrupt: the virtual clock jumps to the next event. With disabled interrupts the event
+ * is handled when they are enabled again. A requested stop takes effect in deep sleep with stopped PLLs,
+ * because then the firmware has finished its work and waits for a long time
+ */
+void __wfi() {
+    sim_clock_statistics.idle_waits++;
+    if (sim_stop_requested && !pll_sys->running) {
+        stop(sim_stop_reason);
+    }
+    sim_event *event = next_event();
+    if (event == NULL) {
+        stop("no wakeup source");
+    }
+    sim_advance(event->time > sim_time ? event->time - sim_time : 0);
+}
+
+void watchdog_enable(uint32_t delay_ms, bool pause_on_debug) {
+    (void) pause_on_debug;
+    watchdog_running = true;
+    watchdog_timeout = (uint64_t) delay_ms * 1000;
+    watchdog_fed = sim_time;
+}
+
+void watchdog_update() {
+    sim_advance(SIM_POLL_COST);
+    watchdog_fed = sim_time;
+}
+
+// a run is a cold start unless the scratch registers of the previous run were loaded
+bool watchdog_enable_caused_reboot() {
+    return watchdog_reboot;
+}
+
+/**
+ * keeps the scratch registers of the watchdog in a file, so that the next run starts like after a reset by the
+ * watchdog at the end of this run. A missing or incomplete file gives a cold start
+ * @param path file with the scratch registers
+ */
+void sim_watchdog_file(const char *path) {
+    FILE *file = fopen(path, "rb");
+    watchdog_file = path;
+    if (file != NULL) {
+        watchdog_reboot = fread(&watchdog_registers, sizeof(watchdog_registers), 1, file) == 1;
+        fclose(file);
+    }
+}
+
+/**
+ * saves the scratch registers to the file of sim_watchdog_file, the end of the run is the reset by the watchdog
+ * @return false if the file could not be written
+ */
+bool sim_watchdog_save() {
+    if (watchdog_file == NULL) {
+        return true;
+    }
+    FILE *file = fopen(watchdog_file, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    bool written = fwrite(&watchdog_registers, sizeof(watchdog_registers), 1, file) == 1;
+    return fclose(file) == 0 && written;
+}
+
+/**
+ * returns the time of the RTC
+ * @return seconds since 1.1.1970
+ */
+static int64_t rtc_seconds() {
+    return rtc_base_seconds + (int64_t) ((sim_time - rtc_base_time) / 1000000);
+}
+
+void rtc_init() {
+    rtc_base_seconds = 0;
+    rtc_base_time = sim_time;
+}
+
+bool rtc_set_datetime(datetime_t *t) {
+    struct tm time = {.tm_sec = t->sec, .tm_min = t->min, .tm_hour = t->hour, .tm_mday = t->day,
+                      .tm_mon = t->month - 1, .tm_year = t->year - 1900};
+    rtc_base_seconds = timegm(&time);
+    rtc_base_time = sim_time;
+    return true;
+}
+
+bool rtc_get_datetime(datetime_t *t) {
+    time_t seconds = (time_t) rtc_seconds();
+    struct tm time;
+    gmtime_r(&seconds, &time);
+    *t = (datetime_t) {(int16_t) (time.tm_year + 1900), (int8_t) (time.tm_mon + 1), (int8_t) time.tm_mday,
+                       (int8_t) time.tm_wday, (int8_t) time.tm_hour, (int8_t) time.tm_min, (int8_t) time.tm_sec};
+    return true;
+}
+
+/**
+ * handler of the RTC alarm
+ */
+static void rtc_alarm(void *data) {
+    (void) data;
+    rtc_alarm_event = 0;
+    if (rtc_alarm_callback != NULL) {
+        rtc_alarm_callback();
+    }
+}
+
+// only alarms with a complete date are supported, the day of the week is ignored
+void rtc_set_alarm(datetime_t *t, rtc_callback_t user_callback) {
+    rtc_disable_alarm();
+    struct tm time = {.tm_sec = t->sec < 0 ? 0 : t->sec, .tm_min = t->min, .tm_hour = t->hour, .tm_mday = t->day,
+                      .tm_mon = t->month - 1, .tm_year = t->year - 1900};
+    int64_t seconds = timegm(&time);
+    rtc_alarm_callback = user_callback;
+    if (seconds > rtc_seconds()) {
+        // the RTC counts full seconds from the time it was set
+        uint64_t elapsed = (sim_time - rtc_base_time) % 1000000;
+        uint64_t due = sim_time - elapsed + (uint64_t) (seconds - rtc_seconds()) * 1000000;
+        rtc_alarm_event = sim_schedule(due, rtc_alarm, NULL);
+    }
+}
+
+void rtc_disable_alarm() {
+    if (rtc_alarm_event != 0) {
+        sim_cancel(rtc_alarm_event);
+        rtc_alarm_event = 0;
+    }
+}
+
+void host_set_verbose(bool enable) {
+    sim_verbose = enable;
+}
+
+/**
+ * console output of the firmware. The firmware waits until the output is sent on the console UART,
+ * in verbose mode every line is printed with the time of the virtual clock
+ */
+int host_printf(const char *format, ...) {
+    char text[512];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (length <= 0) {
+        return length;
+    }
+    if (length >= (int) sizeof(text)) {
+        length = sizeof(text) - 1;
+    }
+    sim_clock_statistics.console_bytes += length;
+    if (sim_verbose) {
+        for (int i = 0; i < length; i++) {
+            if (console_line_start) {
+                fprintf(stdout, "[%10.6f] ", sim_time / 1e6);
+            }
+            fputc(text[i], stdout);
+            console_line_start = text[i] == '\n';
+        }
+    }
+    uint64_t duration = (uint64_t) length * CONSOLE_BITS * 1000000 / CONSOLE_BAUD_RATE;
+    sim_clock_statistics.console_time += duration;
+    sim_advance(duration);
+    return length;
+}
+
+bool stdio_init_all() {
+    return true;
+}
+
+/**
+ * handler of the console input, the text arrives at the console UART at once
+ * @param data text which is typed
+ */
+static void console_typed(void *data) {
+    for (const char *c = data; *c != '\0'; c++) {
+        int next = (console_input_head + 1) % CONSOLE_INPUT_LENGTH;
+        if (next == console_input_tail) {
+            // characters which do not fit are lost like in the receive FIFO of the UART
+            break;
+        }
+        console_input[console_input_head] = *c;
+        console_input_head = next;
+    }
+    if (console_callback != NULL) {
+        console_callback(console_callback_param);
+    }
+}
+
+/**
+ * types a text on the console at a specific time
+ * @param time time of the virtual clock in us
+ * @param text text including the line ending, it has to stay valid until it is typed
+ */
+void sim_console_input(uint64_t time, const char *text) {
+    sim_schedule(time, console_typed, (void *) text);
+}
+
+void stdio_set_chars_available_callback(void (*fn)(void *), void *param) {
+    console_callback = fn;
+    console_callback_param = param;
+}
+
+uint uart_set_baudrate(uart_inst_t *uart, uint baudrate) {
+    (void) uart;
+    return baudrate;
+}
+
+/**
+ * reads a character which was typed on the console, the simulator never waits for the input
+ * @return the character or PICO_ERROR_TIMEOUT if no character was typed
+ */
+int getchar_timeout_us(uint32_t timeout_us) {
+    (void) timeout_us;
+    sim_advance(SIM_POLL_COST);
+    if (console_input_tail == console_input_head) {
+        return PICO_ERROR_TIMEOUT;
+    }
+    int c = (unsigned char) console_input[console_input_tail];
+    console_input_tail = (console_input_tail + 1) % CONSOLE_INPUT_LENGTH;
+    return c;
+}
+
+/**
+ * updates the SysTick counter from the virtual clock, it counts down with the system clock since the start
+ * @return registers of the SysTick counter
+ */
+systick_hw_t *sim_systick() {
+    if (systick_registers.csr & M0PLUS_SYST_CSR_ENABLE_BITS) {
+        uint64_t cycles = sim_time * (SIM_SYS_CLOCK / 1000000);
+        systick_registers.cvr = M0PLUS_SYST_RVR_RELOAD_BITS - (uint32_t) (cycles & M0PLUS_SYST_RVR_RELOAD_BITS);
+    }
+    return &systick_registers;
+}
+
+// the console output is already sent when host_printf returns
+void uart_default_tx_wait_blocking() {
+}
@@ -0,0 +1,492 @@
+#include <stdlib.h>
+#include <strings.h>
+#include <ctype.h>
+#include "pico/stdlib.h"
+#include "provided-libraries/uart.h"
+#include "board.h"
+#include "sim.h"
+
+#define UART_COUNT 2
+// sizes of the rings like in the firmware, the LORA module on UART1 has the bigger receive ring
+#define UART0_RX_SIZE 256
+#define UART1_RX_SIZE 1024
+#define UART_TX_SIZE 256
+// bits on the UART for every character, 8N1
+#define UART_BITS 10
+
+#define LINE_LENGTH 128
+// answer lines which can be in transmission at the same time
+#define MAX_PENDING_LINES 32
+// scripted answers and lines of every answer
+#define MAX_SCRIPTED 64
+#define MAX_SCRIPTED_LINES 8
+
+// one UART of the processor
+typedef struct sim_uart {
+    ring_buffer rx;
+    uart_stats stats;
+    int speed;
+    uint64_t tx_end; // time when the last written byte is sent
+    uint64_t dma_end; // time when the running DMA transmission is finished
+} sim_uart;
+
+// answer to the next occurrence of a command, read from the script
+typedef struct scripted_answer {
+    bool used;
+    char command[16];
+    int count;
+    uint32_t delays[MAX_SCRIPTED_LINES]; // time in ms after the previous line
+    char lines[MAX_SCRIPTED_LINES][LINE_LENGTH];
+} scripted_answer;
+
+// state of the scripted LoRa-E5 module
+typedef struct sim_modem {
+    sim_modem_config config;
+    sim_modem_stats stats;
+    int speed;
+    int next_speed; // speed which is active after the next reset
+    bool joined;
+    char line[LINE_LENGTH];
+    int line_length;
+    uint64_t reply_end; // time when the last answer line is sent, the lines do not overlap
+} sim_modem;
+
+// answer line in transmission
+typedef struct pending_line {
+    bool used;
+    int length;
+    char text[LINE_LENGTH + 2];
+} pending_line;
+
+uint8_t uart0_rx_memory[UART0_RX_SIZE];
+uint8_t uart1_rx_memory[UART1_RX_SIZE];
+sim_uart sim_uarts[UART_COUNT];
+
+sim_modem modem;
+scripted_answer scripted_answers[MAX_SCRIPTED];
+pending_line pending_lines[MAX_PENDING_LINES];
+
+/**
+ * calculates the time which some characters need on a UART
+ * @param bytes amount of characters
+ * @param speed speed in baud
+ * @return time in us
+ */
+static uint64_t transmission_time(int bytes, int speed) {
+    return (uint64_t) bytes * UART_BITS * 1000000 / (speed > 0 ? speed : 9600);
+}
+
+/**
+ * handler of an answer line whose last character was received. The line is only readable
+ * if the UART of the processor has the same speed as the module
+ */
+static void line_received(void *data) {
+    pending_line *line = data;
+    sim_uart *u = &sim_uarts[UART_NR];
+    line->used = false;
+    if (u->speed != modem.speed) {
+        modem.stats.unreadable++;
+        return;
+    }
+    int written = rb_write_bulk(&u->rx, (const uint8_t *) line->text, line->length);
+    u->stats.bytes_in += line->length;
+    u->stats.rx_dropped += line->length - written;
+    if ((uint32_t) rb_count(&u->rx) > u->stats.rx_high_water) {
+        u->stats.rx_high_water = rb_count(&u->rx);
+    }
+}
+
+/**
+ * sends one line of an answer
+ * @param time time of the virtual clock when the transmission of the line may start
+ * @param text line without line ending
+ */
+static void reply(uint64_t time, const char *text) {
+    for (int i = 0; i < MAX_PENDING_LINES; i++) {
+        pending_line *line = &pending_lines[i];
+        if (!line->used) {
+            line->used = true;
+            line->length = snprintf(line->text, sizeof(line->text), "%.*s\r\n", LINE_LENGTH - 1, text);
+            uint64_t start = time > modem.reply_end ? time : modem.reply_end;
+            modem.reply_end = start + transmission_time(line->length, modem.speed);
+            sim_schedule(modem.reply_end, line_received, line);
+            return;
+        }
+    }
+}
+
+/**
+ * handler of the end of a reset, the speed which was set before is active now
+ */
+static void modem_reset(void *data) {
+    (void) data;
+    modem.speed = modem.next_speed;
+}
+
+/**
+ * answers a command with the scripted answer if the script contains one for it
+ * @param command command in upper case without argument
+ * @param time time when the command was received
+ * @return true if the command was answered by the script
+ */
+static bool scripted_reply(const char *command, uint64_t time) {
+    for (int i = 0; i < MAX_SCRIPTED; i++) {
+        scripted_answer *answer = &scripted_answers[i];
+        if (answer->used && strcmp(answer->command, command) == 0) {
+            answer->used = false;
+            modem.stats.scripted++;
+            for (int line = 0; line < answer->count; line++) {
+                time += (uint64_t) answer->delays[line] * 1000;
+                reply(time, answer->lines[line]);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * answers a join request
+ * @param time time when the answer starts
+ * @param force true if a new session is started even if the module has already joined
+ */
+static void join(uint64_t time, bool force) {
+    modem.stats.joins++;
+    reply(time, "+JOIN: Start");
+    reply(time, force ? "+JOIN: FORCE" : "+JOIN: NORMAL");
+    if (modem.joined && !force) {
+        reply(time, "+JOIN: Joined already");
+    } else {
+        time += (uint64_t) modem.config.join_time * 1000;
+        modem.joined = true;
+        reply(time, "+JOIN: Network joined");
+        reply(time, "+JOIN: NetID 000013 DevAddr 26:0B:12:34");
+    }
+    reply(time, "+JOIN: Done");
+}
+
+/**
+ * answers an uplink with a hexadecimal payload
+ * @param payload payload in quotes
+ * @param time time when the answer starts
+ */
+static void send_hex(const char *payload, uint64_t time) {
+    char line[LINE_LENGTH];
+    if (!modem.joined) {
+        reply(time, "+MSGHEX: Please join network first");
+        return;
+    }
+    if (payload[0] != '"') {
+        reply(time, "+MSGHEX: ERROR(-1)");
+        return;
+    }
+    modem.stats.uplinks++;
+    reply(time, "+MSGHEX: Start");
+    time += (uint64_t) modem.config.send_time * 1000;
+    if (modem.config.downlink != NULL) {
+        snprintf(line, sizeof(line), "+MSGHEX: PORT: 8; RX: \"%s\"", modem.config.downlink);
+        reply(time, line);
+    }
+    reply(time, "+MSGHEX: RXWIN1, RSSI -106, SNR 4.0");
+    reply(time, "+MSGHEX: Done");
+}
+
+/**
+ * executes one command which was received completely
+ * @param command command without line ending
+ * @param time time when the last character of the command was received
+ */
+static void execute(const char *command, uint64_t time) {
+    char upper[LINE_LENGTH];
+    char line[LINE_LENGTH + 16];
+    int i;
+    for (i = 0; command[i] != '\0' && command[i] != '=' && i < LINE_LENGTH - 1; i++) {
+        upper[i] = (char) toupper((unsigned char) command[i]);
+    }
+    upper[i] = '\0';
+    const char *argument = command[i] == '=' ? &command[i + 1] : "";
+
+    modem.stats.commands++;
+    if (scripted_reply(upper, time)) {
+        return;
+    }
+    time += (uint64_t) modem.config.latency * 1000;
+    if (strcmp(upper, "AT") == 0) {
+        reply(time, "+AT: OK");
+    } else if (strcmp(upper, "AT+MODE") == 0) {
+        reply(time, "+MODE: LWOTAA");
+    } else if (strcmp(upper, "AT+KEY") == 0) {
+        reply(time, "+KEY: APPKEY B8C1C1466DED5D2FB668555B36D152F7");
+    } else if (strcmp(upper, "AT+CLASS") == 0) {
+        reply(time, "+CLASS: A");
+    } else if (strcmp(upper, "AT+PORT") == 0) {
+        snprintf(line, sizeof(line), "+PORT: %s", argument);
+        reply(time, line);
+    } else if (strcmp(upper, "AT+UART") == 0) {
+        // the new speed is active after the reset
+        sscanf(argument, "BR, %d", &modem.next_speed);
+        snprintf(line, sizeof(line), "+UART: %s", argument);
+        reply(time, line);
+    } else if (strcmp(upper, "AT+RESET") == 0) {
+        modem.joined = false;
+        reply(time, "+RESET: OK");
+        sim_schedule(modem.reply_end, modem_reset, NULL);
+    } else if (strcmp(upper, "AT+JOIN") == 0) {
+        join(time, strcasecmp(argument, "FORCE") == 0);
+    } else if (strcmp(upper, "AT+MSGHEX") == 0) {
+        send_hex(argument, time);
+    } else {
+        snprintf(line, sizeof(line), "+%s: ERROR(-1)", strncmp(upper, "AT+", 3) == 0 ? upper + 3 : upper);
+        reply(time, line);
+    }
+}
+
+/**
+ * passes the characters which the firmware sent to the module, complete lines are executed
+ * @param data characters
+ * @param size amount of characters
+ * @param time time when the last character is received by the module
+ */
+static void modem_receive(const uint8_t *data, int size, uint64_t time) {
+    for (int i = 0; i < size; i++) {
+        if (data[i] == '\n') {
+            modem.line[modem.line_length] = '\0';
+            if (modem.line_length > 0) {
+                if (sim_uarts[UART_NR].speed == modem.speed) {
+                    execute(modem.line, time);
+                } else {
+                    modem.stats.unreadable++;
+                }
+            }
+            modem.line_length = 0;
+        } else if (data[i] != '\r' && modem.line_length < LINE_LENGTH - 1) {
+            modem.line[modem.line_length++] = (char) data[i];
+        }
+    }
+}
+
+/**
+ * sets up the scripted LoRa-E5 module on the UART of the board
+ * @param config behaviour of the module
+ */
+void sim_modem_init(const sim_modem_config *config) {
+    memset(&modem, 0, sizeof(modem));
+    modem.config = *config;
+    modem.speed = config->speed;
+    modem.next_speed = config->speed;
+}
+
+/**
+ * loads answers from a script file. Every line answers the next occurrence of a command instead of the normal
+ * behaviour of the module, e.g. AT+JOIN 100 "+JOIN: Start" 6000 "+JOIN: Join failed" 0 "+JOIN: Done".
+ * Each line of the answer is preceded by its delay in ms after the previous line. A line which contains double
+ * quotes, e.g. a downlink, is written in single quotes. A command without lines is not answered at all,
+ * lines starting with # are comments
+ * @param path path of the script
+ * @return false if the file could not be read or contains too many answers
+ */
+bool sim_modem_load_script(const char *path) {
+    char text[512];
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return false;
+    }
+    int count = 0;
+    while (fgets(text, sizeof(text), file) != NULL) {
+        char *position = text;
+        int length;
+        while (isspace((unsigned char) *position)) {
+            position++;
+        }
+        if (*position == '\0' || *position == '#') {
+            continue;
+        }
+        if (count >= MAX_SCRIPTED) {
+            fclose(file);
+            return false;
+        }
+        scripted_answer *answer = &scripted_answers[count++];
+        memset(answer, 0, sizeof(*answer));
+        answer->used = true;
+        sscanf(position, "%15s%n", answer->command, &length);
+        for (char *c = answer->command; *c != '\0'; c++) {
+            *c = (char) toupper((unsigned char) *c);
+        }
+        position += length;
+        unsigned int delay;
+        while (answer->count < MAX_SCRIPTED_LINES &&
+               (sscanf(position, " %u \"%127[^\"]\"%n", &delay, answer->lines[answer->count], &length) == 2 ||
+                sscanf(position, " %u '%127[^']'%n", &delay, answer->lines[answer->count], &length) == 2)) {
+            answer->delays[answer->count++] = delay;
+            position += length;
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+/**
+ * returns the counters of the scripted module
+ * @return pointer to the counters
+ */
+const sim_modem_stats *sim_modem_get_stats() {
+    return &modem.stats;
+}
+
+/**
+ * calculates the amount of characters which are still waiting in the transmit ring of a UART
+ * @return amount of characters which are not sent yet
+ */
+static int unsent_count(int uart_nr) {
+    sim_uart *u = &sim_uarts[uart_nr];
+    uint64_t now = sim_now();
+    uint64_t byte_time = transmission_time(1, u->speed);
+    return u->tx_end > now ? (int) ((u->tx_end - now + byte_time - 1) / byte_time) : 0;
+}
+
+/**
+ * puts characters into the transmit ring of a UART as far as they fit
+ * @return amount of characters which were taken
+ */
+static int queue(int uart_nr, const uint8_t *buffer, int size) {
+    sim_uart *u = &sim_uarts[uart_nr];
+    uint64_t now = sim_now();
+    int unsent = unsent_count(uart_nr);
+    int count = size < UART_TX_SIZE - unsent ? size : UART_TX_SIZE - unsent;
+    if (count <= 0) {
+        return 0;
+    }
+    u->tx_end = (u->tx_end > now ? u->tx_end : now) + transmission_time(count, u->speed);
+    u->stats.bytes_out += count;
+    if ((uint32_t) (unsent + count) > u->stats.tx_high_water) {
+        u->stats.tx_high_water = unsent + count;
+    }
+    if (uart_nr == UART_NR) {
+        modem_receive(buffer, count, u->tx_end);
+    }
+    return count;
+}
+
+void uart_setup(int uart_nr, int tx_pin, int rx_pin, int speed) {
+    (void) tx_pin;
+    (void) rx_pin;
+    sim_uart *u = &sim_uarts[uart_nr];
+    memset(u, 0, sizeof(*u));
+    if (uart_nr == 0) {
+        rb_init(&u->rx, uart0_rx_memory, UART0_RX_SIZE);
+    } else {
+        rb_init(&u->rx, uart1_rx_memory, UART1_RX_SIZE);
+    }
+    u->speed = speed;
+}
+
+// the received lines are written directly into the ring, like by the receive DMA of the firmware
+void uart_enable_rx_dma(int uart_nr) {
+    (void) uart_nr;
+}
+
+int uart_read(int uart_nr, uint8_t *buffer, int size) {
+    sim_advance(SIM_POLL_COST);
+    return rb_read_bulk(&sim_uarts[uart_nr].rx, buffer, size);
+}
+
+int uart_available(int uart_nr) {
+    sim_advance(SIM_POLL_COST);
+    return rb_count(&sim_uarts[uart_nr].rx);
+}
+
+bool uart_read_line(int uart_nr, rb_line *line) {
+    sim_advance(SIM_POLL_COST);
+    return rb_get_line(&sim_uarts[uart_nr].rx, '\n', line);
+}
+
+void uart_release_line(int uart_nr, const rb_line *line) {
+    rb_release_line(&sim_uarts[uart_nr].rx, line);
+}
+
+int uart_write(int uart_nr, const uint8_t *buffer, int size) {
+    int written = queue(uart_nr, buffer, size);
+    sim_uarts[uart_nr].stats.tx_dropped += size - written;
+    return written;
+}
+
+int uart_send(int uart_nr, const char *str) {
+    return uart_write(uart_nr, (const uint8_t *) str, (int) strlen(str));
+}
+
+bool uart_write_timeout(int uart_nr, const uint8_t *buffer, int size, uint32_t timeout_us) {
+    uint64_t start = sim_now();
+    // data which fits into the ring is queued completely or not at all
+    while (size <= UART_TX_SIZE && UART_TX_SIZE - unsent_count(uart_nr) < size) {
+        if (sim_now() - start > timeout_us) {
+            sim_uarts[uart_nr].stats.tx_dropped += size;
+            return false;
+        }
+        sim_advance(transmission_time(1, sim_uarts[uart_nr].speed));
+    }
+    int written = queue(uart_nr, buffer, size);
+    // waits while the transmit ring is full
+    while (written < size && sim_now() - start <= timeout_us) {
+        sim_advance(transmission_time(1, sim_uarts[uart_nr].speed));
+        written += queue(uart_nr, buffer + written, size - written);
+    }
+    sim_uarts[uart_nr].stats.tx_dropped += size - written;
+    return written == size;
+}
+
+bool uart_send_timeout(int uart_nr, const char *str, uint32_t timeout_us) {
+    return uart_write_timeout(uart_nr, (const uint8_t *) str, (int) strlen(str), timeout_us);
+}
+
+/**
+ * handler of the end of a DMA transmission
+ */
+static void dma_finished(void *data) {
+    sim_uarts[UART_NR].stats.dma_irqs++;
+    ((uart_tx_callback) data)(UART_NR);
+}
+
+// the DMA transmission is sent after the characters which are still in the transmit ring
+bool uart_write_dma(int uart_nr, const uint8_t *buffer, int size, uart_tx_callback callback) {
+    sim_uart *u = &sim_uarts[uart_nr];
+    uint64_t now = sim_now();
+    if (u->dma_end > now) {
+        return false;
+    }
+    u->tx_end = (u->tx_end > now ? u->tx_end : now) + transmission_time(size, u->speed);
+    u->dma_end = u->tx_end;
+    u->stats.bytes_out += size;
+    if (uart_nr == UART_NR) {
+        modem_receive(buffer, size, u->tx_end);
+    }
+    if (callback != NULL) {
+        sim_schedule(u->dma_end, dma_finished, (void *) callback);
+    }
+    return true;
+}
+
+bool uart_tx_done(int uart_nr) {
+    return sim_now() >= sim_uarts[uart_nr].dma_end;
+}
+
+void uart_clock_changed(int uart_nr) {
+    (void) uart_nr;
+}
+
+void uart_set_speed(int uart_nr, int speed) {
+    sim_uarts[uart_nr].speed = speed;
+}
+
+const uart_stats *uart_get_stats(int uart_nr) {
+    return &sim_uarts[uart_nr].stats;
+}
+
+void uart_print_stats(int uart_nr) {
+    sim_uart *u = &sim_uarts[uart_nr];
+    printf("UART%d: in %u, out %u bytes, high water rx %u/%u, tx %u/%u, dropped rx %u, tx %u\n", uart_nr,
+           u->stats.bytes_in, u->stats.bytes_out, u->stats.rx_high_water, u->rx.size, u->stats.tx_high_water,
+           UART_TX_SIZE, u->stats.rx_dropped, u->stats.tx_dropped);
+    printf("UART%d: errors overrun %u, framing %u, parity %u, break %u, interrupts %u, dma %u\n", uart_nr,
+           u->stats.overrun_errors, u->stats.framing_errors, u->stats.parity_errors, u->stats.break_errors,
+           u->stats.irqs, u->stats.dma_irqs);
+}
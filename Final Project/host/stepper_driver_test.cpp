@@ -0,0 +1,94 @@
+#include <cstdio>
+#include "board.hpp"
+#include "stepper_driver.hpp"
+
+// state of the output pins, changed only by the driver through the fake GPIO backend
+uint32_t fake_outputs = 0;
+// masks of the last writes to the set and clear registers
+uint32_t last_set = 0;
+uint32_t last_clear = 0;
+int failures = 0;
+
+// GPIO backend which records the writes instead of accessing the SIO
+struct FakeGpio {
+    static void set_mask(uint32_t mask) {
+        last_set = mask;
+        fake_outputs |= mask;
+    }
+
+    static void clr_mask(uint32_t mask) {
+        last_clear = mask;
+        fake_outputs &= ~mask;
+    }
+};
+
+// board with two wheels whose motor controllers are not in order, so that the pin mapping is checked as well
+struct TestBoard {
+    static constexpr std::size_t wheel_count = 2;
+    static constexpr WheelPins wheels[wheel_count] = {
+            {28, {2, 3, 6, 13}},
+            {27, {21, 19, 18, 20}}
+    };
+};
+
+/**
+ * returns the expected pins of a step of the driver sequence
+ * @param pins motor controllers A to D of the wheel
+ * @param step step in the driver sequence
+ * @return mask of the pins which have to be set
+ */
+static uint32_t expected_mask(const uint8_t *pins, int step) {
+    uint32_t mask = 0;
+    for (int controller = 0; controller < 4; controller++) {
+        if (half_step_sequence[step] & (1u << controller)) {
+            mask |= 1u << pins[controller];
+        }
+    }
+    return mask;
+}
+
+/**
+ * runs the whole driver sequence twice on one wheel and checks the masks of every step,
+ * pins of other wheels and other functions must not change
+ * @tparam Wheel index of the wheel on the test board
+ */
+template<std::size_t Wheel>
+static void check_wheel() {
+    using Driver = StepperDriver<TestBoard, Wheel, FakeGpio>;
+    const uint8_t *pins = TestBoard::wheels[Wheel].motor_controllers;
+    const uint32_t other_pins = 0x80000001u;
+
+    fake_outputs = other_pins;
+    for (int i = 0; i < 16; i++) {
+        int step = i % 8;
+        uint32_t expected = expected_mask(pins, step);
+        Driver::write_phase(step);
+        if (last_set != expected || last_clear != (Driver::pin_mask & ~expected) ||
+            fake_outputs != (expected | other_pins)) {
+            printf("wheel %zu step %d: set %08x, clear %08x, outputs %08x, expected set %08x\n", Wheel, step,
+                   last_set, last_clear, fake_outputs, expected);
+            failures++;
+        }
+    }
+    // steps outside of the sequence wrap around
+    Driver::write_phase(9);
+    if (last_set != expected_mask(pins, 1)) {
+        printf("wheel %zu: step 9 did not wrap around to step 1\n", Wheel);
+        failures++;
+    }
+}
+
+/**
+ * test of the compile-time stepper driver against a fake GPIO backend
+ * @return 0 if all masks are correct, otherwise 1
+ */
+int main() {
+    static_assert(StepperDriver<TestBoard, 0, FakeGpio>::pin_mask == ((1u << 2) | (1u << 3) | (1u << 6) | (1u << 13)),
+                  "pin mask of wheel 0");
+    static_assert(StepperDriver<TestBoard, 1, FakeGpio>::set_masks[3] == ((1u << 19) | (1u << 18)),
+                  "controllers B and C of wheel 1 in step 3");
+    check_wheel<0>();
+    check_wheel<1>();
+    printf("stepper driver: %s\n", failures == 0 ? "ok" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,38 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "modem_emulator.h"
+#include "../provided-libraries/uart.h"
+#include "../uart_bench.h"
+
+// UART where the firmware expects the LORA module
+#define LORA_UART 1
+// speed of the emulated module, the pseudo terminal itself has no speed
+#define BENCH_LINK_SPEED 115200
+
+void uart_host_attach(int uart_nr, int fd);
+
+/**
+ * Host build of the UART benchmark. The round trips are measured against the emulated LoRa-E5 module,
+ * the loopback mode is replaced by a pseudo terminal which sends everything back.
+ * The results are printed as JSON lines, so that changes of the driver can be compared.
+ * usage: uart_bench [latency ms]   latency of the emulated module, default 5 ms
+ */
+int main(int argc, char *argv[]) {
+    modem_config config = {5, 6000, 2000, 0, 0, 0, 0, NULL, 1};
+    if (argc > 1) {
+        config.latency = atoi(argv[1]);
+    }
+
+    int fd = modem_start(&config);
+    if (fd < 0) {
+        fprintf(stderr, "pseudo terminal could not be created\n");
+        return 1;
+    }
+    uart_host_attach(LORA_UART, fd);
+    uart_setup(LORA_UART, 0, 0, BENCH_LINK_SPEED);
+    uart_bench_run(LORA_UART, BENCH_LINK_SPEED);
+    modem_stop();
+    return 0;
+}
@@ -0,0 +1,217 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <termios.h>
+#include "pico/stdlib.h"
+#include "provided-libraries/uart.h"
+
+#define UART_COUNT 2
+
+// file descriptors of the pseudo terminals which replace the UARTs
+int uart_fds[UART_COUNT] = {-1, -1};
+int uart_speeds[UART_COUNT] = {0, 0};
+// receive rings like in the firmware, so that the line reader works on the same data structure
+ring_buffer uart_rx[UART_COUNT];
+uart_stats uart_statistics[UART_COUNT];
+
+// pseudo terminal which sends everything back, replaces the loopback mode of the hardware
+int loopback_master = -1;
+int loopback_slave = -1;
+// file descriptor which is attached again when the loopback mode ends
+int loopback_saved_fd[UART_COUNT] = {-1, -1};
+
+/**
+ * connects a UART of the firmware with a file descriptor, e.g. the pseudo terminal of the modem emulator
+ * @param uart_nr number of the UART
+ * @param fd non-blocking file descriptor
+ */
+void uart_host_attach(int uart_nr, int fd) {
+    uart_fds[uart_nr] = fd;
+    if (uart_rx[uart_nr].buffer == NULL) {
+        rb_alloc(&uart_rx[uart_nr], 256);
+    }
+}
+
+/**
+ * moves the bytes which are waiting in the file descriptor into the receive ring
+ * @param uart_nr number of the UART
+ */
+static void uart_host_receive(int uart_nr) {
+    int space;
+    uint8_t *span;
+    ssize_t count;
+    // the free space can be split at the end of the ring
+    while ((span = rb_write_span(&uart_rx[uart_nr], &space), space > 0) &&
+           (count = read(uart_fds[uart_nr], span, space)) > 0) {
+        rb_commit(&uart_rx[uart_nr], (int) count);
+        uart_statistics[uart_nr].bytes_in += count;
+    }
+    if ((uint32_t) rb_count(&uart_rx[uart_nr]) > uart_statistics[uart_nr].rx_high_water) {
+        uart_statistics[uart_nr].rx_high_water = rb_count(&uart_rx[uart_nr]);
+    }
+}
+
+/**
+ * thread of the loopback, sends every byte which the firmware writes back to it
+ */
+static void *loopback_thread(void *argument) {
+    (void) argument;
+    struct pollfd fd = {loopback_master, POLLIN, 0};
+    uint8_t buffer[256];
+
+    while (true) {
+        if (poll(&fd, 1, -1) <= 0) {
+            continue;
+        }
+        ssize_t count = read(loopback_master, buffer, sizeof(buffer));
+        for (ssize_t written = 0; written < count;) {
+            ssize_t result = write(loopback_master, buffer + written, count - written);
+            if (result > 0) {
+                written += result;
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * creates the pseudo terminal of the loopback mode on first use
+ * @return true if the loopback is available
+ */
+static bool loopback_open() {
+    struct termios settings;
+    pthread_t thread;
+
+    if (loopback_slave >= 0) {
+        return true;
+    }
+    loopback_master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (loopback_master < 0 || grantpt(loopback_master) != 0 || unlockpt(loopback_master) != 0) {
+        return false;
+    }
+    loopback_slave = open(ptsname(loopback_master), O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (loopback_slave < 0) {
+        return false;
+    }
+    tcgetattr(loopback_slave, &settings);
+    cfmakeraw(&settings);
+    tcsetattr(loopback_slave, TCSANOW, &settings);
+    pthread_create(&thread, NULL, loopback_thread, NULL);
+    pthread_detach(thread);
+    return true;
+}
+
+/**
+ * connects the UART with the loopback pseudo terminal or with the file descriptor which was attached before
+ * @param uart_nr number of the UART
+ * @param enabled true for the loopback
+ */
+void uart_set_loopback(int uart_nr, bool enabled) {
+    if (enabled && loopback_saved_fd[uart_nr] < 0 && loopback_open()) {
+        loopback_saved_fd[uart_nr] = uart_fds[uart_nr];
+        uart_fds[uart_nr] = loopback_slave;
+    } else if (!enabled && loopback_saved_fd[uart_nr] >= 0) {
+        uart_fds[uart_nr] = loopback_saved_fd[uart_nr];
+        loopback_saved_fd[uart_nr] = -1;
+    }
+}
+
+const uart_stats *uart_get_stats(int uart_nr) {
+    return &uart_statistics[uart_nr];
+}
+
+void uart_setup(int uart_nr, int tx_pin, int rx_pin, int speed) {
+    (void) tx_pin;
+    (void) rx_pin;
+    uart_speeds[uart_nr] = speed;
+}
+
+int uart_read(int uart_nr, uint8_t *buffer, int size) {
+    uart_host_receive(uart_nr);
+    return rb_read_bulk(&uart_rx[uart_nr], buffer, size);
+}
+
+int uart_available(int uart_nr) {
+    uart_host_receive(uart_nr);
+    return rb_count(&uart_rx[uart_nr]);
+}
+
+bool uart_read_line(int uart_nr, rb_line *line) {
+    uart_host_receive(uart_nr);
+    return rb_get_line(&uart_rx[uart_nr], '\n', line);
+}
+
+void uart_release_line(int uart_nr, const rb_line *line) {
+    rb_release_line(&uart_rx[uart_nr], line);
+}
+
+// like the ring buffer of the firmware, only as much as the pseudo terminal takes is written
+int uart_write(int uart_nr, const uint8_t *buffer, int size) {
+    ssize_t count = write(uart_fds[uart_nr], buffer, size);
+    int written = count > 0 ? (int) count : 0;
+    uart_statistics[uart_nr].bytes_out += written;
+    uart_statistics[uart_nr].tx_dropped += size - written;
+    return written;
+}
+
+/**
+ * writes the whole buffer, waits while the pseudo terminal is full
+ * @param uart_nr number of the UART
+ * @param buffer data to write
+ * @param size amount of bytes
+ * @param timeout_us time in us until the rest is dropped
+ * @return amount of bytes which were written
+ */
+static int uart_host_write_all(int uart_nr, const uint8_t *buffer, int size, uint32_t timeout_us) {
+    uint32_t start = time_us_32();
+    int written = 0;
+    while (written < size && time_us_32() - start <= timeout_us) {
+        ssize_t count = write(uart_fds[uart_nr], buffer + written, size - written);
+        if (count > 0) {
+            written += count;
+        } else if (count < 0 && errno != EAGAIN) {
+            break;
+        }
+    }
+    uart_statistics[uart_nr].bytes_out += written;
+    uart_statistics[uart_nr].tx_dropped += size - written;
+    return written;
+}
+
+int uart_send(int uart_nr, const char *str) {
+    return uart_write(uart_nr, (const uint8_t *) str, (int) strlen(str));
+}
+
+bool uart_write_timeout(int uart_nr, const uint8_t *buffer, int size, uint32_t timeout_us) {
+    return uart_host_write_all(uart_nr, buffer, size, timeout_us) == size;
+}
+
+bool uart_send_timeout(int uart_nr, const char *str, uint32_t timeout_us) {
+    return uart_write_timeout(uart_nr, (const uint8_t *) str, (int) strlen(str), timeout_us);
+}
+
+// the transmission is finished when the pseudo terminal took the whole buffer
+bool uart_write_dma(int uart_nr, const uint8_t *buffer, int size, uart_tx_callback callback) {
+    uart_host_write_all(uart_nr, buffer, size, UINT32_MAX);
+    if (callback != NULL) {
+        callback(uart_nr);
+    }
+    return true;
+}
+
+bool uart_tx_done(int uart_nr) {
+    (void) uart_nr;
+    return true;
+}
+
+void uart_clock_changed(int uart_nr) {
+    (void) uart_nr;
+}
+
+void uart_set_speed(int uart_nr, int speed) {
+    uart_speeds[uart_nr] = speed;
+}
@@ -0,0 +1,33 @@
+# Regression test of the time after a reset by the watchdog: the first run of the simulator ends at 07:12 before
+# the dose at 08:00, the second run starts warm with the scratch registers of the first run and nobody sets the time.
+# The mirrored clock is still valid, so the doses continue without waiting for the time.
+# usage: cmake -DSIM=<dispenser_sim> -DEEPROM=<file> -DSCRATCH=<file> -P warm_reset_test.cmake
+
+file(REMOVE ${EEPROM} ${SCRATCH})
+
+execute_process(COMMAND ${SIM} --eeprom ${EEPROM} --warm-reset ${SCRATCH} --days 0.3
+        RESULT_VARIABLE result OUTPUT_VARIABLE output)
+if (NOT result EQUAL 0)
+    message(FATAL_ERROR "first run failed:\n${output}")
+endif ()
+# the wheel is not calibrated again after a warm reset, so the model starts at the position where it stopped
+if (NOT output MATCHES "position ([0-9]+)")
+    message(FATAL_ERROR "no position of the wheel in the first run:\n${output}")
+endif ()
+set(position ${CMAKE_MATCH_1})
+
+# the second run ends after the dose at 14:00
+execute_process(COMMAND ${SIM} --eeprom ${EEPROM} --warm-reset ${SCRATCH} --position ${position} --no-set-time
+        --days 0.3 -v
+        RESULT_VARIABLE result OUTPUT_VARIABLE output)
+if (NOT result EQUAL 0)
+    message(FATAL_ERROR "second run failed:\n${output}")
+endif ()
+if (NOT output MATCHES "Resumed after watchdog reset")
+    message(FATAL_ERROR "second run did not start warm:\n${output}")
+endif ()
+string(REGEX MATCHALL "\\) (No pill|Pill) dispensed" doses "${output}")
+list(LENGTH doses dose_count)
+if (NOT dose_count EQUAL 2)
+    message(FATAL_ERROR "expected the doses at 08:00 and 14:00, got ${dose_count} doses:\n${output}")
+endif ()
@@ -1,19 +1,99 @@
 #include <stdio.h>
 #include <string.h>
 #include "pico/stdlib.h"
+#include "board.h"
 #include "eeprom.h"
 #include "lora_mod.h"
+#include "logger.h"
+#include "telemetry.h"
+
+// text of every event for the log in the EEPROM and the console
+const char *log_texts[LOG_EVENTS] = {
+        "Boot",
+        "Power off during turning in previous session",
+        "Resumed after watchdog reset",
+        "Calibration started",
+        "Recalibration started",
+        "Pill dispensed",
+        "No pill dispensed",
+        "Dispenser empty",
+        "Missed dose dispensed",
+        "Dose missed",
+        "Remote command executed",
+        "Remote command rejected",
+        "Time set",
+        "Dosing paused, time unknown"
+};
 
 /**
  * Creates a log, which is saved in the EEPROM, sent via the LORA module and printed.
- * The current time since booting is appended to the log entry.
- * @param str String describing the content of the log message
+ * The current time since booting is appended to the log entry, the LORA module sends the event in binary form
+ * @param event event which is logged
+ * @param wheel index of the dispenser wheel plus one, 0 for events of the whole dispenser
  */
-void create_log(char* str) {
+static void log_event(enum Log_Events event, uint8_t wheel) {
     uint64_t actual_time = time_us_64() / 1000000;
     char entry[64];
-    sprintf(entry, "(%llu) %s", actual_time, str);
+    uint8_t payload[TELEMETRY_MAX_LENGTH];
+
+    if (wheel > 0 && DISPENSER_COUNT > 1) {
+        sprintf(entry, "(%llu) Wheel %d: %s", (unsigned long long) actual_time, wheel, log_texts[event]);
+    } else {
+        sprintf(entry, "(%llu) %s", (unsigned long long) actual_time, log_texts[event]);
+    }
     write_log_entry(entry, strlen(entry) + 1);
-    send_lora_message(entry);
+    int length = telemetry_encode(event, wheel, actual_time, payload);
+    // events which need attention are sent immediately, the others are collected and sent together
+    bool urgent = event == LOG_NO_PILL_DISPENSED || event == LOG_DOSE_MISSED || event == LOG_TIME_UNKNOWN;
+    send_lora_payload(payload, length, urgent);
     printf("%s\n", entry);
-}
\ No newline at end of file
+}
+
+/**
+ * Creates a log of an event of the whole dispenser
+ * @param event event which is logged
+ */
+void create_log(enum Log_Events event) {
+    log_event(event, 0);
+}
+
+/**
+ * Creates a log of an event of one dispenser wheel
+ * @param event event which is logged
+ * @param wheel index of the dispenser wheel on the board
+ */
+void create_wheel_log(enum Log_Events event, uint8_t wheel) {
+    log_event(event, wheel + 1);
+}
+
+/**
+ * Sends all entries of the log in the EEPROM via the LORA module. The texts are sent as event codes,
+ * entries with an unknown text are skipped. The dump stops if the backlog of the LORA module is full
+ */
+void send_log() {
+    char entry[64];
+    uint8_t payload[TELEMETRY_MAX_LENGTH];
+    unsigned long long time;
+    int wheel;
+    int offset;
+
+    for (int i = 0; read_log_entry(i, entry); i++) {
+        wheel = 0;
+        offset = 0;
+        if (sscanf(entry, "(%llu) Wheel %d: %n", &time, &wheel, &offset) < 2 || offset == 0) {
+            wheel = 0;
+            if (sscanf(entry, "(%llu) %n", &time, &offset) < 1 || offset == 0) {
+                continue;
+            }
+        }
+        for (int event = 0; event < LOG_EVENTS; event++) {
+            if (strcmp(entry + offset, log_texts[event]) == 0) {
+                int length = telemetry_encode_log_entry(event, wheel, time, payload);
+                if (!send_lora_payload(payload, length, false)) {
+                    return;
+                }
+                break;
+            }
+        }
+    }
+}
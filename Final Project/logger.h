@@ -1,6 +1,31 @@
 #ifndef UART_IRQ_LOGGER_H
 #define UART_IRQ_LOGGER_H
 
-void create_log(char* str);
+#include <stdint.h>
+
+// events which are logged, the value is the event code in the binary uplink
+enum Log_Events {
+    LOG_BOOT = 0,
+    LOG_POWER_OFF_DURING_TURNING = 1,
+    LOG_RESUMED = 2,
+    LOG_CALIBRATION_STARTED = 3,
+    LOG_RECALIBRATION_STARTED = 4,
+    LOG_PILL_DISPENSED = 5,
+    LOG_NO_PILL_DISPENSED = 6,
+    LOG_DISPENSER_EMPTY = 7,
+    LOG_MISSED_DOSE_DISPENSED = 8,
+    LOG_DOSE_MISSED = 9,
+    LOG_REMOTE_COMMAND = 10,
+    LOG_REMOTE_COMMAND_REJECTED = 11,
+    LOG_TIME_SET = 12,
+    LOG_TIME_UNKNOWN = 13,
+    LOG_EVENTS
+};
+
+void create_log(enum Log_Events event);
+
+void create_wheel_log(enum Log_Events event, uint8_t wheel);
+
+void send_log();
 
 #endif //UART_IRQ_LOGGER_H
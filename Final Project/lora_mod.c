@@ -1,190 +1,472 @@
-#include <stdio.h>
-#include <string.h>
-#include <ctype.h>
-#include "pico/stdlib.h"
-#include "provided-libraries/uart.h"
-
-#define STRLEN 80
-#define TIMEOUT 5000000
-#define TIMEOUT_MSG 10000000
-
-#define LORA_UART 1
-
-// stages for sending a message via the LORA module
-enum Stages {
-    ESTABLISH_CONNECTION, SET_MODE, SET_APP_KEY, SET_CLASS, SET_PORT, JOIN, SEND_MESSAGE, FINISHED, ERROR
-};
-enum Stages;
-
-/**
- * // function to execute a command on the LORA module and return the answer
- * @param command command to execute
- * @param output pointer where the return should be written to
- * @return returns true if successful, false when a timeout occurred
- */
-bool execute_command(const char *command, char *output) {
-    char str[STRLEN];
-    int count = 0;
-    int pos = 0;
-    strcpy(output, "");
-
-    while (count < 5) {
-        uart_send(LORA_UART, command);
-        uint32_t t = time_us_32();
-        // if no linefeed is in the output yet or the timeout is reached,
-        // add any output in the buffer to the output string
-        while (strchr(output, '\n') == NULL && (time_us_32() - t) <= TIMEOUT) {
-            pos = uart_read(LORA_UART, (uint8_t *) str, STRLEN);
-            if (pos > 0) {
-                str[pos] = '\0';
-                strcat(output, str);
-                t = time_us_32();
-            }
-        }
-        if (strchr(output, '\n') != NULL) {
-            // newline detected, the command was successful
-            return true;
-        } else {
-            // no newline means the timeout occured
-            count++;
-        }
-    }
-    return false;
-}
-
-bool send_message(const char *command, char *output) {
-    char str[STRLEN];
-    int count = 0;
-    int pos = 0;
-    strcpy(output, "");
-    char done[] = "MSG: Done";
-
-    while (count < 5) {
-        uart_send(LORA_UART, command);
-        uint32_t t = time_us_32();
-        // if no linefeed is in the output yet or the timeout is reached,
-        // add any output in the buffer to the output string
-        while (strstr(output, done) == NULL && (time_us_32() - t) <= TIMEOUT_MSG) {
-            pos = uart_read(LORA_UART, (uint8_t *) str, STRLEN);
-            if (pos > 0) {
-                str[pos] = '\0';
-                strcat(output, str);
-                t = time_us_32();
-            }
-        }
-        if (strstr(output, done) != NULL) {
-            // newline detected, the command was successful
-            return true;
-        } else {
-            // no newline means the timeout occured
-            count++;
-        }
-    }
-    return false;
-}
-
-/**
- * function to send a message via the LORA module
- * @param str message to send
- * @return true if message was sent successfully, otherwise false
- */
-bool send_lora_message(char* str) {
-    enum Stages stage = ESTABLISH_CONNECTION;
-
-    const char atCommand[] = "at\r\n";
-    const char setModeCommand[] = "at+MODE=LWOTAA\r\n";
-    const char setAppKeyCommand[] = "at+KEY=APPKEY, \"b8c1c1466ded5d2fb668555b36d152f7\"\r\n";
-    const char setClassCommand[] = "at+CLASS=A\r\n";
-    const char setPortCommand[] = "at+PORT=8\r\n";
-    const char joinCommand[] = "at+JOIN\r\n";
-    char messageCommand[150];
-    char output[300] = "";
-
-    while (true) {
-        switch (stage) {
-            case ESTABLISH_CONNECTION:
-                // Establish connection and execute test command at
-                if (execute_command(atCommand, output)) {
-                    printf("Connected to LoRa module\r\n");
-                    stage++;
-                } else {
-                    // if execute_command returned false, the timeout occurred
-                    printf("Module not responding\r\n");
-                    stage = ERROR;
-                }
-                break;
-            case SET_MODE:
-                // Set work mode
-                if (execute_command(setModeCommand, output)) {
-                    printf("%s", output); // print out output
-                    stage++;
-                } else {
-                    // if execute_command returned false, the timeout occurred
-                    printf("Module stopped responding: set mode\r\n");
-                    stage = ERROR;
-                }
-                break;
-            case SET_APP_KEY:
-                // Set LoRaWAN related AES-128 KEY
-                if (execute_command(setAppKeyCommand, output)) {
-                    printf("%s", output); // print out output
-                    stage++;
-                } else {
-                    // if execute_command returned false, the timeout occurred
-                    printf("Module stopped responding: set app key\r\n");
-                    stage = ERROR;
-                }
-                break;
-            case SET_CLASS:
-                // Set class mode
-                if (execute_command(setClassCommand, output)) {
-                    printf("%s", output); // print out output
-                    stage++;
-                } else {
-                    // if execute_command returned false, the timeout occurred
-                    printf("Module stopped responding: set class\r\n");
-                    stage = ERROR;
-                }
-                break;
-            case SET_PORT:
-                // Set port
-                if (execute_command(setPortCommand, output)) {
-                    printf("%s", output); // print out output
-                    stage++;
-                } else {
-                    // if execute_command returned false, the timeout occurred
-                    printf("Module stopped responding: set port\r\n");
-                    stage = ERROR;
-                }
-                break;
-            case JOIN:
-                // Try a join
-                if (execute_command(joinCommand, output)) {
-                    printf("%s", output); // print out output
-                    stage++;
-                } else {
-                    // if execute_command returned false, the timeout occurred
-                    printf("Module stopped responding: join\r\n");
-                    stage = ERROR;
-                }
-                break;
-            case SEND_MESSAGE:
-                // Send the message via the LORA module
-                sprintf(messageCommand, "at+MSG=\"%s\"\r\n", str);
-                if (send_message(messageCommand, output)) {
-                    printf("%s\n", output); // print out output
-                    stage++;
-                } else {
-                    // if execute_command returned false, the timeout occurred
-                    printf("Module stopped responding: send message\r\n");
-                    stage = ERROR;
-                }
-                break;
-            case FINISHED:
-                printf("Message sent successfully\n");
-                return true;
-            case ERROR:
-                return false;
-        }
-    }
-}
\ No newline at end of file
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "at_engine.h"
+#include "lora_mod.h"
+#include "backlog.h"
+#include "airtime.h"
+#include "modem_link.h"
+#include "profile.h"
+
+#define TIMEOUT 5000000
+#define TIMEOUT_MSG 10000000
+#define TIMEOUT_JOIN 20000000
+// default time in s after which the network is joined again, even if the session is still valid (24 h)
+#define REJOIN_INTERVAL 86400
+// waiting time in us before the first retry of a failed frame, doubled after every further failure
+#define BACKOFF_MIN 30000000ULL
+// maximum waiting time in us between two retries (1 h)
+#define BACKOFF_MAX 3600000000ULL
+
+#define LORA_UART 1
+
+// maximum length of one frame including the sequence number
+#define FRAME_LENGTH (BACKLOG_HEADER_LENGTH + BACKLOG_PAYLOAD_LENGTH)
+// default time in ms during which events are collected before they are sent together
+#define BATCH_WINDOW 10000
+// default data rate of the LORA module
+#define DATA_RATE 0
+// amount of data rates of the EU868 band
+#define DATA_RATES 8
+
+// stages for sending a message via the LORA module
+enum Stages {
+    NEGOTIATE_LINK, ESTABLISH_CONNECTION, SET_MODE, SET_APP_KEY, SET_CLASS, SET_PORT, JOIN, SEND_MESSAGE, FINISHED, ERROR, IDLE
+};
+enum Stages stage = IDLE;
+
+// true if the command of the current stage has been sent to the module
+bool command_sent = false;
+// true if the module answered that the join was successful
+bool join_accepted = false;
+// true if the module answered that the network has to be joined first
+bool join_required = false;
+// true if the session was joined again for the current message
+bool rejoined = false;
+
+// true if the LORA module has joined the network in this session
+bool session_joined = false;
+// time in us since boot of the last successful join
+uint64_t session_join_time = 0;
+// time in s after which the network is joined again, 0 keeps the session until it is lost
+uint32_t rejoin_interval = REJOIN_INTERVAL;
+// true if the rejoin interval is over, the module still has its session and has to be forced to join again
+bool join_forced = false;
+
+// frame of the backlog which is currently sent
+uint8_t current_frame[FRAME_LENGTH];
+int current_frame_length = 0;
+// true if the current frame is sent with the airtime which is reserved for alarms
+bool current_frame_urgent = false;
+
+// time in us since boot before which no frame is sent after a failure
+uint64_t retry_time = 0;
+// waiting time in us after the next failure
+uint64_t backoff = BACKOFF_MIN;
+
+// maximum payload in bytes of every data rate of the EU868 band
+const uint8_t max_payload_lengths[DATA_RATES] = {51, 51, 51, 115, 222, 222, 222, 222};
+uint8_t data_rate = DATA_RATE;
+uint32_t batch_window = BATCH_WINDOW;
+
+// events which are collected to be sent in one frame
+uint8_t batch[BACKLOG_PAYLOAD_LENGTH];
+int batch_length = 0;
+// time in us since boot when the first event of the batch was added
+uint64_t batch_start = 0;
+// true if the batch window is over, but the duty-cycle budget is too low, so that further events are collected
+bool batch_deferred = false;
+
+// downlink which was received in the receive windows after the current frame
+uint8_t downlink[DOWNLINK_LENGTH];
+int downlink_length = 0;
+lora_downlink_handler downlink_handler = NULL;
+
+const char atCommand[] = "at\r\n";
+const char setModeCommand[] = "at+MODE=LWOTAA\r\n";
+const char setAppKeyCommand[] = "at+KEY=APPKEY, \"b8c1c1466ded5d2fb668555b36d152f7\"\r\n";
+const char setClassCommand[] = "at+CLASS=A\r\n";
+const char setPortCommand[] = "at+PORT=8\r\n";
+const char joinCommand[] = "at+JOIN\r\n";
+// starts a new join even if the module still has a session
+const char forceJoinCommand[] = "at+JOIN=FORCE\r\n";
+char messageCommand[2 * FRAME_LENGTH + 16];
+
+/**
+ * converts one hexadecimal digit to its value
+ * @param c digit
+ * @return value of the digit, -1 if the character is not a hexadecimal digit
+ */
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+/**
+ * extracts the payload of a downlink from a line like +MSGHEX: PORT: 8; RX: "0102"
+ * @param data hexadecimal payload after the opening quote
+ */
+static void parse_downlink(const char *data) {
+    downlink_length = 0;
+    while (downlink_length < DOWNLINK_LENGTH && hex_value(data[0]) >= 0 && hex_value(data[1]) >= 0) {
+        downlink[downlink_length++] = (hex_value(data[0]) << 4) | hex_value(data[1]);
+        data += 2;
+    }
+}
+
+/**
+ * Line handler of the AT engine. Prints every line of the LORA module, evaluates the join state
+ * and extracts received downlinks
+ * @param line received line
+ */
+static void lora_line_handler(const char *line) {
+    const char *rx;
+    printf("%s\r\n", line);
+    if (strstr(line, "Network joined") != NULL || strstr(line, "Joined already") != NULL) {
+        join_accepted = true;
+    } else if (strstr(line, "Please join network first") != NULL) {
+        join_required = true;
+    } else if ((rx = strstr(line, "RX: \"")) != NULL) {
+        parse_downlink(rx + 5);
+    }
+}
+
+/**
+ * sets the function which processes the downlinks, they are received after a frame was sent
+ * @param handler function which is called with the payload of every downlink
+ */
+void lora_set_downlink_handler(lora_downlink_handler handler) {
+    downlink_handler = handler;
+}
+
+/**
+ * initializes the AT engine for the LORA module and loads the unsent frames from the EEPROM
+ */
+void lora_init() {
+    at_init(LORA_UART, lora_line_handler);
+    link_init(LORA_UART);
+    backlog_init();
+}
+
+/**
+ * sends the command of the current stage once and checks for the answer
+ * @param command command to execute
+ * @param done text which marks the last line of the answer, NULL if any line completes the answer
+ * @param timeout time in us without answer until the command is repeated
+ * @return the result of the command, AT_BUSY as long as the answer is not complete
+ */
+static enum At_Results stage_command(const char *command, const char *done, uint32_t timeout) {
+    if (!command_sent) {
+        command_sent = true;
+        at_send(command, done, timeout);
+        return AT_BUSY;
+    }
+    enum At_Results result = at_poll();
+    if (result != AT_BUSY) {
+        command_sent = false;
+    }
+    return result;
+}
+
+/**
+ * executes a configuration command of the current stage and moves to the next stage if it was successful
+ * @param command command to execute
+ * @param error text which is printed if the module is not responding
+ */
+static void configuration_stage(const char *command, const char *error) {
+    enum At_Results result = stage_command(command, NULL, TIMEOUT);
+    if (result == AT_OK) {
+        stage++;
+    } else if (result != AT_BUSY) {
+        printf("%s\r\n", error);
+        stage = ERROR;
+    }
+}
+
+/**
+ * checks if the session of the LORA module is still valid, so that no new join is necessary
+ * @return true if the network is joined and the rejoin interval is not over, otherwise false
+ */
+bool session_valid() {
+    return session_joined &&
+           (rejoin_interval == 0 || time_us_64() - session_join_time < (uint64_t) rejoin_interval * 1000000);
+}
+
+/**
+ * sets the data rate of the LORA module, which limits the size of one frame
+ * @param rate data rate of the EU868 band (0 - 7)
+ */
+void lora_set_data_rate(uint8_t rate) {
+    if (rate < DATA_RATES) {
+        data_rate = rate;
+    }
+}
+
+/**
+ * sets the time during which events are collected before they are sent together in one frame
+ * @param window time in ms, 0 sends every payload on its own
+ */
+void lora_set_batch_window(uint32_t window) {
+    batch_window = window;
+}
+
+/**
+ * sets the time after which the network is joined again with a new session
+ * @param interval time in s, 0 keeps the session until the network reports that it is lost
+ */
+void lora_set_rejoin_interval(uint32_t interval) {
+    rejoin_interval = interval;
+}
+
+/**
+ * moves the collected events as one frame into the backlog in the EEPROM
+ * @param urgent true if the frame may use the airtime which is reserved for alarms
+ * @return true if the batch was saved or is empty, otherwise false
+ */
+static bool flush_batch(bool urgent) {
+    if (batch_length == 0) {
+        return true;
+    }
+    bool saved = backlog_push(batch, batch_length, urgent);
+    batch_length = 0;
+    return saved;
+}
+
+/**
+ * function to send a binary payload via the LORA module. The payload is added to the current batch,
+ * which is sent by lora_poll when the batch window is over or the frame is full for the current data rate
+ * @param data payload to send
+ * @param length length of the payload in bytes
+ * @param urgent true if the batch has to be sent immediately together with this payload
+ * @return true if payload was queued, false if the payload is too long
+ */
+bool send_lora_payload(const uint8_t *data, int length, bool urgent) {
+    PROFILE_SCOPE(PROFILE_LORA_SEND);
+    // the frame has to fit into one page of the backlog and the sequence number is sent in front of the payload
+    int max_length = max_payload_lengths[data_rate] - BACKLOG_HEADER_LENGTH;
+    if (max_length > BACKLOG_PAYLOAD_LENGTH) {
+        max_length = BACKLOG_PAYLOAD_LENGTH;
+    }
+    if (length > max_length) {
+        printf("LoRa payload too long, message dropped\r\n");
+        return false;
+    }
+    if (batch_length + length > max_length && !flush_batch(false)) {
+        return false;
+    }
+    if (batch_length == 0) {
+        batch_start = time_us_64();
+    }
+    memcpy(batch + batch_length, data, length);
+    batch_length += length;
+    if (urgent || batch_window == 0) {
+        return flush_batch(urgent);
+    }
+    return true;
+}
+
+/**
+ * estimates the time on air of an uplink at the current data rate
+ * @param length length of the application payload in bytes
+ * @return time on air in us
+ */
+static uint32_t uplink_airtime(int length) {
+    return airtime_of_frame(length + LORAWAN_OVERHEAD, data_rate);
+}
+
+/**
+ * charges the airtime of every transmission of the last command, repeated commands are transmitted again
+ * @param airtime time on air of one transmission in us
+ */
+static void charge_transmissions(uint32_t airtime) {
+    for (int i = 0; i < at_attempts(); i++) {
+        airtime_charge(airtime, current_frame_urgent);
+    }
+}
+
+/**
+ * writes the at+MSGHEX command for the frame which is currently sent
+ */
+static void build_message_command() {
+    int position = sprintf(messageCommand, "at+MSGHEX=\"");
+    for (int i = 0; i < current_frame_length; i++) {
+        position += sprintf(messageCommand + position, "%02X", current_frame[i]);
+    }
+    sprintf(messageCommand + position, "\"\r\n");
+}
+
+/**
+ * Task which sends the queued messages via the LORA module. Never blocks and has to be called regularly.
+ * The module is only configured and joined if there is no valid session, otherwise only the message is sent.
+ * Collected events are moved into the backlog when the batch window is over. Frames of the backlog are sent in order,
+ * after a failure the next try is delayed with exponential backoff. Frames are only sent if the duty-cycle budget
+ * allows the estimated airtime
+ * @return true if there is still work to do, false if all messages have been sent or the next try is delayed
+ */
+bool lora_poll() {
+    PROFILE_SCOPE(PROFILE_LORA_POLL);
+    enum At_Results result;
+    uint32_t airtime;
+    uint64_t wait;
+
+    switch (stage) {
+        case IDLE:
+            // process unsolicited lines of the module
+            at_poll();
+            if (batch_length > 0 && time_us_64() - batch_start >= (uint64_t) batch_window * 1000) {
+                // without budget the batch is kept open, so that further events are sent in the same frame
+                if (airtime_wait(uplink_airtime(batch_length + BACKLOG_HEADER_LENGTH), false) == 0) {
+                    flush_batch(false);
+                    batch_deferred = false;
+                } else if (!batch_deferred) {
+                    airtime_defer();
+                    batch_deferred = true;
+                }
+            }
+            if (backlog_count() > 0 && at_cooldown_remaining() > 0) {
+                // module did not answer several commands, no frame is sent until the cool-down is over
+                retry_time = time_us_64() + at_cooldown_remaining();
+            }
+            if (backlog_count() == 0 || time_us_64() < retry_time) {
+                // keep polling until the batch window is over
+                return batch_length > 0;
+            }
+            current_frame_length = backlog_peek(current_frame);
+            if (current_frame_length == 0) {
+                printf("Damaged frame in LoRa backlog dropped\r\n");
+                backlog_pop();
+                break;
+            }
+            // frames in front of an urgent frame may also use the alarm reserve, so that the alarm is not delayed
+            current_frame_urgent = backlog_urgent();
+            airtime = uplink_airtime(current_frame_length);
+            if (!session_valid()) {
+                airtime += airtime_of_frame(JOIN_REQUEST_LENGTH, data_rate);
+            }
+            wait = airtime_wait(airtime, current_frame_urgent);
+            if (wait > 0) {
+                printf("LoRa frame delayed by duty cycle for %llu s\r\n", (unsigned long long) (wait / 1000000));
+                airtime_defer();
+                retry_time = time_us_64() + wait;
+                return batch_length > 0;
+            }
+            rejoined = false;
+            if (session_joined && !session_valid()) {
+                // the module would answer "Joined already" and keep the old session
+                join_forced = true;
+            }
+            stage = session_valid() ? SEND_MESSAGE : NEGOTIATE_LINK;
+            break;
+        case NEGOTIATE_LINK:
+            // UART speed is negotiated once before the first connection
+            // if the module does not answer the probes, the connection is tried anyway with the default speed
+            if (link_poll() != LINK_BUSY) {
+                stage++;
+            }
+            break;
+        case ESTABLISH_CONNECTION:
+            // Establish connection and execute test command at
+            result = stage_command(atCommand, NULL, TIMEOUT);
+            if (result == AT_OK) {
+                printf("Connected to LoRa module\r\n");
+                stage++;
+            } else if (result != AT_BUSY) {
+                printf("Module not responding\r\n");
+                stage = ERROR;
+            }
+            break;
+        case SET_MODE:
+            // Set work mode
+            configuration_stage(setModeCommand, "Module stopped responding: set mode");
+            break;
+        case SET_APP_KEY:
+            // Set LoRaWAN related AES-128 KEY
+            configuration_stage(setAppKeyCommand, "Module stopped responding: set app key");
+            break;
+        case SET_CLASS:
+            // Set class mode
+            configuration_stage(setClassCommand, "Module stopped responding: set class");
+            break;
+        case SET_PORT:
+            // Set port
+            configuration_stage(setPortCommand, "Module stopped responding: set port");
+            break;
+        case JOIN:
+            // Try a join and wait until the join procedure is finished
+            if (!command_sent) {
+                join_accepted = false;
+            }
+            result = stage_command(join_forced ? forceJoinCommand : joinCommand, "+JOIN: Done", TIMEOUT_JOIN);
+            if (result != AT_BUSY) {
+                charge_transmissions(airtime_of_frame(JOIN_REQUEST_LENGTH, data_rate));
+            }
+            if (result == AT_OK && join_accepted) {
+                session_joined = true;
+                session_join_time = time_us_64();
+                join_forced = false;
+                stage++;
+            } else if (result != AT_BUSY) {
+                printf("Join failed\r\n");
+                session_joined = false;
+                stage = ERROR;
+            }
+            break;
+        case SEND_MESSAGE:
+            // Send the message via the LORA module
+            if (!command_sent) {
+                join_required = false;
+                downlink_length = 0;
+                build_message_command();
+            }
+            result = stage_command(messageCommand, "MSGHEX: Done", TIMEOUT_MSG);
+            if (result != AT_BUSY) {
+                charge_transmissions(uplink_airtime(current_frame_length));
+            }
+            if (result != AT_BUSY && join_required) {
+                // only the module knows that the session is lost, join again and repeat the message once.
+                // The answer has no Done line, so that the command ends with a timeout
+                session_joined = false;
+                if (rejoined) {
+                    printf("Network not joined after rejoin\r\n");
+                    stage = ERROR;
+                } else {
+                    rejoined = true;
+                    stage = ESTABLISH_CONNECTION;
+                }
+            } else if (result == AT_OK) {
+                stage++;
+            } else if (result != AT_BUSY) {
+                // the session stays valid, so that the retry only repeats the message
+                printf("Module stopped responding: send message\r\n");
+                stage = ERROR;
+            }
+            break;
+        case FINISHED:
+            printf("Message sent successfully\n");
+            backlog_pop();
+            backoff = BACKOFF_MIN;
+            retry_time = 0;
+            stage = IDLE;
+            // Class A: a downlink can only be received in the receive windows after an uplink
+            if (downlink_length > 0 && downlink_handler != NULL) {
+                int length = downlink_length;
+                downlink_length = 0;
+                downlink_handler(downlink, length);
+            }
+            break;
+        case ERROR:
+            // the frame stays in the backlog and is sent again later
+            printf("LoRa frame not sent, retry in %llu s\r\n", (unsigned long long) (backoff / 1000000));
+            retry_time = time_us_64() + backoff;
+            backoff = backoff * 2 > BACKOFF_MAX ? BACKOFF_MAX : backoff * 2;
+            stage = IDLE;
+            break;
+    }
+    return true;
+}
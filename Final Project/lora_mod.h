@@ -1,6 +1,27 @@
-#ifndef UART_IRQ_LORA_MOD_H
-#define UART_IRQ_LORA_MOD_H
-
-bool send_lora_message(char* str);
-
-#endif //UART_IRQ_LORA_MOD_H
+#ifndef UART_IRQ_LORA_MOD_H
+#define UART_IRQ_LORA_MOD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// maximum length of one downlink payload in bytes
+#define DOWNLINK_LENGTH 51
+
+// function which is called with the payload of every downlink
+typedef void (*lora_downlink_handler)(const uint8_t *data, int length);
+
+void lora_init();
+
+void lora_set_downlink_handler(lora_downlink_handler handler);
+
+void lora_set_data_rate(uint8_t rate);
+
+void lora_set_batch_window(uint32_t window);
+
+void lora_set_rejoin_interval(uint32_t interval);
+
+bool send_lora_payload(const uint8_t *data, int length, bool urgent);
+
+bool lora_poll();
+
+#endif //UART_IRQ_LORA_MOD_H
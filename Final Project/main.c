@@ -1,176 +1,311 @@
-#include "pico/stdlib.h"
-#include "provided-libraries/uart.h"
-#include "hardware/i2c.h"
-#include "stepper.h"
-#include "logger.h"
-
-#define LED0_PIN 20
-
-#define SW0_PIN 9
-
-#define OPTO_SENSOR 28
-#define PIEZO_SENSOR 27
-
-#define UART_NR 1
-#define UART_TX_PIN 4
-#define UART_RX_PIN 5
-
-#define MOTOR_CONTR_A 2
-#define MOTOR_CONTR_B 3
-#define MOTOR_CONTR_C 6
-#define MOTOR_CONTR_D 13
-
-#define BAUD_RATE_EEPROM 100000
-#define BAUD_RATE_UART 9600
-
-// main stages of the program
-enum Stages {
-    START, INITIALIZATION, REINITIALIZATION, DISPENSING
-};
-enum Stages program_stage;
-
-bool led_state = false;
-bool piezo_triggered = false;
-
-void set_led(bool value);
-static void gpio_handler(uint gpio, uint32_t event_mask);
-
-
-
-int main() {
-
-    // Initialize Button pin
-    gpio_init(SW0_PIN);
-    gpio_set_dir(SW0_PIN, GPIO_IN);
-    gpio_pull_up(SW0_PIN);
-
-    // Initialize interrupt handler for piezo sensor
-    gpio_set_irq_enabled_with_callback(PIEZO_SENSOR, GPIO_IRQ_EDGE_FALL, true, gpio_handler);
-
-    // Initialize LED pin
-    gpio_init(LED0_PIN);
-    gpio_set_dir(LED0_PIN, GPIO_OUT);
-
-    // Initialize opto sensor pin
-    gpio_init(OPTO_SENSOR);
-    gpio_set_dir(OPTO_SENSOR, GPIO_IN);
-    gpio_pull_up(OPTO_SENSOR);
-
-    // Initialize piezo sensor pin
-    gpio_init(PIEZO_SENSOR);
-    gpio_set_dir(PIEZO_SENSOR, GPIO_IN);
-    gpio_pull_up(PIEZO_SENSOR);
-
-    // Initialize motor controller pins
-    gpio_init(MOTOR_CONTR_A);
-    gpio_set_dir(MOTOR_CONTR_A, GPIO_OUT);
-    gpio_init(MOTOR_CONTR_B);
-    gpio_set_dir(MOTOR_CONTR_B, GPIO_OUT);
-    gpio_init(MOTOR_CONTR_C);
-    gpio_set_dir(MOTOR_CONTR_C, GPIO_OUT);
-    gpio_init(MOTOR_CONTR_D);
-    gpio_set_dir(MOTOR_CONTR_D, GPIO_OUT);
-
-    // Initialize i2c pin for eeprom
-    i2c_init(i2c0, BAUD_RATE_EEPROM);
-    gpio_set_function(16, GPIO_FUNC_I2C);
-    gpio_set_function(17, GPIO_FUNC_I2C);
-
-    // Initialize UART for LORA module
-    uart_setup(UART_NR, UART_TX_PIN, UART_RX_PIN, BAUD_RATE_UART);
-
-    // Initialize chosen serial port
-    stdio_init_all();
-
-    program_stage = START;
-
-    create_log("Boot");
-
-    // initialize stepper data and check if reinitialization necessary
-    if (initialize_stepper_data()) {
-        program_stage = REINITIALIZATION;
-        create_log("Power off during turning in previous session");
-    }
-
-    while (true) {
-
-        switch(program_stage) {
-            case START:
-                // start: blinking led until button is pressed
-                set_led(!led_state);
-                sleep_ms(300);
-                if (!gpio_get(SW0_PIN)) {
-                    while (!gpio_get(SW0_PIN)) { sleep_ms(100); }
-                    set_led(0);
-                    program_stage = INITIALIZATION;
-                }
-                break;
-            case INITIALIZATION:
-            case REINITIALIZATION:
-                // (re-) initialization and calibration of the dispenser
-                if (initialize_stepper()) {
-                    if (program_stage == INITIALIZATION) {
-                        // wait until button is pressed, so that dispenser can be filled up
-                        set_led(1);
-                        while (gpio_get(SW0_PIN)) {
-                            sleep_ms(100);
-                        }
-                        set_led(0);
-                    }
-                    program_stage = DISPENSING;
-                } else {
-                    // if interrupt was during dispensing of the last bill, no more pills available
-                    reset_stepper();
-                    create_log("Dispenser empty");
-                    program_stage = START;
-                }
-                break;
-            case DISPENSING:
-                // Normal operation mode: start of dispensing pills
-                while (get_current_compartment() < 7) {
-                    piezo_triggered = false;
-                    rotate_by_one_compartment();
-                    uint32_t time_snap = time_us_32();
-                    if (!piezo_triggered) {
-                        for (int i = 0; i < 5; i++) {
-                            set_led(1);
-                            sleep_ms(500);
-                            set_led(0);
-                            sleep_ms(500);
-                        }
-                        create_log("No pill dispensed");
-                        uint32_t time_difference = (time_us_32() - time_snap) / 1000;
-                        // subtract the time difference which was needed for sending the log via LORA
-                        sleep_ms(30000 - time_difference); //-5s because of LED blinking
-                    } else {
-                        create_log("Pill dispensed");
-                        if(get_current_compartment() < 7) {
-                            uint32_t time_difference = (time_us_32() - time_snap) / 1000;
-                            // subtract the time difference which was needed for sending the log via LORA
-                            sleep_ms(30000 - time_difference);
-                        }
-                    }
-                }
-                reset_stepper();
-                create_log("Dispenser empty");
-                program_stage = START;
-        }
-    }
-}
-
-/**
- * changes take of the led and executes the change at the LED pin
- * @param value 0 to deactivate the led, 1 to activate it
- */
-void set_led(bool value) {
-    led_state = value;
-    gpio_put(LED0_PIN, led_state);
-}
-
-/**
- * Interrupt handler. Triggered when the piezo sensor is triggered
- */
-static void gpio_handler(uint gpio, uint32_t event_mask) {
-    piezo_triggered = true;
-}
-
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "provided-libraries/uart.h"
+#include "hardware/i2c.h"
+#include "board.h"
+#include "stepper.h"
+#include "logger.h"
+#include "schedule.h"
+#include "power.h"
+#include "recovery.h"
+#include "lora_mod.h"
+#include "remote_config.h"
+#include "profile.h"
+#include "console.h"
+
+#define BAUD_RATE_EEPROM 100000
+#define BAUD_RATE_UART 9600
+
+// main stages of the program
+enum Stages {
+    START, INITIALIZATION, REINITIALIZATION, DISPENSING
+};
+enum Stages program_stage;
+
+// one dispenser wheel with its stepper motor and piezo sensor
+typedef struct dispenser {
+    stepper_t stepper;
+    uint8_t piezo_sensor;
+    volatile bool piezo_triggered;
+    bool empty; // true if no more pills are left in the wheel
+} dispenser;
+
+// every wheel mirrors its state to one slot of the scratch registers, the last slot mirrors the clock
+#if DISPENSER_COUNT > RECOVERY_CLOCK_SLOT
+#error "not enough recovery slots for all dispenser wheels"
+#endif
+
+const stepperpins dispenser_pins[DISPENSER_COUNT] = DISPENSER_PINS;
+const uint8_t dispenser_piezo_sensors[DISPENSER_COUNT] = DISPENSER_PIEZO_SENSORS;
+dispenser dispensers[DISPENSER_COUNT];
+
+bool led_state = false;
+
+void set_led(bool value);
+bool dispensers_empty();
+void dispense_doses();
+static bool background_tasks();
+static void gpio_handler(uint gpio, uint32_t event_mask);
+
+
+
+int main() {
+
+    // start the cycle counter of the profiling before the first interrupt is enabled
+    profile_init();
+
+    // check if the state of the last session is still valid and enable the watchdog
+    bool warm_reset = recovery_init();
+
+    // Initialize Button pin
+    gpio_init(SW0_PIN);
+    gpio_set_dir(SW0_PIN, GPIO_IN);
+    gpio_pull_up(SW0_PIN);
+
+    // Initialize LED pin
+    gpio_init(LED0_PIN);
+    gpio_set_dir(LED0_PIN, GPIO_OUT);
+
+    // Initialize piezo sensor pins and their interrupt handler
+    for (int i = 0; i < DISPENSER_COUNT; i++) {
+        dispensers[i].piezo_sensor = dispenser_piezo_sensors[i];
+        gpio_init(dispensers[i].piezo_sensor);
+        gpio_set_dir(dispensers[i].piezo_sensor, GPIO_IN);
+        gpio_pull_up(dispensers[i].piezo_sensor);
+        gpio_set_irq_enabled_with_callback(dispensers[i].piezo_sensor, GPIO_IRQ_EDGE_FALL, true, gpio_handler);
+    }
+
+    // Initialize i2c pin for eeprom
+    i2c_init(i2c0, BAUD_RATE_EEPROM);
+    gpio_set_function(EEPROM_SDA_PIN, GPIO_FUNC_I2C);
+    gpio_set_function(EEPROM_SCL_PIN, GPIO_FUNC_I2C);
+
+    // Initialize UART for LORA module
+    uart_setup(UART_NR, UART_TX_PIN, UART_RX_PIN, BAUD_RATE_UART);
+    // answers are received by DMA, so that no byte is lost while the step scheduler is running
+    uart_enable_rx_dma(UART_NR);
+    lora_init();
+    // messages to the LORA module are sent and console commands are read in the background while sleeping
+    power_set_idle_task(background_tasks);
+
+    // Initialize chosen serial port, a command typed on the console wakes up the processor from deep sleep
+    stdio_init_all();
+    console_init();
+
+    // Initialize the stepper motors, every wheel has its own record slot in the EEPROM
+    for (int i = 0; i < DISPENSER_COUNT; i++) {
+        stepper_init(&dispensers[i].stepper, &dispenser_pins[i], i);
+    }
+
+    program_stage = START;
+
+    create_log(LOG_BOOT);
+
+    // initialize the RTC and the dosing schedule
+    schedule_init();
+    // load the settings which were changed by downlink
+    remote_config_init();
+
+    // after a watchdog reset the steppers continue with their mirrored state without recalibration,
+    // otherwise initialize stepper data and check if reinitialization necessary
+    int resumed = 0;
+    for (int i = 0; i < DISPENSER_COUNT; i++) {
+        if (warm_reset && resume_stepper(&dispensers[i].stepper)) {
+            dispensers[i].empty = !stepper_ready(&dispensers[i].stepper) ||
+                                  get_current_compartment(&dispensers[i].stepper) >= DOSES_PER_FILL;
+            resumed++;
+        } else if (initialize_stepper_data(&dispensers[i].stepper)) {
+            program_stage = REINITIALIZATION;
+            create_wheel_log(LOG_POWER_OFF_DURING_TURNING, i);
+        }
+    }
+    if (resumed == DISPENSER_COUNT) {
+        create_log(LOG_RESUMED);
+        program_stage = dispensers_empty() ? START : DISPENSING;
+    }
+
+    while (true) {
+        recovery_update();
+
+        switch(program_stage) {
+            case START:
+                // start: blinking led until button is pressed
+                set_led(!led_state);
+                power_sleep_ms(300);
+                if (!gpio_get(SW0_PIN)) {
+                    while (!gpio_get(SW0_PIN)) { power_sleep_ms(100); }
+                    set_led(0);
+                    program_stage = INITIALIZATION;
+                }
+                break;
+            case INITIALIZATION:
+            case REINITIALIZATION:
+                // (re-) initialization and calibration of the dispensers, all wheels move at the same time
+                for (int i = 0; i < DISPENSER_COUNT; i++) {
+                    start_initialize_stepper(&dispensers[i].stepper);
+                }
+                for (int i = 0; i < DISPENSER_COUNT; i++) {
+                    dispensers[i].empty = !finish_initialize_stepper(&dispensers[i].stepper);
+                    if (dispensers[i].empty) {
+                        // if interrupt was during dispensing of the last bill, no more pills available
+                        reset_stepper(&dispensers[i].stepper);
+                        create_wheel_log(LOG_DISPENSER_EMPTY, i);
+                    }
+                }
+                if (!dispensers_empty()) {
+                    if (program_stage == INITIALIZATION) {
+                        // wait until button is pressed, so that dispenser can be filled up
+                        set_led(1);
+                        while (gpio_get(SW0_PIN)) {
+                            power_sleep_ms(100);
+                        }
+                        set_led(0);
+                    }
+                    program_stage = DISPENSING;
+                } else {
+                    program_stage = START;
+                }
+                break;
+            case DISPENSING:
+                // Normal operation mode: dispense pills at the scheduled times.
+                // A dose which was interrupted by a reset has been finished by the (re-) initialization
+                schedule_resume_dose();
+                switch (schedule_catch_up()) {
+                    case TIME_NOT_SET:
+                        // the time is unknown after every reset, it is set on the console or by downlink
+                        schedule_wait_for_time();
+                        continue;
+                    case DOSE_DUE:
+                        // dose was missed shortly before, e.g. because of a power off
+                        create_log(LOG_MISSED_DOSE_DISPENSED);
+                        dispense_doses();
+                        break;
+                    case DOSE_SKIPPED:
+                        create_log(LOG_DOSE_MISSED);
+                        break;
+                    case NO_DOSE_MISSED:
+                        break;
+                }
+                // the wait ends early if the time is set, then the missed doses are checked again with the new time
+                while (!dispensers_empty() && schedule_wait_for_next_dose()) {
+                    dispense_doses();
+                }
+                if (dispensers_empty()) {
+                    program_stage = START;
+                }
+        }
+    }
+}
+
+/**
+ * changes take of the led and executes the change at the LED pin
+ * @param value 0 to deactivate the led, 1 to activate it
+ */
+void set_led(bool value) {
+    led_state = value;
+    gpio_put(LED0_PIN, led_state);
+}
+
+/**
+ * checks if all dispenser wheels are empty
+ * @return true if no more pills are left in any wheel, otherwise false
+ */
+bool dispensers_empty() {
+    for (int i = 0; i < DISPENSER_COUNT; i++) {
+        if (!dispensers[i].empty) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * rotates all dispenser wheels which are not empty at the same time to their next compartment
+ * (aligned again at point zero if a recalibration was requested) and checks with the piezo sensors if the pills were dispensed
+ */
+void dispense_doses() {
+    bool pill_missing = false;
+    // after a remote request the wheels are aligned again at point zero while turning to the next compartment
+    bool recalibrate = remote_recalibration_requested();
+
+    // the dose is saved as in progress, so that it is not dispensed again if the power is lost while turning
+    schedule_start_dose();
+    for (int i = 0; i < DISPENSER_COUNT; i++) {
+        if (!dispensers[i].empty) {
+            dispensers[i].piezo_triggered = false;
+            if (recalibrate) {
+                start_recalibration_by_one_compartment(&dispensers[i].stepper);
+            } else {
+                start_rotation_by_one_compartment(&dispensers[i].stepper);
+            }
+        }
+    }
+    for (int i = 0; i < DISPENSER_COUNT; i++) {
+        if (dispensers[i].empty) {
+            continue;
+        }
+        if (recalibrate) {
+            if (!finish_recalibration_by_one_compartment(&dispensers[i].stepper)) {
+                // opto sensor not found or no compartment left, the position of the wheel is not known anymore
+                dispensers[i].empty = true;
+                reset_stepper(&dispensers[i].stepper);
+                create_wheel_log(LOG_DISPENSER_EMPTY, i);
+            }
+        } else {
+            finish_rotation_by_one_compartment(&dispensers[i].stepper);
+        }
+    }
+    schedule_mark_served();
+
+    for (int i = 0; i < DISPENSER_COUNT; i++) {
+        if (!dispensers[i].empty && !dispensers[i].piezo_triggered) {
+            pill_missing = true;
+        }
+    }
+    if (pill_missing) {
+        for (int i = 0; i < 5; i++) {
+            set_led(1);
+            power_sleep_ms(500);
+            set_led(0);
+            power_sleep_ms(500);
+        }
+    }
+
+    for (int i = 0; i < DISPENSER_COUNT; i++) {
+        if (dispensers[i].empty) {
+            continue;
+        }
+        if (!dispensers[i].piezo_triggered) {
+            create_wheel_log(LOG_NO_PILL_DISPENSED, i);
+        } else {
+            create_wheel_log(LOG_PILL_DISPENSED, i);
+        }
+        if (get_current_compartment(&dispensers[i].stepper) >= DOSES_PER_FILL) {
+            dispensers[i].empty = true;
+            reset_stepper(&dispensers[i].stepper);
+            create_wheel_log(LOG_DISPENSER_EMPTY, i);
+        }
+    }
+}
+
+/**
+ * idle task of the power manager, runs the tasks which work in the background after every wakeup
+ * @return true as long as the LORA module has work to do
+ */
+static bool background_tasks() {
+    console_poll();
+    return lora_poll();
+}
+
+/**
+ * Interrupt handler. Triggered when a piezo sensor is triggered
+ */
+static void gpio_handler(uint gpio, uint32_t event_mask) {
+    (void) event_mask;
+    PROFILE_SCOPE(PROFILE_PIEZO_IRQ);
+    for (int i = 0; i < DISPENSER_COUNT; i++) {
+        if (dispensers[i].piezo_sensor == gpio) {
+            dispensers[i].piezo_triggered = true;
+        }
+    }
+}
@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "provided-libraries/uart.h"
+#include "modem_link.h"
+#include "eeprom.h"
+
+// speed of the LORA module after delivery
+#define DEFAULT_SPEED 9600
+// speed which is negotiated with the LORA module
+#define TARGET_SPEED 115200
+// time in us until a probe at one speed counts as failed
+#define PROBE_TIMEOUT 300000
+// time in us until the answer of a configuration command counts as failed
+#define COMMAND_TIMEOUT 1000000
+// time in us which the LORA module needs to start after a reset
+#define BOOT_TIME 500000
+// time in us which a command may wait for free space in the transmit buffer
+#define SEND_TIMEOUT 100000
+// amount of speeds which are tried if the LORA module does not answer
+#define FALLBACK_SPEEDS 5
+
+// stages of the negotiation
+enum Link_Stages {
+    LINK_PROBE, LINK_FALLBACK, LINK_SET_SPEED, LINK_RESET, LINK_BOOT, LINK_VERIFY, LINK_DONE, LINK_ERROR, LINK_FINISHED
+};
+
+// speeds which are tried one after the other if the LORA module does not answer
+const int fallback_speeds[FALLBACK_SPEEDS] = {TARGET_SPEED, 57600, 38400, 19200, DEFAULT_SPEED};
+
+// eeprom address where the negotiated speed is saved
+uint16_t eeprom_address_linkrecord = 0x08C0;
+
+enum Link_Stages link_stage = LINK_PROBE;
+int link_uart = 0;
+// speed which is currently used by the UART
+int link_speed = DEFAULT_SPEED;
+// index of the next speed in fallback_speeds
+int fallback_index = 0;
+// true if the module was already asked to change its speed, so that a failing change is not repeated
+bool speed_change_tried = false;
+
+// state of the command which is currently sent
+bool link_command_sent = false;
+uint32_t link_command_time = 0;
+
+link_stats link_statistics = {DEFAULT_SPEED, 0, 0, 0};
+
+char speed_command[32];
+
+/**
+ * loads the speed which was negotiated in a previous session
+ * @return speed in baud, DEFAULT_SPEED if no valid record is found
+ */
+static int load_link_record() {
+    uint8_t data[6];
+    read_bytes_from_eeprom(eeprom_address_linkrecord, data, sizeof(data));
+    if (crc16(data, sizeof(data)) != 0) {
+        return DEFAULT_SPEED;
+    }
+    return (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+}
+
+/**
+ * saves the negotiated speed, so that the next session starts with it
+ * @param speed speed in baud
+ */
+static void save_link_record(int speed) {
+    uint8_t data[6];
+    data[0] = speed >> 24;
+    data[1] = (speed >> 16) & 0xFF;
+    data[2] = (speed >> 8) & 0xFF;
+    data[3] = speed & 0xFF;
+    uint16_t crc = crc16(data, 4);
+    data[4] = (uint8_t) (crc >> 8);
+    data[5] = (uint8_t) crc;
+    write_bytes_to_eeprom(eeprom_address_linkrecord, data, sizeof(data));
+}
+
+/**
+ * changes the speed of the UART to the LORA module, characters which were received with the old speed are dropped
+ * @param speed speed in baud
+ */
+static void set_speed(int speed) {
+    uint8_t buffer[16];
+    link_speed = speed;
+    uart_set_speed(link_uart, speed);
+    while (uart_read(link_uart, buffer, sizeof(buffer)) > 0) {}
+}
+
+/**
+ * sends a command once and checks for the expected answer. The AT engine is not used, because failing probes
+ * at a wrong speed are expected and must not mark the module unhealthy
+ * @param command command to send
+ * @param expected text of the answer which marks success
+ * @param timeout time in us until the command counts as failed
+ * @return LINK_BUSY as long as no answer was received, LINK_READY if the answer was received, otherwise LINK_FAILED
+ */
+static enum Link_Results link_command(const char *command, const char *expected, uint32_t timeout) {
+    rb_line line;
+    bool answered = false;
+
+    if (!link_command_sent) {
+        if (!uart_send_timeout(link_uart, command, SEND_TIMEOUT)) {
+            // the transmit ring did not drain, no answer can be expected
+            return LINK_FAILED;
+        }
+        link_command_sent = true;
+        link_command_time = time_us_32();
+        return LINK_BUSY;
+    }
+    // the answer is searched in the received lines in place, a line which wraps around the ring does not match
+    while (uart_read_line(link_uart, &line)) {
+        answered |= line.rest == NULL && strstr(line.text, expected) != NULL;
+        uart_release_line(link_uart, &line);
+    }
+    if (answered) {
+        link_command_sent = false;
+        return LINK_READY;
+    }
+    if (time_us_32() - link_command_time > timeout) {
+        link_command_sent = false;
+        return LINK_FAILED;
+    }
+    return LINK_BUSY;
+}
+
+/**
+ * loads the speed of the previous session and sets up the UART with it
+ * @param uart_nr UART where the LORA module is connected
+ */
+void link_init(int uart_nr) {
+    link_uart = uart_nr;
+    link_stage = LINK_PROBE;
+    fallback_index = 0;
+    speed_change_tried = false;
+    set_speed(load_link_record());
+}
+
+/**
+ * Task which negotiates the UART speed with the LORA module. Never blocks and has to be called until it returns
+ * LINK_READY or LINK_FAILED. The module is probed at the saved speed, switched to TARGET_SPEED and probed again.
+ * If it does not answer, all speeds of the fallback sequence are tried. The speed which works is saved,
+ * if no speed works, DEFAULT_SPEED is used and the negotiation starts again with the next call
+ * @return LINK_BUSY as long as the negotiation is running
+ */
+enum Link_Results link_poll() {
+    enum Link_Results result;
+
+    switch (link_stage) {
+        case LINK_PROBE:
+            result = link_command("AT\r\n", "+AT: OK", PROBE_TIMEOUT);
+            if (result == LINK_READY) {
+                if (!speed_change_tried) {
+                    link_statistics.rtt_before = time_us_32() - link_command_time;
+                }
+                link_stage = link_speed == TARGET_SPEED || speed_change_tried ? LINK_DONE : LINK_SET_SPEED;
+            } else if (result == LINK_FAILED) {
+                link_stage = LINK_FALLBACK;
+            }
+            break;
+        case LINK_FALLBACK:
+            // try the next speed of the fallback sequence
+            if (fallback_index >= FALLBACK_SPEEDS) {
+                printf("LoRa module not answering at any speed\r\n");
+                set_speed(DEFAULT_SPEED);
+                link_stage = LINK_ERROR;
+                break;
+            }
+            link_statistics.fallbacks++;
+            set_speed(fallback_speeds[fallback_index++]);
+            link_stage = LINK_PROBE;
+            break;
+        case LINK_SET_SPEED:
+            sprintf(speed_command, "AT+UART=BR, %d\r\n", TARGET_SPEED);
+            result = link_command(speed_command, "+UART: BR", COMMAND_TIMEOUT);
+            if (result == LINK_READY) {
+                speed_change_tried = true;
+                link_stage = LINK_RESET;
+            } else if (result == LINK_FAILED) {
+                // module does not support the speed change, the current speed is kept
+                link_stage = LINK_DONE;
+            }
+            break;
+        case LINK_RESET:
+            // the new speed of the module is active after a reset
+            result = link_command("AT+RESET\r\n", "+RESET: OK", COMMAND_TIMEOUT);
+            if (result != LINK_BUSY) {
+                link_command_time = time_us_32();
+                link_stage = LINK_BOOT;
+            }
+            break;
+        case LINK_BOOT:
+            if (time_us_32() - link_command_time > BOOT_TIME) {
+                set_speed(TARGET_SPEED);
+                link_stage = LINK_VERIFY;
+            }
+            break;
+        case LINK_VERIFY:
+            result = link_command("AT\r\n", "+AT: OK", PROBE_TIMEOUT);
+            if (result == LINK_READY) {
+                link_statistics.rtt_after = time_us_32() - link_command_time;
+                link_stage = LINK_DONE;
+            } else if (result == LINK_FAILED) {
+                fallback_index = 0;
+                link_stage = LINK_FALLBACK;
+            }
+            break;
+        case LINK_DONE:
+            if (link_statistics.rtt_after == 0) {
+                link_statistics.rtt_after = link_statistics.rtt_before;
+            }
+            if (link_speed != load_link_record()) {
+                save_link_record(link_speed);
+            }
+            link_statistics.speed = link_speed;
+            printf("LoRa UART at %d baud\r\n", link_speed);
+            link_stage = LINK_FINISHED;
+            return LINK_READY;
+        case LINK_ERROR:
+            link_stage = LINK_PROBE;
+            fallback_index = 0;
+            return LINK_FAILED;
+        case LINK_FINISHED:
+            // the negotiation is finished, further calls return the result immediately
+            return LINK_READY;
+    }
+    return LINK_BUSY;
+}
+
+/**
+ * returns the metrics of the UART link to the LORA module
+ * @return pointer to the metrics
+ */
+const link_stats *link_get_stats() {
+    return &link_statistics;
+}
+
+/**
+ * prints the negotiated speed and the round-trip times on the console
+ */
+void link_print_stats() {
+    printf("LoRa UART: %d baud, round trip before: %u us, after: %u us, fallbacks: %u\n", link_statistics.speed,
+           link_statistics.rtt_before, link_statistics.rtt_after, link_statistics.fallbacks);
+}
@@ -0,0 +1,30 @@
+#ifndef UART_IRQ_MODEM_LINK_H
+#define UART_IRQ_MODEM_LINK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// results of the negotiation of the UART speed with the LORA module
+enum Link_Results {
+    LINK_BUSY, // negotiation is running
+    LINK_READY, // module answers at the negotiated speed
+    LINK_FAILED // module did not answer at any speed
+};
+
+// metrics of the UART link to the LORA module
+typedef struct link_stats {
+    int speed; // negotiated speed in baud
+    uint32_t rtt_before; // round-trip time in us of the test command at the speed found at startup
+    uint32_t rtt_after; // round-trip time in us of the test command at the negotiated speed
+    uint32_t fallbacks; // amount of speeds which were tried because the module did not answer
+} link_stats;
+
+void link_init(int uart_nr);
+
+enum Link_Results link_poll();
+
+const link_stats *link_get_stats();
+
+void link_print_stats();
+
+#endif //UART_IRQ_MODEM_LINK_H
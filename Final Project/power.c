@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/pll.h"
+#include "hardware/structs/scb.h"
+#include "hardware/regs/m0plus.h"
+#include "provided-libraries/uart.h"
+#include "board.h"
+#include "power.h"
+#include "recovery.h"
+#include "profile.h"
+
+// clocks which keep running while sleeping: RTC and timer for the wakeup alarms,
+// IO and pads for the button and piezo interrupts, UART1 so that no byte from the LORA module is lost,
+// UART0 so that a command typed on the console wakes up the processor
+// and DMA, bus fabric and SRAM so that the receive DMA of UART1 keeps writing
+#define SLEEP_EN0_KEEP (CLOCKS_SLEEP_EN0_CLK_RTC_RTC_BITS | CLOCKS_SLEEP_EN0_CLK_SYS_RTC_BITS | \
+                        CLOCKS_SLEEP_EN0_CLK_SYS_IO_BITS | CLOCKS_SLEEP_EN0_CLK_SYS_PADS_BITS | \
+                        CLOCKS_SLEEP_EN0_CLK_SYS_DMA_BITS | CLOCKS_SLEEP_EN0_CLK_SYS_BUSFABRIC_BITS | \
+                        CLOCKS_SLEEP_EN0_CLK_SYS_SRAM0_BITS | CLOCKS_SLEEP_EN0_CLK_SYS_SRAM1_BITS | \
+                        CLOCKS_SLEEP_EN0_CLK_SYS_SRAM2_BITS | CLOCKS_SLEEP_EN0_CLK_SYS_SRAM3_BITS)
+#define SLEEP_EN1_KEEP (CLOCKS_SLEEP_EN1_CLK_SYS_TIMER_BITS | CLOCKS_SLEEP_EN1_CLK_SYS_WATCHDOG_BITS | \
+                        CLOCKS_SLEEP_EN1_CLK_SYS_UART0_BITS | CLOCKS_SLEEP_EN1_CLK_PERI_UART0_BITS | \
+                        CLOCKS_SLEEP_EN1_CLK_SYS_UART1_BITS | CLOCKS_SLEEP_EN1_CLK_PERI_UART1_BITS | \
+                        CLOCKS_SLEEP_EN1_CLK_SYS_SRAM4_BITS | CLOCKS_SLEEP_EN1_CLK_SYS_SRAM5_BITS)
+
+power_stats power_statistics = {{0, 0, 0}, 0, 0, 0};
+
+// time when the last change of the power state happened
+uint64_t power_state_entered = 0;
+
+volatile bool sleep_timeout = false;
+// set by an interrupt handler when the idle task has new work, e.g. a character was typed on the console
+volatile bool wakeup_requested = false;
+
+// task which is run after every wakeup, returns true as long as it has work to do
+power_idle_task idle_task = NULL;
+
+/**
+ * adds the time since the last change of the power state to the statistics of a state
+ * @param state power state which is left
+ * @return the current time in us
+ */
+static uint64_t account_state(enum Power_States state) {
+    uint64_t now = time_us_64();
+    power_statistics.time_in_state[state] += now - power_state_entered;
+    power_state_entered = now;
+    return now;
+}
+
+/**
+ * adds the time from the wakeup until the clocks were restored to the statistics
+ * @param wakeup_time time of the wakeup in us
+ */
+static void account_wakeup(uint64_t wakeup_time) {
+    uint32_t latency = time_us_64() - wakeup_time;
+    power_statistics.wakeups++;
+    power_statistics.total_wake_latency += latency;
+    if (latency > power_statistics.max_wake_latency) {
+        power_statistics.max_wake_latency = latency;
+    }
+}
+
+/**
+ * gates all clocks which are not needed and waits for the next interrupt in deep sleep of the processor.
+ * The flag is checked with disabled interrupts, because a wakeup which happens between the check and __wfi
+ * would be lost otherwise. A pending interrupt still ends __wfi and is handled after the interrupts are enabled
+ * @param wakeup flag which is set by the interrupt handler which ends the sleep
+ */
+static void sleep_until_interrupt(volatile bool *wakeup) {
+    uint32_t interrupts = save_and_disable_interrupts();
+    if (!*wakeup && !wakeup_requested) {
+        clocks_hw->sleep_en0 = SLEEP_EN0_KEEP;
+        clocks_hw->sleep_en1 = SLEEP_EN1_KEEP;
+        scb_hw->scr |= M0PLUS_SCR_SLEEPDEEP_BITS;
+        __wfi();
+        scb_hw->scr &= ~M0PLUS_SCR_SLEEPDEEP_BITS;
+        clocks_hw->sleep_en0 = CLOCKS_SLEEP_EN0_BITS;
+        clocks_hw->sleep_en1 = CLOCKS_SLEEP_EN1_BITS;
+    }
+    restore_interrupts(interrupts);
+}
+
+/**
+ * switches the system and peripheral clock to the crystal oscillator and stops the PLLs.
+ * The RTC and the timer keep running because they are clocked from the crystal oscillator as well
+ */
+static void run_from_xosc() {
+    uint32_t xosc_hz = XOSC_MHZ * MHZ;
+    clock_configure(clk_ref, CLOCKS_CLK_REF_CTRL_SRC_VALUE_XOSC_CLKSRC, 0, xosc_hz, xosc_hz);
+    clock_configure(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLK_REF, 0, xosc_hz, xosc_hz);
+    clock_stop(clk_usb);
+    clock_stop(clk_adc);
+    clock_configure(clk_rtc, 0, CLOCKS_CLK_RTC_CTRL_AUXSRC_VALUE_XOSC_CLKSRC, xosc_hz, 46875);
+    clock_configure(clk_peri, 0, CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLK_SYS, xosc_hz, xosc_hz);
+    pll_deinit(pll_sys);
+    pll_deinit(pll_usb);
+    // the dividers of the LORA UART and the console UART have to match the new peripheral clock
+    uart_clock_changed(UART_NR);
+    uart_set_baudrate(uart_default, PICO_DEFAULT_UART_BAUD_RATE);
+    profile_clock_changed();
+}
+
+/**
+ * restarts the PLLs and restores all clocks to their default frequencies
+ */
+static void restore_clocks() {
+    clocks_init();
+    uart_clock_changed(UART_NR);
+    uart_set_baudrate(uart_default, PICO_DEFAULT_UART_BAUD_RATE);
+    profile_clock_changed();
+}
+
+/**
+ * Alarm handler. Triggered when the time of a light sleep is over
+ */
+static int64_t sleep_alarm_handler(alarm_id_t id, void *user_data) {
+    (void) id;
+    (void) user_data;
+    sleep_timeout = true;
+    return 0;
+}
+
+/**
+ * Alarm handler. Only wakes up the processor, e.g. so that the watchdog can be updated during a long deep sleep
+ */
+static int64_t wakeup_alarm_handler(alarm_id_t id, void *user_data) {
+    (void) id;
+    (void) user_data;
+    return 0;
+}
+
+/**
+ * runs the idle task
+ * @return true if the idle task still has work to do, otherwise false
+ */
+static bool run_idle_task() {
+    return idle_task != NULL && idle_task();
+}
+
+/**
+ * sleeps with running PLLs until the next interrupt
+ * @param busy true if the idle task has work to do, then the processor is woken up after the poll interval at the latest
+ * @param wakeup flag which ends the sleep
+ */
+static void light_sleep(bool busy, volatile bool *wakeup) {
+    alarm_id_t poll_alarm = 0;
+    account_state(POWER_ACTIVE);
+    if (busy) {
+        poll_alarm = add_alarm_in_ms(POWER_POLL_INTERVAL, wakeup_alarm_handler, NULL, false);
+    }
+    sleep_until_interrupt(wakeup);
+    if (poll_alarm > 0) {
+        cancel_alarm(poll_alarm);
+    }
+    account_state(POWER_SLEEP);
+}
+
+/**
+ * ends a deep sleep early so that the idle task runs with full clocks, the flag of the deep sleep is not changed.
+ * Called from interrupt handlers, e.g. when a character was typed on the console
+ */
+void power_request_wakeup() {
+    wakeup_requested = true;
+}
+
+/**
+ * sets the task which is run after every wakeup, e.g. to process the answers of the LORA module while sleeping
+ * @param task function which returns true as long as it has work to do
+ */
+void power_set_idle_task(power_idle_task task) {
+    idle_task = task;
+}
+
+/**
+ * waits in sleep for the specified time. The PLLs keep running so that the wakeup is fast,
+ * this is used for short waits like blinking the LED or polling the button
+ * @param ms time to sleep in ms
+ */
+void power_sleep_ms(uint32_t ms) {
+    recovery_update();
+    sleep_timeout = false;
+    if (add_alarm_in_ms(ms, sleep_alarm_handler, NULL, false) <= 0) {
+        // time is already over or no alarm is available
+        return;
+    }
+    while (!sleep_timeout) {
+        light_sleep(run_idle_task(), &sleep_timeout);
+    }
+}
+
+/**
+ * waits in deep sleep until the wakeup flag is set by an interrupt handler, e.g. the RTC alarm.
+ * Other interrupts shortly wake up the processor, which then goes back to sleep. An interrupt which requests
+ * a wakeup, e.g. of the console, restores the clocks and runs the idle task before going back to deep sleep.
+ * As long as the idle task has work to do, only light sleep is used
+ * @param wakeup flag which ends the deep sleep
+ */
+void power_deep_sleep_until(volatile bool *wakeup) {
+    while (!*wakeup) {
+        recovery_update();
+        wakeup_requested = false;
+        // work of the idle task is finished with full clocks before going to deep sleep
+        if (run_idle_task()) {
+            light_sleep(true, wakeup);
+            continue;
+        }
+        // UART output has to be finished before the clock of the peripherals changes
+        uart_default_tx_wait_blocking();
+        account_state(POWER_ACTIVE);
+        run_from_xosc();
+        while (!*wakeup && !wakeup_requested) {
+            alarm_id_t watchdog_alarm = add_alarm_in_ms(WATCHDOG_FEED_INTERVAL, wakeup_alarm_handler, NULL, false);
+            sleep_until_interrupt(wakeup);
+            cancel_alarm(watchdog_alarm);
+            recovery_update();
+        }
+        uint64_t wakeup_time = account_state(POWER_DEEP_SLEEP);
+        restore_clocks();
+        account_wakeup(wakeup_time);
+    }
+}
+
+/**
+ * returns the statistics of the idle manager, the time in the active state is updated before
+ * @return pointer to the statistics
+ */
+const power_stats *power_get_stats() {
+    account_state(POWER_ACTIVE);
+    return &power_statistics;
+}
+
+/**
+ * prints the time spent in every power state and the wake latency on the console
+ */
+void power_print_stats() {
+    const char *names[POWER_STATES] = {"active", "sleep", "deep sleep"};
+    power_get_stats();
+    for (int i = 0; i < POWER_STATES; i++) {
+        printf("%s: %llu ms\n", names[i], (unsigned long long) (power_statistics.time_in_state[i] / 1000));
+    }
+    printf("wakeups: %u, wake latency avg: %llu us, max: %u us\n", power_statistics.wakeups,
+           (unsigned long long) (power_statistics.wakeups ? power_statistics.total_wake_latency / power_statistics.wakeups : 0),
+           power_statistics.max_wake_latency);
+}
@@ -0,0 +1,41 @@
+#ifndef UART_IRQ_POWER_H
+#define UART_IRQ_POWER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// time in ms after which the processor wakes up from sleep while the idle task has work to do
+#define POWER_POLL_INTERVAL 10
+
+// power states of the idle manager
+enum Power_States {
+    POWER_ACTIVE, // system clock from the PLL, all clocks running
+    POWER_SLEEP, // processor sleeping, unused clocks gated, PLLs keep running for a fast wakeup
+    POWER_DEEP_SLEEP, // processor sleeping, system clock from the crystal oscillator and PLLs stopped
+    POWER_STATES
+};
+
+// statistics of the idle manager
+typedef struct power_stats {
+    uint64_t time_in_state[POWER_STATES]; // time in us spent in every power state
+    uint32_t wakeups; // amount of wakeups from deep sleep
+    uint32_t max_wake_latency; // longest time in us from wakeup until the clocks were restored
+    uint64_t total_wake_latency; // sum of all wake latencies in us
+} power_stats;
+
+// task which is run after every wakeup, returns true as long as it has work to do
+typedef bool (*power_idle_task)();
+
+void power_set_idle_task(power_idle_task task);
+
+void power_sleep_ms(uint32_t ms);
+
+void power_deep_sleep_until(volatile bool *wakeup);
+
+void power_request_wakeup();
+
+const power_stats *power_get_stats();
+
+void power_print_stats();
+
+#endif //UART_IRQ_POWER_H
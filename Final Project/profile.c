@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+#include "hardware/regs/m0plus.h"
+#include "profile.h"
+
+#ifdef PROFILING
+
+// the SysTick counter counts down from its reload value with the system clock
+#define SYSTICK_RELOAD M0PLUS_SYST_RVR_RELOAD_BITS
+// longest duration in us which is measured with the SysTick counter, longer scopes are measured with the timer,
+// because the 24 bit counter wraps around after 134 ms at 125 MHz
+#define SYSTICK_SPAN 100000
+
+const char *profile_names[PROFILE_SCOPES] = {
+        "log write", "lora send", "lora poll", "stepper run", "calibration", "step irq", "piezo irq", "uart irq",
+        "dma irq"
+};
+
+profile_stats profile_table[PROFILE_SCOPES];
+// cycles of the system clock per us, to convert the durations of long scopes and to print the table
+uint32_t profile_cycles_per_us = 125;
+// true while the system clock runs with the frequency of the table, e.g. not from the crystal oscillator in deep sleep
+bool profile_clock_full = true;
+// incremented at every change of the system clock, so that scopes which overlap a change are not measured
+uint8_t profile_clock_generation = 0;
+
+/**
+ * starts the SysTick counter as free running counter of the cycles of the system clock and clears the table
+ */
+void profile_init() {
+    systick_hw->csr = 0;
+    systick_hw->rvr = SYSTICK_RELOAD;
+    systick_hw->cvr = 0;
+    systick_hw->csr = M0PLUS_SYST_CSR_CLKSOURCE_BITS | M0PLUS_SYST_CSR_ENABLE_BITS;
+    profile_cycles_per_us = clock_get_hz(clk_sys) / MHZ;
+    profile_clock_full = true;
+    profile_reset();
+}
+
+/**
+ * has to be called after every change of the system clock. The table only contains durations which were measured
+ * with the frequency of profile_init, because the cycles of a slower clock and the conversion of long scopes
+ * would not match
+ */
+void profile_clock_changed() {
+    profile_clock_generation++;
+    profile_clock_full = clock_get_hz(clk_sys) / MHZ == profile_cycles_per_us;
+}
+
+/**
+ * starts the measurement of a scope
+ * @param scope scope which is measured
+ * @return timer which has to be passed to profile_stop at the end of the scope
+ */
+profile_timer profile_start(enum Profile_Scopes scope) {
+    profile_timer timer;
+    timer.scope = scope;
+    timer.clock_generation = profile_clock_generation;
+    timer.start_us = time_us_32();
+    timer.start_ticks = systick_hw->cvr;
+    return timer;
+}
+
+/**
+ * ends the measurement of a scope and adds its duration to the table. Short scopes are measured in cycles
+ * with the SysTick counter, long ones with the timer. Every scope is only measured in one context,
+ * so that an interrupt never changes the entry which is currently updated
+ * @param timer timer which was returned by profile_start
+ */
+void profile_stop(const profile_timer *timer) {
+    uint32_t ticks = systick_hw->cvr;
+    uint32_t elapsed = time_us_32() - timer->start_us;
+    uint32_t cycles;
+    profile_stats *stats = &profile_table[timer->scope];
+
+    if (!profile_clock_full || timer->clock_generation != profile_clock_generation) {
+        return;
+    }
+    if (elapsed < SYSTICK_SPAN) {
+        cycles = (timer->start_ticks - ticks) & SYSTICK_RELOAD;
+    } else {
+        uint64_t long_cycles = (uint64_t) elapsed * profile_cycles_per_us;
+        cycles = long_cycles > UINT32_MAX ? UINT32_MAX : (uint32_t) long_cycles;
+    }
+    stats->count++;
+    stats->sum += cycles;
+    if (cycles < stats->min) {
+        stats->min = cycles;
+    }
+    if (cycles > stats->max) {
+        stats->max = cycles;
+    }
+}
+
+/**
+ * returns the durations of one scope
+ * @param scope scope of the table
+ * @return pointer to the durations
+ */
+const profile_stats *profile_get_stats(enum Profile_Scopes scope) {
+    return &profile_table[scope];
+}
+
+/**
+ * clears all durations of the table
+ */
+void profile_reset() {
+    uint32_t interrupts = save_and_disable_interrupts();
+    for (int i = 0; i < PROFILE_SCOPES; i++) {
+        profile_table[i] = (profile_stats) {0, UINT32_MAX, 0, 0};
+    }
+    restore_interrupts(interrupts);
+}
+
+/**
+ * prints the amount of calls and the minimum, average and maximum duration of every scope on the console.
+ * The table is copied with disabled interrupts, so that the values of the interrupt handlers belong together
+ */
+void profile_print_stats() {
+    profile_stats table[PROFILE_SCOPES];
+    uint32_t interrupts = save_and_disable_interrupts();
+    memcpy(table, profile_table, sizeof(table));
+    restore_interrupts(interrupts);
+
+    printf("scope: calls, min / avg / max cycles, total us\n");
+    for (int i = 0; i < PROFILE_SCOPES; i++) {
+        if (table[i].count == 0) {
+            continue;
+        }
+        printf("%s: %u, %u / %llu / %u, %llu\n", profile_names[i], table[i].count, table[i].min,
+               (unsigned long long) (table[i].sum / table[i].count), table[i].max,
+               (unsigned long long) (table[i].sum / profile_cycles_per_us));
+    }
+}
+
+#endif
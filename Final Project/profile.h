@@ -0,0 +1,61 @@
+#ifndef UART_IRQ_PROFILE_H
+#define UART_IRQ_PROFILE_H
+
+#include <stdint.h>
+
+// code sections which are measured, every scope has one entry in the profile table
+enum Profile_Scopes {
+    PROFILE_LOG_WRITE, // write_log_entry
+    PROFILE_LORA_SEND, // send_lora_payload
+    PROFILE_LORA_POLL, // lora_poll
+    PROFILE_STEPPER_RUN, // wait_for_run, the motion of run and of a dose
+    PROFILE_CALIBRATION, // calibration
+    PROFILE_STEP_IRQ, // step scheduler tick
+    PROFILE_PIEZO_IRQ, // GPIO interrupt of the piezo sensors
+    PROFILE_UART_IRQ, // UART interrupts
+    PROFILE_DMA_IRQ, // DMA interrupt of the UART channels
+    PROFILE_SCOPES
+};
+
+// durations of one scope in cycles of the system clock
+typedef struct profile_stats {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+} profile_stats;
+
+// running measurement of one scope
+typedef struct profile_timer {
+    uint8_t scope;
+    uint8_t clock_generation;
+    uint32_t start_us;
+    uint32_t start_ticks;
+} profile_timer;
+
+// Without PROFILING the calls of the firmware are empty macros, so that it contains no code of the measurement
+#ifdef PROFILING
+void profile_init();
+
+void profile_clock_changed();
+
+profile_timer profile_start(enum Profile_Scopes scope);
+
+void profile_stop(const profile_timer *timer);
+
+const profile_stats *profile_get_stats(enum Profile_Scopes scope);
+
+void profile_reset();
+
+void profile_print_stats();
+
+// measures the rest of the enclosing block, the timer is stopped at every exit of the block
+#define PROFILE_SCOPE(scope) \
+    profile_timer profile_timer_ __attribute__((cleanup(profile_stop))) = profile_start(scope)
+#else
+#define profile_init()
+#define profile_clock_changed()
+#define PROFILE_SCOPE(scope)
+#endif
+
+#endif //UART_IRQ_PROFILE_H
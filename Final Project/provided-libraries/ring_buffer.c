@@ -2,48 +2,192 @@
 // Created by keijo on 4.11.2023.
 //
 #include <stdlib.h>
+#include <string.h>
 #include "ring_buffer.h"
 
+// the producer publishes data with a release store of head, the consumer frees space with a release store of tail.
+// The acquire loads make sure that the data is read only after the index which publishes it
+#define LOAD_ACQUIRE(index) __atomic_load_n(&(index), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(index, value) __atomic_store_n(&(index), (value), __ATOMIC_RELEASE)
+
 
 void rb_init(ring_buffer *rb, uint8_t *buffer, int size)
 {
     rb->tail = 0;
     rb->head = 0;
     rb->size = size;
+    rb->mask = size - 1;
+    rb->line_scan = 0;
     rb->buffer = buffer;
 }
 
 bool rb_empty(ring_buffer *rb)
 {
-    return rb->head == rb->tail;
+    return LOAD_ACQUIRE(rb->head) == LOAD_ACQUIRE(rb->tail);
 }
 
 bool rb_full(ring_buffer *rb)
 {
-    return (rb->head + 1) % rb->size == rb->tail;
+    return LOAD_ACQUIRE(rb->head) - LOAD_ACQUIRE(rb->tail) == rb->size;
+}
+
+// amount of bytes which can be read
+int rb_count(ring_buffer *rb)
+{
+    return (int)(LOAD_ACQUIRE(rb->head) - LOAD_ACQUIRE(rb->tail));
+}
+
+// amount of bytes which can be written
+int rb_space(ring_buffer *rb)
+{
+    return (int)(rb->size - (LOAD_ACQUIRE(rb->head) - LOAD_ACQUIRE(rb->tail)));
 }
 
 bool rb_put(ring_buffer *rb, uint8_t data)
 {
-    // calculate new head (position where to store the value)
-    int nh = (rb->head + 1) % rb->size;
-    // return false if buffer would be full
-    if(nh == rb->tail) return false;
+    uint32_t head = rb->head;
+    // return false if buffer is full
+    if(head - LOAD_ACQUIRE(rb->tail) == rb->size) return false;
 
-    rb->buffer[rb->head] = data;
-    rb->head = nh;
+    rb->buffer[head & rb->mask] = data;
+    STORE_RELEASE(rb->head, head + 1);
     return true;
 }
 
 uint8_t rb_get(ring_buffer *rb)
 {
-    uint8_t value = rb->buffer[rb->tail];
-    if(rb->head != rb->tail) {
-        rb->tail = (rb->tail + 1) % rb->size;
-    }
+    uint32_t tail = rb->tail;
+    // the tail is not moved if the buffer is empty
+    bool available = LOAD_ACQUIRE(rb->head) != tail;
+    uint8_t value = rb->buffer[tail & rb->mask];
+    if(available) STORE_RELEASE(rb->tail, tail + 1);
     return value;
 }
 
+// writes as many bytes as fit with at most two copies, returns the amount of bytes written
+int rb_write_bulk(ring_buffer *rb, const uint8_t *data, int length)
+{
+    uint32_t head = rb->head;
+    uint32_t space = rb->size - (head - LOAD_ACQUIRE(rb->tail));
+    uint32_t count = (uint32_t)length < space ? (uint32_t)length : space;
+    uint32_t start = head & rb->mask;
+    // first span up to the end of the buffer, second span from the start of the buffer
+    uint32_t first = count < rb->size - start ? count : rb->size - start;
+
+    memcpy(&rb->buffer[start], data, first);
+    memcpy(rb->buffer, data + first, count - first);
+    STORE_RELEASE(rb->head, head + count);
+    return (int)count;
+}
+
+// copies up to length bytes without removing them, returns the amount of bytes copied
+int rb_peek(ring_buffer *rb, uint8_t *data, int length)
+{
+    uint32_t tail = rb->tail;
+    uint32_t available = LOAD_ACQUIRE(rb->head) - tail;
+    uint32_t count = (uint32_t)length < available ? (uint32_t)length : available;
+    uint32_t start = tail & rb->mask;
+    uint32_t first = count < rb->size - start ? count : rb->size - start;
+
+    memcpy(data, &rb->buffer[start], first);
+    memcpy(data + first, rb->buffer, count - first);
+    return (int)count;
+}
+
+// reads up to length bytes with at most two copies, returns the amount of bytes read
+int rb_read_bulk(ring_buffer *rb, uint8_t *data, int length)
+{
+    int count = rb_peek(rb, data, length);
+    STORE_RELEASE(rb->tail, rb->tail + count);
+    return count;
+}
+
+// returns the contiguous readable data at the tail, it is removed with rb_consume
+const uint8_t *rb_read_span(ring_buffer *rb, int *length)
+{
+    uint32_t tail = rb->tail;
+    uint32_t available = LOAD_ACQUIRE(rb->head) - tail;
+    uint32_t start = tail & rb->mask;
+    *length = (int)(available < rb->size - start ? available : rb->size - start);
+    return &rb->buffer[start];
+}
+
+// removes bytes which were read with rb_read_span
+void rb_consume(ring_buffer *rb, int length)
+{
+    STORE_RELEASE(rb->tail, rb->tail + length);
+}
+
+// returns the contiguous free space at the head, the written data is published with rb_commit
+uint8_t *rb_write_span(ring_buffer *rb, int *length)
+{
+    uint32_t head = rb->head;
+    uint32_t space = rb->size - (head - LOAD_ACQUIRE(rb->tail));
+    uint32_t start = head & rb->mask;
+    *length = (int)(space < rb->size - start ? space : rb->size - start);
+    return &rb->buffer[start];
+}
+
+// publishes bytes which were written to the span of rb_write_span
+void rb_commit(ring_buffer *rb, int length)
+{
+    STORE_RELEASE(rb->head, rb->head + length);
+}
+
+// finds the next complete line without copying it. The delimiter and a \r in front of it are replaced by NUL,
+// so that a line which does not wrap can be used as a string. Data which was searched before is not searched again.
+// A line which does not fit into the ring is cut at the last byte. Returns false if no line is complete
+bool rb_get_line(ring_buffer *rb, char delimiter, rb_line *line)
+{
+    uint32_t tail = rb->tail;
+    uint32_t head = LOAD_ACQUIRE(rb->head);
+    // continue the search where the last call stopped, unless the data was read in the meantime
+    uint32_t position = (int32_t)(rb->line_scan - tail) > 0 ? rb->line_scan : tail;
+    bool found = false;
+
+    // search in at most two spans
+    while(position != head && !found) {
+        uint32_t start = position & rb->mask;
+        uint32_t span = head - position < rb->size - start ? head - position : rb->size - start;
+        uint8_t *match = memchr(&rb->buffer[start], delimiter, span);
+        if(match != NULL) {
+            position += match - &rb->buffer[start];
+            found = true;
+        } else {
+            position += span;
+        }
+    }
+    rb->line_scan = position;
+    if(!found) {
+        if(head - tail < rb->size) return false;
+        position = head - 1;
+    }
+
+    uint32_t length = position - tail;
+    rb->buffer[position & rb->mask] = '\0';
+    if(length > 0 && rb->buffer[(position - 1) & rb->mask] == '\r') {
+        rb->buffer[(position - 1) & rb->mask] = '\0';
+        length--;
+    }
+    uint32_t start = tail & rb->mask;
+    line->text = (const char *)&rb->buffer[start];
+    line->length = (int)(length < rb->size - start ? length : rb->size - start);
+    line->rest_length = (int)length - line->length;
+    // the NUL is only behind the text if the line ends before the end of the buffer
+    line->rest = start + length >= rb->size ? (const char *)rb->buffer : NULL;
+    line->size = (int)(position + 1 - tail);
+    return true;
+}
+
+// removes a line which was returned by rb_get_line
+void rb_release_line(ring_buffer *rb, const rb_line *line)
+{
+    rb_consume(rb, line->size);
+}
+
+// the heap-free build has no allocation of ring buffers
+#ifndef HEAP_FREE
+// size must be a power of two
 void rb_alloc(ring_buffer *rb, int size)
 {
     uint8_t  *buffer = calloc(size, sizeof(uint8_t));
@@ -54,3 +198,4 @@ void rb_free(ring_buffer *rb)
 {
     free(rb->buffer);
 }
+#endif
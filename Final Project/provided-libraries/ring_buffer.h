@@ -8,20 +8,49 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+// single-producer/single-consumer ring buffer, e.g. an interrupt handler and the main program.
+// head and tail run freely and are masked on access, so the size must be a power of two
 typedef struct  {
-    int head;
-    int tail;
-    int size;
+    volatile uint32_t head; // written only by the producer
+    volatile uint32_t tail; // written only by the consumer
+    uint32_t size;
+    uint32_t mask;
+    uint32_t line_scan; // position up to which the consumer searched for a delimiter
     uint8_t *buffer;
 } ring_buffer;
 
+// view onto a complete line inside the ring, a line which wraps at the end of the buffer continues in rest
+typedef struct {
+    const char *text;
+    int length;
+    const char *rest; // NULL if text is terminated with NUL, otherwise the line wraps and rest is terminated
+    int rest_length;
+    int size; // bytes which are released, including the delimiter
+} rb_line;
+
 void rb_init(ring_buffer *rb, uint8_t *buffer, int size);
 bool rb_empty(ring_buffer *rb);
 bool rb_full(ring_buffer *rb);
+int rb_count(ring_buffer *rb);
+int rb_space(ring_buffer *rb);
 bool rb_put(ring_buffer *rb, uint8_t data);
 uint8_t rb_get(ring_buffer *rb);
 
+int rb_write_bulk(ring_buffer *rb, const uint8_t *data, int length);
+int rb_read_bulk(ring_buffer *rb, uint8_t *data, int length);
+int rb_peek(ring_buffer *rb, uint8_t *data, int length);
+
+const uint8_t *rb_read_span(ring_buffer *rb, int *length);
+void rb_consume(ring_buffer *rb, int length);
+uint8_t *rb_write_span(ring_buffer *rb, int *length);
+void rb_commit(ring_buffer *rb, int length);
+
+bool rb_get_line(ring_buffer *rb, char delimiter, rb_line *line);
+void rb_release_line(ring_buffer *rb, const rb_line *line);
+
+#ifndef HEAP_FREE
 void rb_alloc(ring_buffer *rb, int size);
 void rb_free(ring_buffer *rb);
+#endif
 
 #endif //UART_IRQ_RING_BUFFER_H
@@ -1,135 +1,452 @@
-//
-// Created by keijo on 4.11.2023.
-//
-#include <string.h>
-#include "pico/stdlib.h"
-#include "hardware/uart.h"
-#include "ring_buffer.h"
-
-#include "uart.h"
-
-typedef struct {
-    ring_buffer tx;
-    ring_buffer rx;
-    uart_inst_t *uart;
-    int irqn;
-    irq_handler_t handler;
-} uart_t;
-
-void uart_irq_rx(uart_t *u);
-void uart_irq_tx(uart_t *u);
-void uart0_handler(void);
-void uart1_handler(void);
-
-static uart_t *uart_get_handle(int uart_nr);
-
-static uart_t u0 = { .uart = uart0, .irqn = UART0_IRQ, .handler = uart0_handler };
-static uart_t u1 = { .uart = uart1, .irqn = UART1_IRQ, .handler = uart1_handler };
-
-static uart_t *uart_get_handle(int uart_nr) {
-    return uart_nr ? &u1 : &u0;
-}
-
-
-void uart_setup(int uart_nr, int tx_pin, int rx_pin, int speed)
-{
-    uart_t *uart = uart_get_handle(uart_nr);
-
-    // ensure that we don't get any interrupts from the uart during configuration
-    irq_set_enabled(uart->irqn, false);
-
-    // allocate space for ring buffers
-    rb_alloc(&uart->rx, 256);
-    rb_alloc(&uart->tx, 256);
-
-    // Set up our UART with the required speed.
-    uart_init(uart->uart, speed);
-
-    // Set the TX and RX pins by using the function select on the GPIO
-    // See datasheet for more information on function select
-    gpio_set_function(tx_pin, GPIO_FUNC_UART);
-    gpio_set_function(rx_pin, GPIO_FUNC_UART);
-
-    irq_set_exclusive_handler(uart->irqn, uart->handler);
-
-    // Now enable the UART to send interrupts - RX only
-    uart_set_irq_enables(uart->uart, true, false);
-    // enable UART0 interrupts on NVIC
-    irq_set_enabled(uart->irqn, true);
-}
-
-int uart_read(int uart_nr, uint8_t *buffer, int size)
-{
-    int count = 0;
-    uart_t *u = uart_get_handle(uart_nr);
-    while(count < size && !rb_empty(&u->rx)) {
-        *buffer++ = rb_get(&u->rx);
-        ++count;
-    }
-    return count;
-}
-
-int uart_write(int uart_nr, const uint8_t *buffer, int size)
-{
-    int count = 0;
-    uart_t *u = uart_get_handle(uart_nr);
-    // write data to ring buffer
-    while(count < size && !rb_full(&u->tx)) {
-        rb_put(&u->tx, *buffer++);
-        ++count;
-    }
-    // disable interrupts on NVIC while managing transmit interrupts
-    irq_set_enabled(u->irqn, false);
-
-    // if transmit interrupt is not enabled we need to enable it and give fifo an initial filling
-    if(!(uart_get_hw(u->uart)->imsc & (1 << UART_UARTIMSC_TXIM_LSB))) {
-        // enable transmit interrupt
-        uart_set_irq_enables(u->uart, true, true);
-        // fifo requires initial filling
-        uart_irq_tx(u);
-    }
-
-    // enable interrupts on NVIC
-    irq_set_enabled(u->irqn, true);
-
-    return count;
-}
-
-int uart_send(int uart_nr, const char *str)
-{
-    return uart_write(uart_nr, (const uint8_t *)str, strlen(str));
-}
-
-
-void uart_irq_rx(uart_t *u)
-{
-    while(uart_is_readable(u->uart)) {
-        uint8_t c = uart_getc(u->uart);
-        // ignoring return value for now
-        rb_put(&u->rx, c);
-    }
-}
-
-void uart_irq_tx(uart_t *u)
-{
-    while(!rb_empty(&u->tx) && uart_is_writable(u->uart)) {
-        uart_get_hw(u->uart)->dr = rb_get((&u->tx));
-    }
-
-    if (rb_empty(&u->tx)) {
-        // disable tx interrupt if transmit buffer is empty
-        uart_set_irq_enables(u->uart, true, false);
-    }
-}
-
-void uart0_handler(void)
-{
-    uart_irq_rx(&u0);
-    uart_irq_tx(&u0);
-}
-
-void uart1_handler(void)
-{
-    uart_irq_rx(&u1);
-    uart_irq_tx(&u1);
-}
+//
+// Created by keijo on 4.11.2023.
+//
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/uart.h"
+#include "hardware/dma.h"
+#include "ring_buffer.h"
+
+#include "uart.h"
+#include "../profile.h"
+
+// sizes of the ring buffers, powers of two. They are set by the build, e.g. a bigger receive ring for the LORA module
+#ifndef UART0_RX_SIZE
+#define UART0_RX_SIZE 256
+#endif
+#ifndef UART0_TX_SIZE
+#define UART0_TX_SIZE 256
+#endif
+#ifndef UART1_RX_SIZE
+#define UART1_RX_SIZE 256
+#endif
+#ifndef UART1_TX_SIZE
+#define UART1_TX_SIZE 256
+#endif
+
+#define IS_POWER_OF_TWO(size) ((size) > 0 && ((size) & ((size) - 1)) == 0)
+_Static_assert(IS_POWER_OF_TWO(UART0_RX_SIZE) && IS_POWER_OF_TWO(UART0_TX_SIZE) &&
+               IS_POWER_OF_TWO(UART1_RX_SIZE) && IS_POWER_OF_TWO(UART1_TX_SIZE),
+               "sizes of the UART ring buffers must be powers of two");
+
+// amount of transfers until the receive DMA has to be restarted, a power of two so that the transferred
+// amount can be counted modulo RX_DMA_COUNT across restarts
+#define RX_DMA_COUNT 0x80000000
+// error flags of a received character in the data register, at the positions of the receive status register
+#define UART_DR_ERROR_SHIFT 8
+
+typedef struct {
+    ring_buffer tx;
+    ring_buffer rx;
+    uart_inst_t *uart;
+    int speed;
+    int irqn;
+    irq_handler_t handler;
+    int rx_dma; // DMA channel which receives into the rx ring, -1 if the receive interrupt is used
+    int tx_dma; // DMA channel which sends caller-owned buffers, -1 until the first DMA transmission
+    volatile bool tx_dma_busy; // true while a DMA transmission is running, the tx ring waits for it
+    uart_tx_callback tx_callback; // called from the interrupt when the DMA transmission is finished
+    uint32_t rx_dma_transferred; // amount of transfers of the receive DMA which were published to the rx ring
+    uart_stats stats;
+    uint8_t *rx_buffer; // statically allocated memory of the rings
+    int rx_size;
+    uint8_t *tx_buffer;
+    int tx_size;
+} uart_t;
+
+void uart_irq_rx(uart_t *u);
+void uart_irq_tx(uart_t *u);
+void uart0_handler(void);
+void uart1_handler(void);
+void uart_dma_handler(void);
+
+static uart_t *uart_get_handle(int uart_nr);
+
+// the receive rings are aligned to their size, so that the DMA can wrap its write address in them
+static uint8_t u0_rx_buffer[UART0_RX_SIZE] __attribute__((aligned(UART0_RX_SIZE)));
+static uint8_t u0_tx_buffer[UART0_TX_SIZE];
+static uint8_t u1_rx_buffer[UART1_RX_SIZE] __attribute__((aligned(UART1_RX_SIZE)));
+static uint8_t u1_tx_buffer[UART1_TX_SIZE];
+
+static uart_t u0 = { .uart = uart0, .irqn = UART0_IRQ, .handler = uart0_handler, .rx_dma = -1, .tx_dma = -1,
+                     .rx_buffer = u0_rx_buffer, .rx_size = UART0_RX_SIZE,
+                     .tx_buffer = u0_tx_buffer, .tx_size = UART0_TX_SIZE };
+static uart_t u1 = { .uart = uart1, .irqn = UART1_IRQ, .handler = uart1_handler, .rx_dma = -1, .tx_dma = -1,
+                     .rx_buffer = u1_rx_buffer, .rx_size = UART1_RX_SIZE,
+                     .tx_buffer = u1_tx_buffer, .tx_size = UART1_TX_SIZE };
+
+static bool dma_handler_installed = false;
+
+static uart_t *uart_get_handle(int uart_nr) {
+    return uart_nr ? &u1 : &u0;
+}
+
+
+void uart_setup(int uart_nr, int tx_pin, int rx_pin, int speed)
+{
+    uart_t *uart = uart_get_handle(uart_nr);
+
+    // ensure that we don't get any interrupts from the uart during configuration
+    irq_set_enabled(uart->irqn, false);
+
+    // the ring buffers use statically allocated memory
+    rb_init(&uart->rx, uart->rx_buffer, uart->rx_size);
+    rb_init(&uart->tx, uart->tx_buffer, uart->tx_size);
+
+    // Set up our UART with the required speed.
+    uart->speed = speed;
+    uart_init(uart->uart, speed);
+
+    // Set the TX and RX pins by using the function select on the GPIO
+    // See datasheet for more information on function select
+    gpio_set_function(tx_pin, GPIO_FUNC_UART);
+    gpio_set_function(rx_pin, GPIO_FUNC_UART);
+
+    irq_set_exclusive_handler(uart->irqn, uart->handler);
+
+    // Now enable the UART to send interrupts - RX only
+    uart_set_irq_enables(uart->uart, true, false);
+    // enable UART0 interrupts on NVIC
+    irq_set_enabled(uart->irqn, true);
+}
+
+// must be called after the frequency of the peripheral clock has changed
+void uart_clock_changed(int uart_nr)
+{
+    uart_t *u = uart_get_handle(uart_nr);
+    // let the transmission of the buffered data finish with the old divider
+    while(!rb_empty(&u->tx) || u->tx_dma_busy) {
+        tight_loop_contents();
+    }
+    uart_tx_wait_blocking(u->uart);
+    uart_set_baudrate(u->uart, u->speed);
+}
+
+// changes the speed of the UART, the buffered data is still sent with the old speed
+void uart_set_speed(int uart_nr, int speed)
+{
+    uart_t *u = uart_get_handle(uart_nr);
+    u->speed = speed;
+    uart_clock_changed(uart_nr);
+}
+
+// connects the transmitter internally to the receiver, e.g. to measure the throughput of the driver without a peer
+void uart_set_loopback(int uart_nr, bool enabled)
+{
+    uart_t *u = uart_get_handle(uart_nr);
+    // the buffered data is still sent on the old path
+    while(!rb_empty(&u->tx) || u->tx_dma_busy) {
+        tight_loop_contents();
+    }
+    uart_tx_wait_blocking(u->uart);
+    if(enabled) {
+        hw_set_bits(&uart_get_hw(u->uart)->cr, UART_UARTCR_LBE_BITS);
+    } else {
+        hw_clear_bits(&uart_get_hw(u->uart)->cr, UART_UARTCR_LBE_BITS);
+    }
+}
+
+// installs the handler of the DMA interrupt which is shared by the receive and transmit channels
+static void uart_dma_irq_init(void)
+{
+    if(dma_handler_installed) return;
+    dma_handler_installed = true;
+    irq_add_shared_handler(DMA_IRQ_0, uart_dma_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_0, true);
+}
+
+// receives with DMA instead of the receive interrupt, so that no byte is lost while interrupts are blocked.
+// The DMA drains the FIFO for every received byte, the data becomes visible when the consumer reads
+void uart_enable_rx_dma(int uart_nr)
+{
+    uart_t *u = uart_get_handle(uart_nr);
+    if(u->rx_dma >= 0) return;
+
+    irq_set_enabled(u->irqn, false);
+    // the receive interrupt must not compete with the DMA for the FIFO
+    uart_set_irq_enables(u->uart, false, false);
+
+    u->rx_dma = dma_claim_unused_channel(true);
+    dma_channel_config config = dma_channel_get_default_config(u->rx_dma);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, true);
+    channel_config_set_ring(&config, true, __builtin_ctz(u->rx.size));
+    channel_config_set_dreq(&config, uart_get_dreq(u->uart, false));
+    // the DMA continues behind the data which was received by the interrupt
+    u->rx_dma_transferred = 0;
+    dma_channel_configure(u->rx_dma, &config, &u->rx.buffer[u->rx.head & u->rx.mask], &uart_get_hw(u->uart)->dr,
+                          RX_DMA_COUNT, true);
+
+    // the interrupt of the DMA only restarts the channel after RX_DMA_COUNT bytes
+    dma_channel_set_irq0_enabled(u->rx_dma, true);
+    uart_dma_irq_init();
+
+    // a transmission which is still running needs the transmit interrupt
+    if(!rb_empty(&u->tx)) uart_set_irq_enables(u->uart, false, true);
+    irq_set_enabled(u->irqn, true);
+}
+
+// counts the error flags of the receive status register
+static void uart_count_errors(uart_t *u, uint32_t flags)
+{
+    if(flags & UART_UARTRSR_OE_BITS) u->stats.overrun_errors++;
+    if(flags & UART_UARTRSR_FE_BITS) u->stats.framing_errors++;
+    if(flags & UART_UARTRSR_PE_BITS) u->stats.parity_errors++;
+    if(flags & UART_UARTRSR_BE_BITS) u->stats.break_errors++;
+}
+
+// publishes the bytes which the DMA has written since the last read as new head of the rx ring
+static void uart_rx_dma_sync(uart_t *u)
+{
+    // the transfer counter runs down from RX_DMA_COUNT and starts again after a restart of the DMA
+    uint32_t transferred = RX_DMA_COUNT - dma_channel_hw_addr(u->rx_dma)->transfer_count;
+    uint32_t received = (transferred - u->rx_dma_transferred) & (RX_DMA_COUNT - 1);
+    u->rx_dma_transferred = transferred;
+    u->stats.bytes_in += received;
+    rb_commit(&u->rx, received);
+
+    uint32_t count = u->rx.head - u->rx.tail;
+    if(count > u->rx.size) {
+        // the DMA has overwritten the oldest unread bytes, reading continues behind them
+        u->stats.rx_dropped += count - u->rx.size;
+        rb_consume(&u->rx, count - u->rx.size);
+        count = u->rx.size;
+    }
+    if(count > u->stats.rx_high_water) u->stats.rx_high_water = count;
+
+    // the DMA reads only the data, the errors are collected in the receive status register
+    uint32_t errors = uart_get_hw(u->uart)->rsr;
+    if(errors) {
+        uart_count_errors(u, errors);
+        uart_get_hw(u->uart)->rsr = 0;
+    }
+}
+
+int uart_read(int uart_nr, uint8_t *buffer, int size)
+{
+    uart_t *u = uart_get_handle(uart_nr);
+    if(u->rx_dma >= 0) uart_rx_dma_sync(u);
+    return rb_read_bulk(&u->rx, buffer, size);
+}
+
+// amount of received bytes which were not read yet
+int uart_available(int uart_nr)
+{
+    uart_t *u = uart_get_handle(uart_nr);
+    if(u->rx_dma >= 0) uart_rx_dma_sync(u);
+    return rb_count(&u->rx);
+}
+
+// returns a view onto the next complete received line without copying it, the line ending is not part of it.
+// The line stays in the receive ring until it is released with uart_release_line
+bool uart_read_line(int uart_nr, rb_line *line)
+{
+    uart_t *u = uart_get_handle(uart_nr);
+    if(u->rx_dma >= 0) uart_rx_dma_sync(u);
+    return rb_get_line(&u->rx, '\n', line);
+}
+
+void uart_release_line(int uart_nr, const rb_line *line)
+{
+    rb_release_line(&uart_get_handle(uart_nr)->rx, line);
+}
+
+// writes as much data as fits to the tx ring and starts the transmission
+static int uart_queue(uart_t *u, const uint8_t *buffer, int size)
+{
+    // write data to ring buffer
+    int count = rb_write_bulk(&u->tx, buffer, size);
+    if((uint32_t)rb_count(&u->tx) > u->stats.tx_high_water) u->stats.tx_high_water = rb_count(&u->tx);
+    // disable interrupts on NVIC while managing transmit interrupts
+    irq_set_enabled(u->irqn, false);
+
+    // if transmit interrupt is not enabled we need to enable it and give fifo an initial filling,
+    // during a DMA transmission the data waits in the ring until the DMA is finished
+    if(!(uart_get_hw(u->uart)->imsc & (1 << UART_UARTIMSC_TXIM_LSB)) && !u->tx_dma_busy) {
+        // enable transmit interrupt
+        uart_set_irq_enables(u->uart, u->rx_dma < 0, true);
+        // fifo requires initial filling
+        uart_irq_tx(u);
+    }
+
+    // enable interrupts on NVIC
+    irq_set_enabled(u->irqn, true);
+
+    return count;
+}
+
+int uart_write(int uart_nr, const uint8_t *buffer, int size)
+{
+    uart_t *u = uart_get_handle(uart_nr);
+    int count = uart_queue(u, buffer, size);
+    u->stats.tx_dropped += size - count;
+    return count;
+}
+
+int uart_send(int uart_nr, const char *str)
+{
+    return uart_write(uart_nr, (const uint8_t *)str, strlen(str));
+}
+
+// writes all data to the ring buffer, waits for free space as long as the timeout allows.
+// Data which fits into the ring is queued completely or not at all, so that a timeout never leaves
+// the beginning of a command in the ring. Longer data is queued piece by piece as the ring drains.
+// returns true if all data was queued for sending
+bool uart_write_timeout(int uart_nr, const uint8_t *buffer, int size, uint32_t timeout_us)
+{
+    uart_t *u = uart_get_handle(uart_nr);
+    uint32_t start = time_us_32();
+    if(size <= u->tx_size) {
+        while(rb_space(&u->tx) < size) {
+            if(time_us_32() - start > timeout_us) {
+                u->stats.tx_dropped += size;
+                return false;
+            }
+            tight_loop_contents();
+        }
+    }
+    int count = uart_queue(u, buffer, size);
+    while(count < size) {
+        if(time_us_32() - start > timeout_us) {
+            u->stats.tx_dropped += size - count;
+            return false;
+        }
+        tight_loop_contents();
+        count += uart_queue(u, buffer + count, size - count);
+    }
+    return true;
+}
+
+bool uart_send_timeout(int uart_nr, const char *str, uint32_t timeout_us)
+{
+    return uart_write_timeout(uart_nr, (const uint8_t *)str, strlen(str), timeout_us);
+}
+
+// sends the buffer of the caller with DMA without copying it. The buffer must stay valid until uart_tx_done
+// returns true or the callback is called. Returns false without sending if a transmission is still running
+bool uart_write_dma(int uart_nr, const uint8_t *buffer, int size, uart_tx_callback callback)
+{
+    uart_t *u = uart_get_handle(uart_nr);
+    if(u->tx_dma_busy || !rb_empty(&u->tx)) return false;
+
+    if(u->tx_dma < 0) {
+        u->tx_dma = dma_claim_unused_channel(true);
+        dma_channel_set_irq0_enabled(u->tx_dma, true);
+        uart_dma_irq_init();
+    }
+    dma_channel_config config = dma_channel_get_default_config(u->tx_dma);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_read_increment(&config, true);
+    channel_config_set_write_increment(&config, false);
+    channel_config_set_dreq(&config, uart_get_dreq(u->uart, true));
+
+    irq_set_enabled(u->irqn, false);
+    // the ring is empty, its transmit interrupt must not feed the FIFO during the DMA transmission
+    uart_set_irq_enables(u->uart, u->rx_dma < 0, false);
+    u->tx_callback = callback;
+    u->tx_dma_busy = true;
+    u->stats.bytes_out += size;
+    dma_channel_configure(u->tx_dma, &config, &uart_get_hw(u->uart)->dr, buffer, size, true);
+    irq_set_enabled(u->irqn, true);
+    return true;
+}
+
+// returns true if no DMA transmission is running, the last bytes may still be in the FIFO
+bool uart_tx_done(int uart_nr)
+{
+    return !uart_get_handle(uart_nr)->tx_dma_busy;
+}
+
+// returns the counters of the UART, the data received by DMA is counted when it is read
+const uart_stats *uart_get_stats(int uart_nr)
+{
+    uart_t *u = uart_get_handle(uart_nr);
+    if(u->rx_dma >= 0) uart_rx_dma_sync(u);
+    return &u->stats;
+}
+
+// prints the counters of the UART on the console
+void uart_print_stats(int uart_nr)
+{
+    uart_t *u = uart_get_handle(uart_nr);
+    const uart_stats *stats = uart_get_stats(uart_nr);
+    printf("UART%d: in %u, out %u bytes, high water rx %u/%u, tx %u/%u, dropped rx %u, tx %u\n", uart_nr,
+           stats->bytes_in, stats->bytes_out, stats->rx_high_water, u->rx.size, stats->tx_high_water, u->tx.size,
+           stats->rx_dropped, stats->tx_dropped);
+    printf("UART%d: errors overrun %u, framing %u, parity %u, break %u, interrupts %u, dma %u\n", uart_nr,
+           stats->overrun_errors, stats->framing_errors, stats->parity_errors, stats->break_errors, stats->irqs,
+           stats->dma_irqs);
+}
+
+
+void uart_irq_rx(uart_t *u)
+{
+    if(u->rx_dma >= 0) return;
+    while(uart_is_readable(u->uart)) {
+        // the data register contains the error flags of the character above the data
+        uint32_t data = uart_get_hw(u->uart)->dr;
+        uart_count_errors(u, data >> UART_DR_ERROR_SHIFT);
+        u->stats.bytes_in++;
+        if(!rb_put(&u->rx, (uint8_t)data)) u->stats.rx_dropped++;
+    }
+    if((uint32_t)rb_count(&u->rx) > u->stats.rx_high_water) u->stats.rx_high_water = rb_count(&u->rx);
+}
+
+void uart_irq_tx(uart_t *u)
+{
+    // data which was written during a DMA transmission is sent after it
+    if(u->tx_dma_busy) return;
+    while(!rb_empty(&u->tx) && uart_is_writable(u->uart)) {
+        uart_get_hw(u->uart)->dr = rb_get((&u->tx));
+        u->stats.bytes_out++;
+    }
+
+    if (rb_empty(&u->tx)) {
+        // disable tx interrupt if transmit buffer is empty
+        uart_set_irq_enables(u->uart, u->rx_dma < 0, false);
+    }
+}
+
+void uart0_handler(void)
+{
+    PROFILE_SCOPE(PROFILE_UART_IRQ);
+    u0.stats.irqs++;
+    uart_irq_rx(&u0);
+    uart_irq_tx(&u0);
+}
+
+void uart1_handler(void)
+{
+    PROFILE_SCOPE(PROFILE_UART_IRQ);
+    u1.stats.irqs++;
+    uart_irq_rx(&u1);
+    uart_irq_tx(&u1);
+}
+
+void uart_dma_handler(void)
+{
+    PROFILE_SCOPE(PROFILE_DMA_IRQ);
+    uart_t *uarts[] = { &u0, &u1 };
+    for(int i = 0; i < 2; i++) {
+        uart_t *u = uarts[i];
+        if(u->rx_dma >= 0 && dma_channel_get_irq0_status(u->rx_dma)) {
+            dma_channel_acknowledge_irq0(u->rx_dma);
+            u->stats.dma_irqs++;
+            // continue at the current write address, the ring keeps wrapping
+            dma_channel_set_trans_count(u->rx_dma, RX_DMA_COUNT, true);
+        }
+        if(u->tx_dma >= 0 && dma_channel_get_irq0_status(u->tx_dma)) {
+            dma_channel_acknowledge_irq0(u->tx_dma);
+            u->stats.dma_irqs++;
+            u->tx_dma_busy = false;
+            // start sending the data which was written to the ring in the meantime
+            if(!rb_empty(&u->tx)) {
+                uart_set_irq_enables(u->uart, u->rx_dma < 0, true);
+                uart_irq_tx(u);
+            }
+            if(u->tx_callback != NULL) u->tx_callback(i);
+        }
+    }
+}
@@ -1,14 +1,49 @@
-//
-// Created by keijo on 4.11.2023.
-//
-
-#ifndef UART_IRQ_UART_H
-#define UART_IRQ_UART_H
-
-
-void uart_setup(int uart_nr, int tx_pin, int rx_pin, int speed);
-int uart_read(int uart_nr, uint8_t *buffer, int size);
-int uart_write(int uart_nr, const uint8_t *buffer, int size);
-int uart_send(int uart_nr, const char *str);
-
-#endif //UART_IRQ_UART_H
+//
+// Created by keijo on 4.11.2023.
+//
+
+#ifndef UART_IRQ_UART_H
+#define UART_IRQ_UART_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ring_buffer.h"
+
+// called from the interrupt handler when a DMA transmission is finished
+typedef void (*uart_tx_callback)(int uart_nr);
+
+// counters of one UART
+typedef struct uart_stats {
+    uint32_t bytes_in; // received bytes
+    uint32_t bytes_out; // bytes which were handed to the hardware
+    uint32_t rx_high_water; // highest amount of unread bytes in the rx ring
+    uint32_t tx_high_water; // highest amount of unsent bytes in the tx ring
+    uint32_t rx_dropped; // received bytes which were lost because the rx ring was full
+    uint32_t tx_dropped; // bytes which did not fit into the tx ring
+    uint32_t overrun_errors; // characters lost because the hardware FIFO was full
+    uint32_t framing_errors;
+    uint32_t parity_errors;
+    uint32_t break_errors;
+    uint32_t irqs; // interrupts of the UART
+    uint32_t dma_irqs; // interrupts of the DMA channels of the UART
+} uart_stats;
+
+void uart_setup(int uart_nr, int tx_pin, int rx_pin, int speed);
+int uart_read(int uart_nr, uint8_t *buffer, int size);
+int uart_available(int uart_nr);
+bool uart_read_line(int uart_nr, rb_line *line);
+void uart_release_line(int uart_nr, const rb_line *line);
+int uart_write(int uart_nr, const uint8_t *buffer, int size);
+int uart_send(int uart_nr, const char *str);
+bool uart_write_timeout(int uart_nr, const uint8_t *buffer, int size, uint32_t timeout_us);
+bool uart_send_timeout(int uart_nr, const char *str, uint32_t timeout_us);
+bool uart_write_dma(int uart_nr, const uint8_t *buffer, int size, uart_tx_callback callback);
+bool uart_tx_done(int uart_nr);
+void uart_clock_changed(int uart_nr);
+void uart_set_speed(int uart_nr, int speed);
+void uart_set_loopback(int uart_nr, bool enabled);
+void uart_enable_rx_dma(int uart_nr);
+const uart_stats *uart_get_stats(int uart_nr);
+void uart_print_stats(int uart_nr);
+
+#endif //UART_IRQ_UART_H
@@ -0,0 +1,99 @@
+#include "pico/stdlib.h"
+#include "hardware/watchdog.h"
+#include "recovery.h"
+
+// marks valid content of the scratch registers, combined with the values to detect corruption
+#define RECOVERY_MAGIC 0x9D15E45E
+
+// true if the system was reset by the watchdog and the scratch registers contain a valid state
+bool recovery_valid = false;
+// function which returns the value of the clock slot, NULL if the clock is not mirrored
+recovery_clock clock_source = NULL;
+// time in us of the last update of the clock slot
+uint64_t clock_mirror_time = 0;
+
+/**
+ * calculates the check value of the scratch registers
+ * @return check value, which is saved in the first scratch register
+ */
+static uint32_t recovery_check() {
+    uint32_t check = RECOVERY_MAGIC;
+    for (int i = 1; i <= RECOVERY_SLOTS; i++) {
+        check ^= watchdog_hw->scratch[i] * (2 * i + 1);
+    }
+    return check;
+}
+
+/**
+ * checks if the last reset was caused by the watchdog while the mirrored state was still valid and enables the watchdog.
+ * The scratch registers 0 to 3 are used, 4 to 7 are reserved by the SDK and the boot ROM.
+ * Their content survives a watchdog reset but not a power off, so power loss is still handled by the EEPROM
+ * @return true if this is a warm reset and the mirrored state can be loaded, otherwise false
+ */
+bool recovery_init() {
+    recovery_valid = watchdog_enable_caused_reboot() && watchdog_hw->scratch[0] == recovery_check();
+    if (!recovery_valid) {
+        for (int i = 1; i <= RECOVERY_SLOTS; i++) {
+            watchdog_hw->scratch[i] = 0;
+        }
+        watchdog_hw->scratch[0] = recovery_check();
+    }
+    watchdog_enable(WATCHDOG_TIMEOUT, true);
+    return recovery_valid;
+}
+
+/**
+ * mirrors a value to a scratch register of the watchdog
+ * @param slot number of the slot, 0 to RECOVERY_SLOTS - 1
+ * @param value value to mirror
+ */
+void recovery_save(uint8_t slot, uint32_t value) {
+    if (slot >= RECOVERY_SLOTS) {
+        return;
+    }
+    // value and check value must not be written by an interrupt in between
+    uint32_t interrupts = save_and_disable_interrupts();
+    watchdog_hw->scratch[slot + 1] = value;
+    watchdog_hw->scratch[0] = recovery_check();
+    restore_interrupts(interrupts);
+}
+
+/**
+ * sets the function which returns the value of the clock slot, it is called at the updates of the watchdog
+ * @param clock function which returns the current time in the format of its owner
+ */
+void recovery_set_clock(recovery_clock clock) {
+    clock_source = clock;
+    clock_mirror_time = time_us_64();
+    recovery_save(RECOVERY_CLOCK_SLOT, clock());
+}
+
+/**
+ * updates the watchdog and mirrors the clock at most once per RECOVERY_CLOCK_INTERVAL, so that the time
+ * is known after a watchdog reset. It is called instead of watchdog_update wherever the firmware waits
+ */
+void recovery_update() {
+    watchdog_update();
+    uint64_t now = time_us_64();
+    if (clock_source != NULL && now - clock_mirror_time >= RECOVERY_CLOCK_INTERVAL) {
+        clock_mirror_time = now;
+        uint32_t value = clock_source();
+        if (value != watchdog_hw->scratch[RECOVERY_CLOCK_SLOT + 1]) {
+            recovery_save(RECOVERY_CLOCK_SLOT, value);
+        }
+    }
+}
+
+/**
+ * loads a value which has been mirrored before the last watchdog reset
+ * @param slot number of the slot, 0 to RECOVERY_SLOTS - 1
+ * @param value pointer where the value is written to
+ * @return true if the value is valid, false after a cold start or if the slot does not exist
+ */
+bool recovery_load(uint8_t slot, uint32_t *value) {
+    if (!recovery_valid || slot >= RECOVERY_SLOTS) {
+        return false;
+    }
+    *value = watchdog_hw->scratch[slot + 1];
+    return true;
+}
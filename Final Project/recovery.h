@@ -0,0 +1,31 @@
+#ifndef UART_IRQ_RECOVERY_H
+#define UART_IRQ_RECOVERY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// time in ms without update until the watchdog resets the system
+#define WATCHDOG_TIMEOUT 5000
+// maximum time in ms between two updates of the watchdog while sleeping
+#define WATCHDOG_FEED_INTERVAL 2000
+// amount of values which can be mirrored to the scratch registers of the watchdog
+#define RECOVERY_SLOTS 3
+// slot which mirrors the clock, the slots in front of it belong to the stepper motors
+#define RECOVERY_CLOCK_SLOT (RECOVERY_SLOTS - 1)
+// minimum time in us between two updates of the mirrored clock
+#define RECOVERY_CLOCK_INTERVAL 1000000
+
+// function which returns the current value of the mirrored clock
+typedef uint32_t (*recovery_clock)();
+
+bool recovery_init();
+
+void recovery_set_clock(recovery_clock clock);
+
+void recovery_update();
+
+void recovery_save(uint8_t slot, uint32_t value);
+
+bool recovery_load(uint8_t slot, uint32_t *value);
+
+#endif //UART_IRQ_RECOVERY_H
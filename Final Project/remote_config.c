@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "remote_config.h"
+#include "eeprom.h"
+#include "logger.h"
+#include "lora_mod.h"
+#include "schedule.h"
+
+// batch window in s which is used if no valid configuration is found in the EEPROM
+#define DEFAULT_BATCH_WINDOW 10
+// rejoin interval in h which is used if no valid configuration is found in the EEPROM
+#define DEFAULT_REJOIN_INTERVAL 24
+
+// structure which is saved to the EEPROM with the settings that were changed remotely
+typedef struct configrecord {
+    uint16_t batch_window; // time in s during which events are collected for one uplink
+    uint16_t rejoin_interval; // time in h after which the network is joined again, 0 only after a lost session
+} configrecord;
+
+// one command which can be sent by downlink
+typedef struct remote_command {
+    uint8_t code; // command code as defined in enum Remote_Commands
+    uint8_t min_length; // minimum length of the arguments in bytes
+    bool (*execute)(const uint8_t *args, int length); // returns true if the command was executed
+} remote_command;
+
+// eeprom address where the configuration record is saved
+uint16_t eeprom_address_configrecord = 0x0880;
+
+configrecord config_record = {DEFAULT_BATCH_WINDOW, DEFAULT_REJOIN_INTERVAL};
+
+// true if the wheels have to be aligned again during the next dose
+bool recalibration_requested = false;
+
+/**
+ * loads the configuration record from the EEPROM
+ * @return true if a valid configuration was found, otherwise false
+ */
+static bool load_config_record() {
+    uint8_t data[6];
+    read_bytes_from_eeprom(eeprom_address_configrecord, data, sizeof(data));
+    if (crc16(data, sizeof(data)) != 0) {
+        return false;
+    }
+    config_record.batch_window = (data[0] << 8) | data[1];
+    config_record.rejoin_interval = (data[2] << 8) | data[3];
+    return true;
+}
+
+/**
+ * saves the configuration record to the EEPROM
+ */
+static void save_config_record() {
+    uint8_t data[6];
+    data[0] = config_record.batch_window >> 8;
+    data[1] = config_record.batch_window & 0xFF;
+    data[2] = config_record.rejoin_interval >> 8;
+    data[3] = config_record.rejoin_interval & 0xFF;
+    uint16_t crc = crc16(data, 4);
+    data[4] = (uint8_t) (crc >> 8);
+    data[5] = (uint8_t) crc;
+    write_bytes_to_eeprom(eeprom_address_configrecord, data, sizeof(data));
+}
+
+/**
+ * applies the configuration to the modules
+ */
+static void apply_config() {
+    lora_set_batch_window((uint32_t) config_record.batch_window * 1000);
+    lora_set_rejoin_interval((uint32_t) config_record.rejoin_interval * 3600);
+}
+
+/**
+ * replaces the dose table
+ * @param args dose entries of 3 bytes each
+ * @param length length of the arguments
+ * @return true if all entries are valid and the table was saved, otherwise false
+ */
+static bool set_schedule(const uint8_t *args, int length) {
+    dose_entry entries[MAX_DOSE_ENTRIES];
+    int count = length / 3;
+    if (length % 3 != 0 || count > MAX_DOSE_ENTRIES) {
+        return false;
+    }
+    for (int i = 0; i < count; i++) {
+        entries[i].hour = args[3 * i];
+        entries[i].minute = args[3 * i + 1];
+        entries[i].weekdays = args[3 * i + 2];
+        if (entries[i].hour > 23 || entries[i].minute > 59 || entries[i].weekdays == 0 ||
+            entries[i].weekdays > EVERY_DAY) {
+            return false;
+        }
+    }
+    return schedule_set_entries(entries, count);
+}
+
+/**
+ * replaces the exceptions of single dates
+ * @param args exceptions of 6 bytes each
+ * @param length length of the arguments
+ * @return true if all exceptions are valid and were saved, otherwise false
+ */
+static bool set_exceptions(const uint8_t *args, int length) {
+    dose_exception exceptions[MAX_DOSE_EXCEPTIONS];
+    int count = length / 6;
+    if (length % 6 != 0 || count > MAX_DOSE_EXCEPTIONS) {
+        return false;
+    }
+    for (int i = 0; i < count; i++) {
+        exceptions[i].year = args[6 * i];
+        exceptions[i].month = args[6 * i + 1];
+        exceptions[i].day = args[6 * i + 2];
+        exceptions[i].hour = args[6 * i + 3];
+        exceptions[i].minute = args[6 * i + 4];
+        exceptions[i].action = args[6 * i + 5];
+        if (exceptions[i].month < 1 || exceptions[i].month > 12 || exceptions[i].day < 1 || exceptions[i].day > 31 ||
+            (exceptions[i].hour > 23 && !(exceptions[i].hour == WHOLE_DAY && exceptions[i].action == SKIP_DOSE)) ||
+            exceptions[i].minute > 59 || exceptions[i].action > EXTRA_DOSE) {
+            return false;
+        }
+    }
+    return schedule_set_exceptions(exceptions, count);
+}
+
+/**
+ * changes the time during which events are collected for one uplink
+ * @param args 16-bit big endian time in s
+ * @param length length of the arguments
+ * @return true if the setting was saved
+ */
+static bool set_batch_window(const uint8_t *args, int length) {
+    (void) length;
+    config_record.batch_window = (args[0] << 8) | args[1];
+    save_config_record();
+    apply_config();
+    return true;
+}
+
+/**
+ * changes the time after which the network is joined again with a new session
+ * @param args 16-bit big endian time in h, 0 joins again only after the session was lost
+ * @param length length of the arguments
+ * @return true if the setting was saved
+ */
+static bool set_rejoin_interval(const uint8_t *args, int length) {
+    (void) length;
+    config_record.rejoin_interval = (args[0] << 8) | args[1];
+    save_config_record();
+    apply_config();
+    return true;
+}
+
+/**
+ * sends the log of the EEPROM via the LORA module
+ * @param args not used
+ * @param length not used
+ * @return true
+ */
+static bool dump_log(const uint8_t *args, int length) {
+    (void) args;
+    (void) length;
+    send_log();
+    return true;
+}
+
+/**
+ * sets the date and time of the RTC
+ * @param args 32-bit big endian time in s since 1.1.2000 00:00:00
+ * @param length length of the arguments
+ * @return true
+ */
+static bool set_time(const uint8_t *args, int length) {
+    (void) length;
+    uint32_t seconds = ((uint32_t) args[0] << 24) | ((uint32_t) args[1] << 16) | (args[2] << 8) | args[3];
+    schedule_set_time_seconds(seconds);
+    return true;
+}
+
+/**
+ * requests that the wheels are aligned again at point zero during the next dose
+ * @param args not used
+ * @param length not used
+ * @return true
+ */
+static bool recalibrate(const uint8_t *args, int length) {
+    (void) args;
+    (void) length;
+    recalibration_requested = true;
+    return true;
+}
+
+// all commands which can be sent by downlink
+const remote_command remote_commands[] = {
+        {REMOTE_SET_SCHEDULE, 3, set_schedule},
+        {REMOTE_SET_BATCH_WINDOW, 2, set_batch_window},
+        {REMOTE_DUMP_LOG, 0, dump_log},
+        {REMOTE_RECALIBRATE, 0, recalibrate},
+        {REMOTE_SET_EXCEPTIONS, 0, set_exceptions},
+        {REMOTE_SET_TIME, 4, set_time},
+        {REMOTE_SET_REJOIN_INTERVAL, 2, set_rejoin_interval}
+};
+
+/**
+ * downlink handler of the LORA module, executes the command of the downlink
+ * @param data payload of the downlink
+ * @param length length of the payload
+ */
+static void execute_downlink(const uint8_t *data, int length) {
+    for (unsigned int i = 0; i < sizeof(remote_commands) / sizeof(remote_command); i++) {
+        const remote_command *command = &remote_commands[i];
+        if (command->code == data[0]) {
+            if (length - 1 >= command->min_length && command->execute(&data[1], length - 1)) {
+                create_log(LOG_REMOTE_COMMAND);
+            } else {
+                create_log(LOG_REMOTE_COMMAND_REJECTED);
+            }
+            return;
+        }
+    }
+    create_log(LOG_REMOTE_COMMAND_REJECTED);
+}
+
+/**
+ * loads the settings which were changed remotely and registers the downlink handler of the LORA module
+ */
+void remote_config_init() {
+    if (!load_config_record()) {
+        save_config_record();
+    }
+    apply_config();
+    lora_set_downlink_handler(execute_downlink);
+}
+
+/**
+ * checks if the wheels have to be aligned again. The request is reset by the call
+ * @return true if the wheels have to be aligned again during the next dose, otherwise false
+ */
+bool remote_recalibration_requested() {
+    bool requested = recalibration_requested;
+    recalibration_requested = false;
+    return requested;
+}
@@ -0,0 +1,34 @@
+#ifndef UART_IRQ_REMOTE_CONFIG_H
+#define UART_IRQ_REMOTE_CONFIG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Downlink commands, byte 0 of the downlink is the command code followed by its arguments:
+ * 0x01 set schedule:       one or more dose entries of 3 bytes each: hour, minute, weekday bit mask (bit 0 Sunday)
+ * 0x02 set batch window:   16-bit big endian time in s during which events are collected for one uplink
+ * 0x03 dump log:           sends the entries of the log in the EEPROM via the backlog, encoded as in telemetry.h
+ * 0x04 recalibrate:        the wheels are aligned again at point zero during the next dose
+ * 0x05 set exceptions:     zero or more exceptions of single dates of 6 bytes each: years since 2000, month, day,
+ *                          hour (0xFF for the whole day), minute, action (0 skip the dose, 1 extra dose),
+ *                          the new list replaces all previous exceptions
+ * 0x06 set time:           32-bit big endian date and time in s since 1.1.2000 00:00:00
+ * 0x07 set rejoin interval: 16-bit big endian time in h after which the network is joined again with a new session,
+ *                          0 joins again only after the session was lost
+ */
+enum Remote_Commands {
+    REMOTE_SET_SCHEDULE = 0x01,
+    REMOTE_SET_BATCH_WINDOW = 0x02,
+    REMOTE_DUMP_LOG = 0x03,
+    REMOTE_RECALIBRATE = 0x04,
+    REMOTE_SET_EXCEPTIONS = 0x05,
+    REMOTE_SET_TIME = 0x06,
+    REMOTE_SET_REJOIN_INTERVAL = 0x07
+};
+
+void remote_config_init();
+
+bool remote_recalibration_requested();
+
+#endif //UART_IRQ_REMOTE_CONFIG_H
@@ -0,0 +1,600 @@
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/rtc.h"
+#include "schedule.h"
+#include "eeprom.h"
+#include "power.h"
+#include "logger.h"
+#include "recovery.h"
+
+#define MINUTES_PER_DAY 1440
+#define MINUTES_PER_HOUR 60
+// doses which were missed up to this amount of minutes ago are still dispensed after a restart
+#define CATCH_UP_WINDOW 60
+// return value if the schedule does not contain any valid dose time
+#define NO_SLOT 0xFFFFFFFF
+// last_served of a new clock record, no dose has been served before the time is set for the first time
+#define NEVER_SERVED 0
+// time in minutes between two uplinks which report that the time is unknown, the backend answers them with the time
+#define TIME_REQUEST_INTERVAL 15
+// bit of the mirrored clock which marks a time that has been set, the other bits are the minutes since 1.1.2000
+#define CLOCK_VALID 0x80000000
+
+// structure which is saved to the EEPROM to recover the schedule state after power loss
+typedef struct clockrecord {
+    uint32_t last_served; // minute of the last served (or skipped) dose since 1.1.2000
+    uint32_t clock; // last known time of the RTC in minutes since 1.1.2000
+    uint32_t dose_in_progress; // minute of the dose whose rotation was started but not finished, or NO_SLOT
+} clockrecord;
+
+// eeprom address where the dose table is saved
+uint16_t eeprom_address_schedule = 0x0800;
+// eeprom address where the clock record is saved
+uint16_t eeprom_address_clockrecord = 0x0840;
+// eeprom address where the exceptions of single dates are saved
+uint16_t eeprom_address_exceptions = 0x0900;
+
+// dose table sorted by the time of the day
+dose_entry dose_entries[MAX_DOSE_ENTRIES];
+uint8_t dose_entry_count = 0;
+
+// exceptions of single dates in any order
+dose_exception dose_exceptions[MAX_DOSE_EXCEPTIONS];
+uint8_t dose_exception_count = 0;
+
+clockrecord clock_record = {0, 0, NO_SLOT};
+
+// scheduled minute of the dose which is currently dispensed
+uint32_t pending_slot = 0;
+
+volatile bool alarm_fired = false;
+
+// true if the dose table was changed while waiting for the next dose
+bool schedule_changed = false;
+
+// true after the time of the RTC was set, the RTC only continues at the last saved time after a reset
+bool time_set = false;
+// true if the time was set after the last catch-up check
+bool time_changed = false;
+
+// schedule which is used if no valid dose table is found in the EEPROM
+const dose_entry default_entries[] = {
+        {8, 0, EVERY_DAY},
+        {14, 0, EVERY_DAY},
+        {21, 0, EVERY_DAY}
+};
+
+/**
+ * converts a date and time to the minutes since 1.1.2000 00:00
+ * @param t date and time to convert, the year must be 2000 or later
+ * @return minutes since 1.1.2000
+ */
+static uint32_t datetime_to_minutes(const datetime_t *t) {
+    // days from civil algorithm with the year starting in march
+    uint32_t year = t->year - (t->month <= 2);
+    uint32_t era = year / 400;
+    uint32_t year_of_era = year - era * 400;
+    uint32_t day_of_year = (153 * (t->month > 2 ? t->month - 3 : t->month + 9) + 2) / 5 + t->day - 1;
+    uint32_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    // 730425 days between 1.3.0000 and 1.1.2000
+    uint32_t days = era * 146097 + day_of_era - 730425;
+    return days * MINUTES_PER_DAY + t->hour * MINUTES_PER_HOUR + t->min;
+}
+
+/**
+ * converts minutes since 1.1.2000 00:00 to a date and time including the day of the week
+ * @param minutes minutes since 1.1.2000
+ * @param t pointer where the date and time is written to
+ */
+static void minutes_to_datetime(uint32_t minutes, datetime_t *t) {
+    uint32_t days = minutes / MINUTES_PER_DAY;
+    uint32_t shifted_days = days + 730425;
+    uint32_t era = shifted_days / 146097;
+    uint32_t day_of_era = shifted_days - era * 146097;
+    uint32_t year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    uint32_t day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    uint32_t month_index = (5 * day_of_year + 2) / 153;
+    t->day = day_of_year - (153 * month_index + 2) / 5 + 1;
+    t->month = month_index < 10 ? month_index + 3 : month_index - 9;
+    t->year = year_of_era + era * 400 + (t->month <= 2);
+    // 1.1.2000 was a saturday
+    t->dotw = (days + 6) % 7;
+    t->hour = (minutes % MINUTES_PER_DAY) / MINUTES_PER_HOUR;
+    t->min = minutes % MINUTES_PER_HOUR;
+    t->sec = 0;
+}
+
+/**
+ * returns the current time of the RTC
+ * @return minutes since 1.1.2000
+ */
+static uint32_t current_minutes() {
+    datetime_t now;
+    rtc_get_datetime(&now);
+    return datetime_to_minutes(&now);
+}
+
+/**
+ * returns the time of the day of a dose entry
+ * @param index index of the entry in the dose table
+ * @return minutes since midnight
+ */
+static uint16_t entry_minutes(int index) {
+    return dose_entries[index].hour * MINUTES_PER_HOUR + dose_entries[index].minute;
+}
+
+/**
+ * checks if a dose entry is active on a specific day
+ * @param index index of the entry in the dose table
+ * @param day days since 1.1.2000
+ * @return true if the dose is given on that day, otherwise false
+ */
+static bool entry_active_on(int index, uint32_t day) {
+    return dose_entries[index].weekdays & (1 << ((day + 6) % 7));
+}
+
+/**
+ * returns the time of an exception
+ * @param index index of the exception
+ * @return minutes since 1.1.2000, the start of the date for exceptions of the whole day
+ */
+static uint32_t exception_minutes(int index) {
+    const dose_exception *exception = &dose_exceptions[index];
+    datetime_t date = {(int16_t) (2000 + exception->year), (int8_t) exception->month, (int8_t) exception->day,
+                       0, 0, 0, 0};
+    uint32_t minutes = datetime_to_minutes(&date);
+    if (exception->hour != WHOLE_DAY) {
+        minutes += exception->hour * MINUTES_PER_HOUR + exception->minute;
+    }
+    return minutes;
+}
+
+/**
+ * checks if a dose of the dose table is skipped on its date
+ * @param slot minute of the dose since 1.1.2000
+ * @return true if an exception skips the dose or its whole day, otherwise false
+ */
+static bool slot_skipped(uint32_t slot) {
+    for (int i = 0; i < dose_exception_count; i++) {
+        if (dose_exceptions[i].action != SKIP_DOSE) {
+            continue;
+        }
+        uint32_t minutes = exception_minutes(i);
+        if (minutes == slot || (dose_exceptions[i].hour == WHOLE_DAY &&
+                                minutes / MINUTES_PER_DAY == slot / MINUTES_PER_DAY)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * finds the first scheduled dose after a specific time
+ * the start position in the sorted dose table is found by binary search,
+ * skipped doses and extra doses of single dates are taken from the exceptions
+ * @param after minutes since 1.1.2000
+ * @return minute of the next dose since 1.1.2000 or NO_SLOT if the schedule is empty
+ */
+static uint32_t next_slot(uint32_t after) {
+    uint32_t day = after / MINUTES_PER_DAY;
+    uint16_t time_of_day = after % MINUTES_PER_DAY;
+    int low = 0;
+    int high = dose_entry_count;
+    // search the first entry which is later than the time of the day
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (entry_minutes(middle) <= time_of_day) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    // the same time of the day one week later is the latest possible next dose,
+    // every skipped day can delay it by one more day
+    uint32_t slot = NO_SLOT;
+    for (int d = 0; d <= 7 + MAX_DOSE_EXCEPTIONS && slot == NO_SLOT; d++) {
+        for (int i = (d == 0 ? low : 0); i < dose_entry_count; i++) {
+            uint32_t candidate = (day + d) * MINUTES_PER_DAY + entry_minutes(i);
+            if (entry_active_on(i, day + d) && !slot_skipped(candidate)) {
+                slot = candidate;
+                break;
+            }
+        }
+    }
+    for (int i = 0; i < dose_exception_count; i++) {
+        uint32_t extra = exception_minutes(i);
+        if (dose_exceptions[i].action == EXTRA_DOSE && extra > after && extra < slot) {
+            slot = extra;
+        }
+    }
+    return slot;
+}
+
+/**
+ * finds the last scheduled dose at or before a specific time
+ * the start position in the sorted dose table is found by binary search,
+ * skipped doses and extra doses of single dates are taken from the exceptions
+ * @param before minutes since 1.1.2000
+ * @return minute of the previous dose since 1.1.2000 or NO_SLOT if there is none
+ */
+static uint32_t previous_slot(uint32_t before) {
+    uint32_t day = before / MINUTES_PER_DAY;
+    uint16_t time_of_day = before % MINUTES_PER_DAY;
+    int low = 0;
+    int high = dose_entry_count;
+    // search the first entry which is later than the time of the day
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (entry_minutes(middle) <= time_of_day) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    uint32_t slot = NO_SLOT;
+    for (uint32_t d = 0; d <= 7 + MAX_DOSE_EXCEPTIONS && d <= day && slot == NO_SLOT; d++) {
+        for (int i = (d == 0 ? low : dose_entry_count) - 1; i >= 0; i--) {
+            uint32_t candidate = (day - d) * MINUTES_PER_DAY + entry_minutes(i);
+            if (entry_active_on(i, day - d) && !slot_skipped(candidate)) {
+                slot = candidate;
+                break;
+            }
+        }
+    }
+    for (int i = 0; i < dose_exception_count; i++) {
+        uint32_t extra = exception_minutes(i);
+        if (dose_exceptions[i].action == EXTRA_DOSE && extra <= before && (slot == NO_SLOT || extra > slot)) {
+            slot = extra;
+        }
+    }
+    return slot;
+}
+
+/**
+ * sorts the dose table by the time of the day
+ */
+static void sort_entries() {
+    for (int i = 1; i < dose_entry_count; i++) {
+        dose_entry entry = dose_entries[i];
+        int j = i - 1;
+        while (j >= 0 && entry_minutes(j) > entry.hour * MINUTES_PER_HOUR + entry.minute) {
+            dose_entries[j + 1] = dose_entries[j];
+            j--;
+        }
+        dose_entries[j + 1] = entry;
+    }
+}
+
+/**
+ * method to load the dose table from the EEPROM
+ * @return true if a valid dose table was found, otherwise false
+ */
+static bool load_schedule() {
+    uint8_t data[1 + sizeof(dose_entry) * MAX_DOSE_ENTRIES + 2];
+    read_bytes_from_eeprom(eeprom_address_schedule, data, sizeof(data));
+    uint8_t count = data[0];
+    if (count == 0 || count > MAX_DOSE_ENTRIES || crc16(data, 1 + count * sizeof(dose_entry) + 2) != 0) {
+        return false;
+    }
+    memcpy(dose_entries, &data[1], count * sizeof(dose_entry));
+    dose_entry_count = count;
+    return true;
+}
+
+/**
+ * method to save the dose table to the EEPROM
+ */
+static void save_schedule() {
+    uint8_t data[1 + sizeof(dose_entry) * MAX_DOSE_ENTRIES + 2];
+    int length = 1 + dose_entry_count * sizeof(dose_entry);
+    data[0] = dose_entry_count;
+    memcpy(&data[1], dose_entries, dose_entry_count * sizeof(dose_entry));
+    uint16_t crc = crc16(data, length);
+    data[length] = (uint8_t) (crc >> 8);
+    data[length + 1] = (uint8_t) crc;
+    write_bytes_to_eeprom(eeprom_address_schedule, data, length + 2);
+}
+
+/**
+ * method to load the exceptions of single dates from the EEPROM
+ * @return true if a valid table of exceptions was found, otherwise false
+ */
+static bool load_exceptions() {
+    uint8_t data[1 + sizeof(dose_exception) * MAX_DOSE_EXCEPTIONS + 2];
+    read_bytes_from_eeprom(eeprom_address_exceptions, data, sizeof(data));
+    uint8_t count = data[0];
+    if (count > MAX_DOSE_EXCEPTIONS || crc16(data, 1 + count * sizeof(dose_exception) + 2) != 0) {
+        return false;
+    }
+    memcpy(dose_exceptions, &data[1], count * sizeof(dose_exception));
+    dose_exception_count = count;
+    return true;
+}
+
+/**
+ * method to save the exceptions of single dates to the EEPROM
+ */
+static void save_exceptions() {
+    uint8_t data[1 + sizeof(dose_exception) * MAX_DOSE_EXCEPTIONS + 2];
+    int length = 1 + dose_exception_count * sizeof(dose_exception);
+    data[0] = dose_exception_count;
+    memcpy(&data[1], dose_exceptions, dose_exception_count * sizeof(dose_exception));
+    uint16_t crc = crc16(data, length);
+    data[length] = (uint8_t) (crc >> 8);
+    data[length + 1] = (uint8_t) crc;
+    write_bytes_to_eeprom(eeprom_address_exceptions, data, length + 2);
+}
+
+/**
+ * method to load the clock record from the EEPROM
+ * @return true if the record is valid, otherwise false
+ */
+static bool load_clock_record() {
+    uint8_t data[sizeof(clockrecord) + 2];
+    read_bytes_from_eeprom(eeprom_address_clockrecord, data, sizeof(data));
+    if (crc16(data, sizeof(data)) != 0) {
+        return false;
+    }
+    memcpy(&clock_record, data, sizeof(clockrecord));
+    return true;
+}
+
+/**
+ * method to save the clock record together with the current time of the RTC to the EEPROM
+ */
+static void save_clock_record() {
+    uint8_t data[sizeof(clockrecord) + 2];
+    clock_record.clock = current_minutes();
+    memcpy(data, &clock_record, sizeof(clockrecord));
+    uint16_t crc = crc16(data, sizeof(clockrecord));
+    data[sizeof(clockrecord)] = (uint8_t) (crc >> 8);
+    data[sizeof(clockrecord) + 1] = (uint8_t) crc;
+    write_bytes_to_eeprom(eeprom_address_clockrecord, data, sizeof(data));
+}
+
+/**
+ * Interrupt handler. Triggered when the RTC alarm is reached
+ */
+static void rtc_alarm_handler() {
+    alarm_fired = true;
+}
+
+/**
+ * returns the time of the RTC for the scratch registers of the watchdog
+ * @return minutes since 1.1.2000 together with CLOCK_VALID, 0 as long as the time has not been set
+ */
+static uint32_t mirror_clock() {
+    return time_set ? current_minutes() | CLOCK_VALID : 0;
+}
+
+/**
+ * initializes the RTC and loads the dose table and the last known time from the EEPROM.
+ * After power loss the RTC continues at the last saved time, but no dose is checked until the time is set again.
+ * After a watchdog reset the RTC continues at the mirrored time, which is still valid
+ */
+void schedule_init() {
+    datetime_t time = {2024, 1, 1, 1, 0, 0, 0};
+
+    rtc_init();
+    if (!load_schedule()) {
+        schedule_set_entries(default_entries, sizeof(default_entries) / sizeof(dose_entry));
+    }
+    if (!load_exceptions()) {
+        dose_exception_count = 0;
+    }
+    if (load_clock_record()) {
+        minutes_to_datetime(clock_record.clock, &time);
+    } else {
+        clock_record.last_served = NEVER_SERVED;
+        clock_record.dose_in_progress = NO_SLOT;
+    }
+    uint32_t mirrored;
+    if (recovery_load(RECOVERY_CLOCK_SLOT, &mirrored) && (mirrored & CLOCK_VALID)) {
+        minutes_to_datetime(mirrored & ~CLOCK_VALID, &time);
+        time_set = true;
+    }
+    rtc_set_datetime(&time);
+    // the RTC needs a few cycles of its clock until the new time can be read back
+    sleep_us(64);
+    save_clock_record();
+    recovery_set_clock(mirror_clock);
+}
+
+/**
+ * replaces the dose table and saves it to the EEPROM
+ * @param entries dose times, the order does not matter
+ * @param count amount of dose times
+ * @return true if the table was accepted, false if the amount of entries is not valid
+ */
+bool schedule_set_entries(const dose_entry *entries, uint8_t count) {
+    if (count == 0 || count > MAX_DOSE_ENTRIES) {
+        return false;
+    }
+    memcpy(dose_entries, entries, count * sizeof(dose_entry));
+    dose_entry_count = count;
+    sort_entries();
+    save_schedule();
+    // a running wait for the next dose is woken up to calculate the next dose with the new table
+    schedule_changed = true;
+    alarm_fired = true;
+    return true;
+}
+
+/**
+ * replaces the exceptions of single dates and saves them to the EEPROM
+ * @param exceptions skipped and extra doses, the order does not matter
+ * @param count amount of exceptions, 0 removes all exceptions
+ * @return true if the exceptions were accepted, false if there are too many
+ */
+bool schedule_set_exceptions(const dose_exception *exceptions, uint8_t count) {
+    if (count > MAX_DOSE_EXCEPTIONS) {
+        return false;
+    }
+    memcpy(dose_exceptions, exceptions, count * sizeof(dose_exception));
+    dose_exception_count = count;
+    save_exceptions();
+    // a running wait for the next dose is woken up to calculate the next dose with the exceptions
+    schedule_changed = true;
+    alarm_fired = true;
+    return true;
+}
+
+/**
+ * sets the time of the RTC, the day of the week is calculated from the date.
+ * The first dose after the first time setting is the next scheduled one, and if the clock is set back,
+ * the doses until the last served one are not skipped. A running wait for the next dose is woken up,
+ * so that the doses which were missed with the old time are checked again
+ * @param time new date and time, the year must be 2000 or later
+ */
+void schedule_set_time(datetime_t *time) {
+    datetime_t valid_time;
+    uint32_t minutes = datetime_to_minutes(time);
+    minutes_to_datetime(minutes, &valid_time);
+    valid_time.sec = time->sec;
+    rtc_set_datetime(&valid_time);
+    sleep_us(64);
+    if (clock_record.last_served == NEVER_SERVED || clock_record.last_served > minutes) {
+        clock_record.last_served = minutes;
+    }
+    save_clock_record();
+    time_set = true;
+    time_changed = true;
+    alarm_fired = true;
+    create_log(LOG_TIME_SET);
+}
+
+/**
+ * sets the date and time of the RTC like schedule_set_time
+ * @param seconds new date and time in s since 1.1.2000 00:00:00
+ */
+void schedule_set_time_seconds(uint32_t seconds) {
+    datetime_t time;
+    minutes_to_datetime(seconds / 60, &time);
+    time.sec = seconds % 60;
+    schedule_set_time(&time);
+}
+
+/**
+ * checks if the time of the RTC has been set since the reset
+ * @return true if the time is valid, otherwise false
+ */
+bool schedule_time_valid() {
+    return time_set;
+}
+
+/**
+ * waits in deep sleep until the time is set, on the console or by downlink. The console and the LORA module are
+ * handled by the idle task of the power manager, which wakes up for them.
+ * Every TIME_REQUEST_INTERVAL an event reports that dosing is paused. The backend answers it with the time,
+ * which is received as downlink after the next uplink
+ */
+void schedule_wait_for_time() {
+    datetime_t alarm;
+    while (!time_set) {
+        create_log(LOG_TIME_UNKNOWN);
+        // the RTC continues at the last saved time, so that it still measures the interval
+        minutes_to_datetime(current_minutes() + TIME_REQUEST_INTERVAL, &alarm);
+        alarm.dotw = -1;
+        alarm_fired = false;
+        rtc_set_alarm(&alarm, rtc_alarm_handler);
+        power_deep_sleep_until(&alarm_fired);
+    }
+}
+
+/**
+ * checks after a restart or a change of the time if the last scheduled dose has been missed.
+ * A dose within the catch-up window is marked as due, older doses are skipped.
+ * Without a valid time no dose is checked, because the RTC might be far behind after power loss
+ * @return the result of the check as defined in enum catch up results
+ */
+enum Catch_Up_Results schedule_catch_up() {
+    if (!time_set) {
+        return TIME_NOT_SET;
+    }
+    time_changed = false;
+    uint32_t now = current_minutes();
+    uint32_t slot = previous_slot(now);
+
+    if (slot == NO_SLOT || slot <= clock_record.last_served) {
+        return NO_DOSE_MISSED;
+    }
+    pending_slot = slot;
+    if (now - slot <= CATCH_UP_WINDOW) {
+        return DOSE_DUE;
+    }
+    schedule_mark_served();
+    return DOSE_SKIPPED;
+}
+
+/**
+ * waits in deep sleep until the next scheduled dose is due.
+ * The current time is saved to the EEPROM every full hour, so that the clock can be restored after power loss.
+ * Without any valid dose time the wait only ends when the time is set
+ * @return true if the dose is due, false if the time was set and the missed doses have to be checked again
+ */
+bool schedule_wait_for_next_dose() {
+    uint32_t now = current_minutes();
+    uint32_t after = clock_record.last_served > now - 1 ? clock_record.last_served : now - 1;
+    uint32_t slot = next_slot(after);
+
+    schedule_changed = false;
+    while (!time_changed && now < slot) {
+        uint32_t next_hour = (now / MINUTES_PER_HOUR + 1) * MINUTES_PER_HOUR;
+        uint32_t wakeup = slot < next_hour ? slot : next_hour;
+        datetime_t alarm;
+        minutes_to_datetime(wakeup, &alarm);
+        // day of the week is not part of the alarm comparison
+        alarm.dotw = -1;
+        alarm_fired = false;
+        rtc_set_alarm(&alarm, rtc_alarm_handler);
+        power_deep_sleep_until(&alarm_fired);
+        if (time_changed) {
+            break;
+        }
+        now = current_minutes();
+        if (schedule_changed) {
+            // dose table was changed remotely, doses of the new table before the change are not dispensed
+            schedule_changed = false;
+            after = now;
+            slot = next_slot(after);
+        }
+        if (now < slot) {
+            save_clock_record();
+        }
+    }
+    if (time_changed) {
+        return false;
+    }
+    pending_slot = slot;
+    return true;
+}
+
+/**
+ * marks the pending dose as in progress before the wheels start turning. If the power is lost during the rotation,
+ * the recovery finishes the rotation and the dose is marked as served by schedule_resume_dose
+ */
+void schedule_start_dose() {
+    clock_record.dose_in_progress = pending_slot;
+    save_clock_record();
+}
+
+/**
+ * marks the dose which was in progress at the reset as served, after the recovery has finished the interrupted
+ * rotation of the wheels. Otherwise the catch-up would dispense the same dose a second time
+ */
+void schedule_resume_dose() {
+    if (clock_record.dose_in_progress != NO_SLOT) {
+        pending_slot = clock_record.dose_in_progress;
+        schedule_mark_served();
+    }
+}
+
+/**
+ * marks the pending dose as served, so that it will not be dispensed again after a restart
+ */
+void schedule_mark_served() {
+    clock_record.last_served = pending_slot;
+    clock_record.dose_in_progress = NO_SLOT;
+    save_clock_record();
+}
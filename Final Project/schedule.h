@@ -0,0 +1,72 @@
+#ifndef UART_IRQ_SCHEDULE_H
+#define UART_IRQ_SCHEDULE_H
+
+#include "pico/util/datetime.h"
+
+// maximum amount of dose times which fit into the schedule table in the EEPROM
+#define MAX_DOSE_ENTRIES 16
+
+// maximum amount of exceptions of single dates which fit into the EEPROM
+#define MAX_DOSE_EXCEPTIONS 8
+
+// weekday bits of a dose entry, bit 0 is Sunday like the dotw field of the RTC
+#define EVERY_DAY 0x7F
+// hour of an exception which skips all doses of the date
+#define WHOLE_DAY 0xFF
+
+// results of the catch-up check after a restart
+enum Catch_Up_Results {
+    NO_DOSE_MISSED, // every scheduled dose up to now has been served
+    DOSE_DUE, // a dose was missed recently and should be dispensed immediately
+    DOSE_SKIPPED, // a dose was missed too long ago and has been skipped
+    TIME_NOT_SET // the time of the RTC is unknown since the reset, no dose can be checked
+};
+
+// changes of the dose table on a single date
+enum Exception_Actions {
+    SKIP_DOSE = 0, // the dose of the dose table at this time, or all doses of the date, are not given
+    EXTRA_DOSE = 1 // a dose is given at this time in addition to the dose table
+};
+
+// one scheduled dose time of the day
+typedef struct dose_entry {
+    uint8_t hour;
+    uint8_t minute;
+    uint8_t weekdays; // bit mask of the days on which the dose is given, bit 0 is Sunday
+} dose_entry;
+
+// exception of the dose table on a single date, e.g. to skip a day or to replace its doses by other times
+typedef struct dose_exception {
+    uint8_t year; // years since 2000
+    uint8_t month;
+    uint8_t day;
+    uint8_t hour; // WHOLE_DAY to skip all doses of the date
+    uint8_t minute;
+    uint8_t action; // action as defined in enum Exception_Actions
+} dose_exception;
+
+void schedule_init();
+
+bool schedule_set_entries(const dose_entry *entries, uint8_t count);
+
+bool schedule_set_exceptions(const dose_exception *exceptions, uint8_t count);
+
+void schedule_set_time(datetime_t *time);
+
+void schedule_set_time_seconds(uint32_t seconds);
+
+bool schedule_time_valid();
+
+void schedule_wait_for_time();
+
+enum Catch_Up_Results schedule_catch_up();
+
+bool schedule_wait_for_next_dose();
+
+void schedule_start_dose();
+
+void schedule_resume_dose();
+
+void schedule_mark_served();
+
+#endif //UART_IRQ_SCHEDULE_H
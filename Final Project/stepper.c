@@ -1,349 +1,648 @@
-#include "hardware/i2c.h"
-#include "pico/stdlib.h"
-#include <stdio.h>
-#include "stepper.h"
-#include "eeprom.h"
-#include "logger.h"
-
-#define OPTO_SENSOR 28
-
-#define MOTOR_CONTR_A 2
-#define MOTOR_CONTR_B 3
-#define MOTOR_CONTR_C 6
-#define MOTOR_CONTR_D 13
-
-// stages for calibrate the stepper motor after the start
-enum Calibration_Stages {
-    WAY_TO_START, CALCULATE_SENSOR_WIDTH, CALCULATE_NON_SENSOR_WIDTH, WAY_TO_ZERO, CALIBRATION_FINISHED
-};
-enum Calibration_Stages calibration_stage;
-
-// stages which describe the current state of the stepper
-enum Stepper_Stages {
-    INITIAL = 0, // initial state of the motor before successful calibration
-    RECALIBRATING = 1, // stepper motor is currently recalibrating
-    NORMAL_OPERATION = 2, // normal, calibrated operation mode
-    TURNING = 3 // stepper motor is currently turning by one compartment
-};
-enum Stepper_Stages stepper_stage;
-
-// structure to describe the current state of stepper motor
-typedef struct stepperstate {
-    uint8_t stepper_stage; // describes the stage as defined in enum stepper stages
-    uint8_t current_compartment; // describes the actual compartment position in relation to the point zero
-} stepperstate;
-
-// structure with the calibrated data of the stepper motor
-typedef struct stepperdata {
-    uint16_t revolution_steps; // steps needed for one total revolution
-    uint16_t sensor_width; // amount of steps within the opto sensor detection
-} stepperdata;
-
-stepperdata stepper_data = {4096, 0};
-stepperstate stepper_state = {0, 0};
-
-// current step in driver sequence
-uint8_t current_step = 0;
-
-// eeprom address where the stepper state structure is saved
-uint16_t eeprom_address_stepperstate = 0x7FFE;
-// eeprom address where the stepper data structure is saved
-uint16_t eeprom_address_stepperdata = 0x7FFA;
-
-// driver sequence to set the motor controllers for a rotation of the motor
-int seq_table[8][4] = {
-        {1, 0, 0, 0},
-        {1, 1, 0, 0},
-        {0, 1, 0, 0},
-        {0, 1, 1, 0},
-        {0, 0, 1, 0},
-        {0, 0, 1, 1},
-        {0, 0, 0, 1},
-        {1, 0, 0, 1}
-};
-
-void set_motor_controllers(int sleep_timer);
-bool recalibration();
-void calibration();
-void load_stepper_data();
-void save_stepper_data();
-void load_stepper_state();
-void save_stepper_state();
-void run(int compartments);
-
-/**
- * method to load the stepper data structure from the EEPROM
- */
-void load_stepper_data() {
-    uint8_t divided_data[4];
-    read_bytes_from_eeprom(eeprom_address_stepperdata, divided_data, sizeof(divided_data));
-    stepper_data.revolution_steps = (divided_data[0] << 8) | divided_data[1];
-    stepper_data.sensor_width = (divided_data[2] << 8) | divided_data[3];
-}
-
-/**
- * method to save the stepper data structure to the EEPROM
- */
-void save_stepper_data() {
-    uint8_t divided_data[4];
-    divided_data[0] = (stepper_data.revolution_steps >> 8);
-    divided_data[1] = (stepper_data.revolution_steps & 0xFF);
-    divided_data[2] = (stepper_data.sensor_width >> 8);
-    divided_data[3] = (stepper_data.sensor_width & 0xFF);
-    write_bytes_to_eeprom(eeprom_address_stepperdata, divided_data, sizeof(divided_data));
-}
-
-/**
- * method to load the stepper state structure from the EEPROM
- */
-void load_stepper_state() {
-    read_bytes_from_eeprom(eeprom_address_stepperstate, (uint8_t *) &stepper_state, sizeof(stepper_state));
-}
-
-/**
- * method to save the stepper state structure to the EEPROM
- */
-void save_stepper_state() {
-    write_bytes_to_eeprom(eeprom_address_stepperstate, (uint8_t *) &stepper_state, sizeof(stepper_state));
-}
-
-/**
- * returns the current compartment position of the stepper motor in relation to "point zero"
- * @return the current compartment
- */
-uint8_t get_current_compartment() {
-    return stepper_state.current_compartment;
-}
-
-/**
- * initializes the stepper data after booting by loading the data from the EEPROM
- * @return true if the current stepper state is not INITIAL, otherwise false
- */
-bool initialize_stepper_data() {
-    load_stepper_data();
-    load_stepper_state();
-
-    return (stepper_state.stepper_stage != INITIAL);
-}
-
-/**
- * initializes and (re-) calibrates the stepper based on possible interruptions during the last operation
- * @return true if the dispenser has not become empty after recalibration and has not reached "point zero" again, otherwise false
- */
-bool initialize_stepper() {
-    bool dispenser_not_empty = true;
-
-    if (stepper_state.stepper_stage == RECALIBRATING || stepper_state.stepper_stage == TURNING) {
-        dispenser_not_empty = recalibration();
-        sleep_ms(2000);
-    } else if (stepper_state.stepper_stage == NORMAL_OPERATION) {
-        // stepper was interrupted during normal operation, now continues at the stopped point
-        sleep_ms(500);
-    } else {
-        // default case: corrupted data or start of program leads to the calibration of the motor
-        calibration();
-    }
-
-    return dispenser_not_empty;
-}
-
-/**
- * method to recalibrate the stepper motor after power off during middle of a turn
- * @return true if stepper motor did not reach point zero while recalibrating otherwise false
- */
-bool recalibration() {
-    stepper_state.stepper_stage = RECALIBRATING;
-    save_stepper_state();
-    create_log("Recalibration started");
-
-    bool edge_detected = false;
-    int last_sensor_value = gpio_get(OPTO_SENSOR);
-    // motor is turned backwards until the opto sensor is triggered
-    while (!edge_detected) {
-        set_motor_controllers(2);
-        if (gpio_get(OPTO_SENSOR) == 0 && last_sensor_value == 1) {
-            edge_detected = true;
-        }
-        last_sensor_value = gpio_get(OPTO_SENSOR);
-        if (current_step == 0) {
-            current_step = 7;
-        } else {
-            current_step--;
-        }
-    }
-    // motor continues moving backward until middle of the opto sensor (point zero) is reached
-    for (int i = 0; i < (stepper_data.sensor_width / 2); i++) {
-        set_motor_controllers(3);
-        if (current_step == 0) {
-            current_step = 7;
-        } else {
-            current_step--;
-        }
-    }
-    uint8_t new_compartment = stepper_state.current_compartment + 1;
-    // stepper motor moves forward until next intact compartment
-    run(stepper_state.current_compartment + 1);
-    // check if point zero was reached again and all pills have been dispensed
-    if (new_compartment <= 7) {
-        stepper_state.current_compartment = new_compartment;
-        stepper_state.stepper_stage = NORMAL_OPERATION;
-        save_stepper_state();
-        return true;
-    } else {
-        // all pills have been dispensed
-        stepper_state.current_compartment = 0;
-        stepper_state.stepper_stage = INITIAL;
-        save_stepper_state();
-        return false;
-    }
-}
-
-/**
- * function for calibration after program started with no interrupts detected
- */
-void calibration() {
-    create_log("Calibration started");
-    int step_counter;
-    stepper_data.sensor_width = 0;
-    int last_sensor_value = gpio_get(OPTO_SENSOR);
-    bool edge_detected = false;
-    calibration_stage = WAY_TO_START;
-    int sensor_width_values[2] = {0, 0};
-    int revolution_steps_values[2] = {0, 0};
-    int round = 0;
-    while (calibration_stage != CALIBRATION_FINISHED) {
-        switch (calibration_stage) {
-            case WAY_TO_START:
-                // move forward until beginning of the opto sensor detection
-                edge_detected = false;
-                while (!edge_detected) {
-                    set_motor_controllers(2);
-                    if (gpio_get(OPTO_SENSOR) == 0 && last_sensor_value == 1) {
-                        edge_detected = true;
-                    }
-                    last_sensor_value = gpio_get(OPTO_SENSOR);
-                    if (current_step == 7) {
-                        current_step = 0;
-                    } else {
-                        current_step++;
-                    }
-                }
-                calibration_stage = CALCULATE_SENSOR_WIDTH;
-                break;
-            case CALCULATE_SENSOR_WIDTH:
-                // calculate the steps during opto sensor detection
-                edge_detected = false;
-                while (!edge_detected) {
-                    set_motor_controllers(3);
-                    if (gpio_get(OPTO_SENSOR) == 1 && last_sensor_value == 0) {
-                        edge_detected = true;
-                    }
-                    last_sensor_value = gpio_get(OPTO_SENSOR);
-                    sensor_width_values[round]++;
-                    if (current_step == 7) {
-                        current_step = 0;
-                    } else {
-                        current_step++;
-                    }
-                }
-                calibration_stage = CALCULATE_NON_SENSOR_WIDTH;
-                break;
-            case CALCULATE_NON_SENSOR_WIDTH:
-                // calculate all the steps outside the opto sensor detection
-                step_counter = 0;
-                edge_detected = false;
-                while (!edge_detected) {
-                    set_motor_controllers(3);
-                    if (gpio_get(OPTO_SENSOR) == 0 && last_sensor_value == 1) {
-                        edge_detected = true;
-                    }
-                    last_sensor_value = gpio_get(OPTO_SENSOR);
-                    step_counter++;
-                    if (current_step == 7) {
-                        current_step = 0;
-                    } else {
-                        current_step++;
-                    }
-                }
-                revolution_steps_values[round] = step_counter + sensor_width_values[round];;
-                if (round < 1) {
-                    // second calibration round for better accuracy
-                    round++;
-                    calibration_stage = CALCULATE_SENSOR_WIDTH;
-                } else {
-                    calibration_stage = WAY_TO_ZERO;
-                }
-                break;
-            case WAY_TO_ZERO:
-                // use average of both measurement rounds as calibration data
-                stepper_data.revolution_steps = (revolution_steps_values[0] + revolution_steps_values[1]) / 2;
-                stepper_data.sensor_width = (sensor_width_values[0] + sensor_width_values[1]) / 2;
-                printf("Calculated revolution steps: %d\n", stepper_data.revolution_steps);
-                // move forward until "point zero" where to start the normal operation
-                for (int i = 0; i < (stepper_data.sensor_width / 2); i++) {
-                    set_motor_controllers(3);
-                    if (current_step == 7) {
-                        current_step = 0;
-                    } else {
-                        current_step++;
-                    }
-                }
-                calibration_stage = CALIBRATION_FINISHED;
-                save_stepper_data();
-                stepper_state.stepper_stage = NORMAL_OPERATION;
-                stepper_state.current_compartment = 0;
-                save_stepper_state();
-                break;
-        }
-    }
-}
-
-/**
- * method to set all controllers of the motor with the specified values from the current step of the driver sequence
- * @param sleep_timer time in ms to wait after this, controls the speed
- */
-void set_motor_controllers(int sleep_timer) {
-    gpio_put(MOTOR_CONTR_A, seq_table[current_step][0]);
-    gpio_put(MOTOR_CONTR_B, seq_table[current_step][1]);
-    gpio_put(MOTOR_CONTR_C, seq_table[current_step][2]);
-    gpio_put(MOTOR_CONTR_D, seq_table[current_step][3]);
-    sleep_ms(sleep_timer);
-}
-
-/**
- * move the stepper motor by n compartments forward
- * @param compartments amount of compartments to move forward
- */
-void run(int compartments) {
-    int calculated_steps = (int) (compartments * ((double) stepper_data.revolution_steps / 8));
-    for (int i = 0; i < calculated_steps; i++) {
-        set_motor_controllers(2);
-        if (current_step == 7) {
-            current_step = 0;
-        } else {
-            current_step++;
-        }
-    }
-}
-
-/**
- * to rotate the stepper motor by one compartment,
- * whereby the state structure of the stepper motor is changed according to this action
- */
-void rotate_by_one_compartment() {
-    stepper_state.stepper_stage = TURNING;
-    save_stepper_state();
-    run(1);
-    stepper_state.current_compartment++;
-    stepper_state.stepper_stage = NORMAL_OPERATION;
-    save_stepper_state();
-}
-
-/**
- * reset the state of the motor to the initial state with no calibration data
- */
-void reset_stepper() {
-    stepper_state.current_compartment = 0;
-    stepper_state.stepper_stage = INITIAL;
-    save_stepper_state();
-}
\ No newline at end of file
+#include "hardware/i2c.h"
+#include "pico/stdlib.h"
+#include <stdio.h>
+#include "stepper.h"
+#include "eeprom.h"
+#include "logger.h"
+#include "recovery.h"
+#include "profile.h"
+
+// time in ms between two ticks of the step scheduler
+#define SCHEDULER_TICK 1
+// size of one record slot of a stepper motor in the EEPROM, slots are placed downwards from the end of the EEPROM
+#define EEPROM_SLOT_SIZE 8
+// maximum amount of steps while searching an edge of the opto sensor, two revolutions of the wheel
+#define EDGE_SEARCH_LIMIT 8192
+// time in us which a part of a motion may take longer than its steps, before the motor is considered stuck
+#define RUN_MARGIN 500000
+
+// directions of a motion
+#define FORWARD 1
+#define BACKWARD (-1)
+// value of the opto sensor after the edge which ends a search, the sensor is low while it detects the wheel
+#define FALLING_EDGE 0
+#define RISING_EDGE 1
+#define NO_EDGE (-1)
+
+// stages of the calibration and the recalibration, the next stage is started by the step scheduler
+enum Calibration_Stages {
+    WAY_TO_START, CALCULATE_SENSOR_WIDTH, CALCULATE_NON_SENSOR_WIDTH, WAY_TO_ZERO, // calibration
+    WAY_BACK_TO_SENSOR, WAY_BACK_TO_ZERO, WAY_TO_COMPARTMENT, // recalibration
+    CALIBRATION_FINISHED, // also the stage of a motion which has only one part
+    CALIBRATION_FAILED // the opto sensor was not found
+};
+
+// stages which describe the current state of the stepper
+enum Stepper_Stages {
+    INITIAL = 0, // initial state of the motor before successful calibration
+    RECALIBRATING = 1, // stepper motor is currently recalibrating
+    NORMAL_OPERATION = 2, // normal, calibrated operation mode
+    TURNING = 3 // stepper motor is currently turning by one compartment
+};
+
+// all stepper motors which are driven by the step scheduler
+stepper_t *steppers[STEPPER_MAX_INSTANCES];
+int stepper_count = 0;
+
+repeating_timer_t scheduler_timer;
+// the scheduler timer only runs while a stepper motor is moving, so that it does not prevent sleeping
+bool scheduler_running = false;
+
+void start_recalibration(stepper_t *stepper);
+bool finish_recalibration(stepper_t *stepper);
+void start_calibration(stepper_t *stepper);
+bool finish_calibration(stepper_t *stepper);
+void load_stepper_data(stepper_t *stepper);
+void save_stepper_data(stepper_t *stepper);
+void load_stepper_state(stepper_t *stepper);
+void save_stepper_state(stepper_t *stepper);
+void write_motor_controllers(stepper_t *stepper);
+void start_motion(stepper_t *stepper, enum Calibration_Stages stage, int direction, int steps, int stop_edge,
+                  int interval);
+void start_steps(stepper_t *stepper, int steps, int steps_done);
+void wait_for_run(stepper_t *stepper);
+static void next_motion(stepper_t *stepper, bool completed);
+void mirror_stepper(stepper_t *stepper);
+bool scheduler_tick(repeating_timer_t *timer);
+
+/**
+ * initializes a stepper motor with its pins and registers it at the step scheduler
+ * @param stepper stepper motor to initialize
+ * @param pins pins of the opto sensor and the motor controllers of this dispenser wheel
+ * @param wheel index of the dispenser wheel on the board, also the number of the record slot in the EEPROM
+ */
+void stepper_init(stepper_t *stepper, const stepperpins *pins, uint8_t wheel) {
+    stepper->pins = *pins;
+    stepper->stepper_data = (stepperdata) {4096, 0};
+    stepper->stepper_state = (stepperstate) {0, 0};
+    stepper->current_step = 0;
+    stepper->wheel = wheel;
+    stepper->eeprom_address_stepperdata = 0x7FFA - wheel * EEPROM_SLOT_SIZE;
+    stepper->eeprom_address_stepperstate = 0x7FFE - wheel * EEPROM_SLOT_SIZE;
+    stepper->steps_remaining = 0;
+    stepper->motion_steps = 0;
+    stepper->motion_part = 0;
+    stepper->calibration_stage = CALIBRATION_FINISHED;
+
+    // Initialize opto sensor pin
+    gpio_init(pins->opto_sensor);
+    gpio_set_dir(pins->opto_sensor, GPIO_IN);
+    gpio_pull_up(pins->opto_sensor);
+
+    // Initialize motor controller pins
+    for (int i = 0; i < 4; i++) {
+        gpio_init(pins->motor_controllers[i]);
+        gpio_set_dir(pins->motor_controllers[i], GPIO_OUT);
+    }
+
+    if (stepper_count < STEPPER_MAX_INSTANCES) {
+        steppers[stepper_count] = stepper;
+        stepper_count++;
+    }
+}
+
+/**
+ * method to load the stepper data structure from the EEPROM
+ */
+void load_stepper_data(stepper_t *stepper) {
+    uint8_t divided_data[4];
+    read_bytes_from_eeprom(stepper->eeprom_address_stepperdata, divided_data, sizeof(divided_data));
+    stepper->stepper_data.revolution_steps = (divided_data[0] << 8) | divided_data[1];
+    stepper->stepper_data.sensor_width = (divided_data[2] << 8) | divided_data[3];
+}
+
+/**
+ * method to save the stepper data structure to the EEPROM
+ */
+void save_stepper_data(stepper_t *stepper) {
+    uint8_t divided_data[4];
+    divided_data[0] = (stepper->stepper_data.revolution_steps >> 8);
+    divided_data[1] = (stepper->stepper_data.revolution_steps & 0xFF);
+    divided_data[2] = (stepper->stepper_data.sensor_width >> 8);
+    divided_data[3] = (stepper->stepper_data.sensor_width & 0xFF);
+    write_bytes_to_eeprom(stepper->eeprom_address_stepperdata, divided_data, sizeof(divided_data));
+}
+
+/**
+ * method to load the stepper state structure from the EEPROM
+ */
+void load_stepper_state(stepper_t *stepper) {
+    read_bytes_from_eeprom(stepper->eeprom_address_stepperstate, (uint8_t *) &stepper->stepper_state, sizeof(stepper->stepper_state));
+}
+
+/**
+ * method to save the stepper state structure to the EEPROM
+ */
+void save_stepper_state(stepper_t *stepper) {
+    mirror_stepper(stepper);
+    write_bytes_to_eeprom(stepper->eeprom_address_stepperstate, (uint8_t *) &stepper->stepper_state, sizeof(stepper->stepper_state));
+}
+
+/**
+ * mirrors the exact position and the state of the stepper motor to the scratch registers of the watchdog,
+ * so that the motor does not need to be recalibrated after a watchdog reset
+ * @param stepper stepper motor to mirror
+ */
+void mirror_stepper(stepper_t *stepper) {
+    uint32_t value = stepper->current_step |
+                     (stepper->stepper_state.current_compartment << 3) |
+                     (stepper->stepper_state.stepper_stage << 7) |
+                     ((uint32_t) (stepper->motion_steps - stepper->steps_remaining) << 9);
+    recovery_save(stepper->wheel, value);
+}
+
+/**
+ * returns the current compartment position of the stepper motor in relation to "point zero"
+ * @return the current compartment
+ */
+uint8_t get_current_compartment(stepper_t *stepper) {
+    return stepper->stepper_state.current_compartment;
+}
+
+/**
+ * initializes the stepper data after booting by loading the data from the EEPROM
+ * @return true if the current stepper state is not INITIAL, otherwise false
+ */
+bool initialize_stepper_data(stepper_t *stepper) {
+    load_stepper_data(stepper);
+    load_stepper_state(stepper);
+    mirror_stepper(stepper);
+
+    return (stepper->stepper_state.stepper_stage != INITIAL);
+}
+
+/**
+ * restores the state of the stepper motor from the scratch registers of the watchdog after a watchdog reset.
+ * An interrupted rotation is finished without recalibration because the exact position is known
+ * @return true if the state was restored, false if the stepper has to be initialized from the EEPROM
+ */
+bool resume_stepper(stepper_t *stepper) {
+    uint32_t value;
+    if (!recovery_load(stepper->wheel, &value)) {
+        return false;
+    }
+    uint8_t stage = (value >> 7) & 0x3;
+    if (stage == RECALIBRATING) {
+        // position during the recalibration is not known
+        return false;
+    }
+    load_stepper_data(stepper);
+    stepper->current_step = value & 0x7;
+    stepper->stepper_state.current_compartment = (value >> 3) & 0xF;
+    stepper->stepper_state.stepper_stage = stage;
+    if (stage == TURNING) {
+        // continue with the steps of the compartment which have not been done before the reset
+        int steps = (int) ((double) stepper->stepper_data.revolution_steps / COMPARTMENTS);
+        int steps_done = value >> 9;
+        start_steps(stepper, steps, steps_done < steps ? steps_done : steps);
+        finish_rotation_by_one_compartment(stepper);
+    } else {
+        save_stepper_state(stepper);
+    }
+    return true;
+}
+
+/**
+ * checks if the stepper motor is calibrated and ready to dispense
+ * @return true if the stepper is in normal operation, otherwise false
+ */
+bool stepper_ready(stepper_t *stepper) {
+    return stepper->stepper_state.stepper_stage == NORMAL_OPERATION;
+}
+
+/**
+ * starts the (re-) initialization and (re-) calibration of the stepper based on possible interruptions during the
+ * last operation and returns immediately, so that the motions of several dispenser wheels are interleaved
+ * by the step scheduler
+ * @param stepper stepper motor to initialize
+ */
+void start_initialize_stepper(stepper_t *stepper) {
+    if (stepper->stepper_state.stepper_stage == RECALIBRATING || stepper->stepper_state.stepper_stage == TURNING) {
+        start_recalibration(stepper);
+    } else if (stepper->stepper_state.stepper_stage != NORMAL_OPERATION) {
+        // default case: corrupted data or start of program leads to the calibration of the motor
+        start_calibration(stepper);
+    }
+}
+
+/**
+ * waits until the (re-) initialization of the stepper is finished and saves its result
+ * @param stepper stepper motor which was started by start_initialize_stepper
+ * @return true if the dispenser has not become empty after recalibration and has not reached "point zero" again, otherwise false
+ */
+bool finish_initialize_stepper(stepper_t *stepper) {
+    bool dispenser_not_empty = true;
+
+    if (stepper->stepper_state.stepper_stage == RECALIBRATING) {
+        dispenser_not_empty = finish_recalibration(stepper);
+        sleep_ms(2000);
+    } else if (stepper->stepper_state.stepper_stage == NORMAL_OPERATION) {
+        // stepper was interrupted during normal operation, now continues at the stopped point
+        sleep_ms(500);
+    } else {
+        dispenser_not_empty = finish_calibration(stepper);
+    }
+
+    return dispenser_not_empty;
+}
+
+/**
+ * initializes and (re-) calibrates the stepper based on possible interruptions during the last operation
+ * @return true if the dispenser has not become empty after recalibration and has not reached "point zero" again, otherwise false
+ */
+bool initialize_stepper(stepper_t *stepper) {
+    start_initialize_stepper(stepper);
+    return finish_initialize_stepper(stepper);
+}
+
+/**
+ * method to start the recalibration of the stepper motor after power off during middle of a turn.
+ * The motor turns backwards to point zero and then forward to the next compartment
+ */
+void start_recalibration(stepper_t *stepper) {
+    stepper->stepper_state.stepper_stage = RECALIBRATING;
+    save_stepper_state(stepper);
+    create_wheel_log(LOG_RECALIBRATION_STARTED, stepper->wheel);
+
+    // motor is turned backwards until the opto sensor is triggered
+    start_motion(stepper, WAY_BACK_TO_SENSOR, BACKWARD, EDGE_SEARCH_LIMIT, FALLING_EDGE, 2);
+}
+
+/**
+ * method to wait until the recalibration has finished and to save the new state of the stepper motor
+ * @return true if stepper motor did not reach point zero while recalibrating otherwise false
+ */
+bool finish_recalibration(stepper_t *stepper) {
+    wait_for_run(stepper);
+    if (stepper->calibration_stage == CALIBRATION_FAILED) {
+        // position is unknown, the wheel is calibrated again at the next start
+        printf("Wheel %d: opto sensor not found\n", stepper->wheel);
+        return false;
+    }
+    uint8_t new_compartment = stepper->stepper_state.current_compartment + 1;
+    // check if point zero was reached again and all pills have been dispensed
+    if (new_compartment <= DOSES_PER_FILL) {
+        stepper->stepper_state.current_compartment = new_compartment;
+        stepper->stepper_state.stepper_stage = NORMAL_OPERATION;
+        save_stepper_state(stepper);
+        return true;
+    } else {
+        // all pills have been dispensed
+        stepper->stepper_state.current_compartment = 0;
+        stepper->stepper_state.stepper_stage = INITIAL;
+        save_stepper_state(stepper);
+        return false;
+    }
+}
+
+/**
+ * function to start the calibration after program started with no interrupts detected.
+ * The stages of the calibration are advanced by the step scheduler
+ */
+void start_calibration(stepper_t *stepper) {
+    create_wheel_log(LOG_CALIBRATION_STARTED, stepper->wheel);
+    stepper->stepper_data.sensor_width = 0;
+    stepper->calibration_round = 0;
+    // move forward until beginning of the opto sensor detection
+    start_motion(stepper, WAY_TO_START, FORWARD, EDGE_SEARCH_LIMIT, FALLING_EDGE, 2);
+}
+
+/**
+ * function to wait until the calibration has finished and to save the calibration data
+ * @return true if the wheel was calibrated, false if the opto sensor was not found
+ */
+bool finish_calibration(stepper_t *stepper) {
+    PROFILE_SCOPE(PROFILE_CALIBRATION);
+    wait_for_run(stepper);
+    if (stepper->calibration_stage == CALIBRATION_FAILED) {
+        printf("Wheel %d: opto sensor not found\n", stepper->wheel);
+        return false;
+    }
+    printf("Calculated revolution steps: %d\n", stepper->stepper_data.revolution_steps);
+    save_stepper_data(stepper);
+    stepper->stepper_state.stepper_stage = NORMAL_OPERATION;
+    stepper->stepper_state.current_compartment = 0;
+    save_stepper_state(stepper);
+    return true;
+}
+
+/**
+ * method to set all controllers of the motor with the specified values from the current step of the driver sequence
+ * @param stepper stepper motor whose controllers are set
+ */
+void write_motor_controllers(stepper_t *stepper) {
+    stepper_write_phase(stepper->wheel, stepper->current_step);
+}
+
+/**
+ * returns the amount of steps of n compartments
+ * @param stepper stepper motor of the dispenser wheel
+ * @param compartments amount of compartments
+ * @return steps of the compartments
+ */
+static int compartment_steps(stepper_t *stepper, int compartments) {
+    return (int) (compartments * ((double) stepper->stepper_data.revolution_steps / COMPARTMENTS));
+}
+
+/**
+ * sets the next part of the current motion, called by the step scheduler or with disabled interrupts
+ * @param stepper stepper motor to move
+ * @param direction FORWARD or BACKWARD
+ * @param steps amount of steps, for a search of an edge of the opto sensor the maximum amount of steps
+ * @param stop_edge value of the opto sensor after the edge which ends the part, NO_EDGE to do all steps
+ * @param interval time in ms between two steps
+ */
+static void set_motion(stepper_t *stepper, int direction, int steps, int stop_edge, int interval) {
+    stepper->direction = direction;
+    stepper->stop_edge = stop_edge;
+    stepper->last_sensor_value = gpio_get(stepper->pins.opto_sensor);
+    stepper->step_interval = interval / SCHEDULER_TICK;
+    stepper->ticks_to_step = 0;
+    stepper->motion_steps = steps;
+    stepper->steps_remaining = steps;
+    stepper->motion_part++;
+    if (steps == 0) {
+        next_motion(stepper, true);
+    }
+}
+
+/**
+ * starts the next part of a calibration or recalibration when the current part has ended.
+ * Called by the step scheduler, so that the calibrations of several wheels run at the same time
+ * @param stepper stepper motor whose part has ended
+ * @param completed false if the edge of the opto sensor was not found within the maximum amount of steps
+ */
+static void next_motion(stepper_t *stepper, bool completed) {
+    int steps_done = stepper->motion_steps - stepper->steps_remaining;
+    int round = stepper->calibration_round;
+
+    if (!completed) {
+        // the opto sensor is not reached, e.g. because the wheel is blocked
+        stepper->steps_remaining = 0;
+        stepper->calibration_stage = CALIBRATION_FAILED;
+        return;
+    }
+    switch (stepper->calibration_stage) {
+        case WAY_TO_START:
+            // calculate the steps during opto sensor detection
+            stepper->calibration_stage = CALCULATE_SENSOR_WIDTH;
+            set_motion(stepper, FORWARD, EDGE_SEARCH_LIMIT, RISING_EDGE, 3);
+            break;
+        case CALCULATE_SENSOR_WIDTH:
+            stepper->sensor_width_values[round] = steps_done;
+            // calculate all the steps outside the opto sensor detection
+            stepper->calibration_stage = CALCULATE_NON_SENSOR_WIDTH;
+            set_motion(stepper, FORWARD, EDGE_SEARCH_LIMIT, FALLING_EDGE, 3);
+            break;
+        case CALCULATE_NON_SENSOR_WIDTH:
+            stepper->revolution_steps_values[round] = steps_done + stepper->sensor_width_values[round];
+            if (round < 1) {
+                // second calibration round for better accuracy
+                stepper->calibration_round++;
+                stepper->calibration_stage = CALCULATE_SENSOR_WIDTH;
+                set_motion(stepper, FORWARD, EDGE_SEARCH_LIMIT, RISING_EDGE, 3);
+            } else {
+                // use average of both measurement rounds as calibration data
+                stepper->stepper_data.revolution_steps =
+                        (stepper->revolution_steps_values[0] + stepper->revolution_steps_values[1]) / 2;
+                stepper->stepper_data.sensor_width =
+                        (stepper->sensor_width_values[0] + stepper->sensor_width_values[1]) / 2;
+                // move forward until "point zero" where to start the normal operation
+                stepper->calibration_stage = WAY_TO_ZERO;
+                set_motion(stepper, FORWARD, stepper->stepper_data.sensor_width / 2, NO_EDGE, 3);
+            }
+            break;
+        case WAY_BACK_TO_SENSOR:
+            // motor continues moving backward until middle of the opto sensor (point zero) is reached
+            stepper->calibration_stage = WAY_BACK_TO_ZERO;
+            set_motion(stepper, BACKWARD, stepper->stepper_data.sensor_width / 2, NO_EDGE, 3);
+            break;
+        case WAY_BACK_TO_ZERO:
+            // stepper motor moves forward until next intact compartment
+            stepper->calibration_stage = WAY_TO_COMPARTMENT;
+            set_motion(stepper, FORWARD, compartment_steps(stepper, stepper->stepper_state.current_compartment + 1),
+                       NO_EDGE, 2);
+            break;
+        case WAY_TO_ZERO:
+        case WAY_TO_COMPARTMENT:
+            stepper->calibration_stage = CALIBRATION_FINISHED;
+            break;
+        case CALIBRATION_FINISHED:
+        case CALIBRATION_FAILED:
+            break;
+    }
+}
+
+/**
+ * executes one step of a stepper motor. A search of an edge checks the opto sensor before every step,
+ * when the previous step has moved the wheel
+ * @param stepper stepper motor whose step is due
+ */
+static void step(stepper_t *stepper) {
+    if (stepper->stop_edge != NO_EDGE) {
+        int sensor_value = gpio_get(stepper->pins.opto_sensor);
+        bool edge_detected = sensor_value == stepper->stop_edge && stepper->last_sensor_value != sensor_value;
+        stepper->last_sensor_value = sensor_value;
+        if (edge_detected) {
+            next_motion(stepper, true);
+            return;
+        }
+    }
+    write_motor_controllers(stepper);
+    stepper->current_step = (stepper->current_step + stepper->direction) & 7;
+    stepper->ticks_to_step = stepper->step_interval;
+    stepper->steps_remaining--;
+    mirror_stepper(stepper);
+    if (stepper->steps_remaining == 0) {
+        next_motion(stepper, stepper->stop_edge == NO_EDGE);
+    }
+}
+
+/**
+ * Timer handler of the step scheduler. Executes the next step of every moving stepper motor which is due,
+ * so that the steps of several motors are interleaved on one timer
+ * @param timer the repeating timer of the scheduler
+ * @return true to keep the timer running, false if no stepper motor is moving anymore
+ */
+bool scheduler_tick(repeating_timer_t *timer) {
+    PROFILE_SCOPE(PROFILE_STEP_IRQ);
+    (void) timer;
+    bool moving = false;
+    for (int i = 0; i < stepper_count; i++) {
+        stepper_t *stepper = steppers[i];
+        if (stepper->steps_remaining > 0 && --stepper->ticks_to_step <= 0) {
+            step(stepper);
+        }
+        if (stepper->steps_remaining > 0) {
+            moving = true;
+        }
+    }
+    scheduler_running = moving;
+    return moving;
+}
+
+/**
+ * starts the repeating timer of the step scheduler if it is not running yet, called with disabled interrupts
+ * @return false if no timer is available, then the stepper motors do not move
+ */
+static bool start_scheduler() {
+    if (!scheduler_running) {
+        scheduler_running = add_repeating_timer_ms(-SCHEDULER_TICK, scheduler_tick, NULL, &scheduler_timer);
+    }
+    return scheduler_running;
+}
+
+/**
+ * starts a motion of the stepper motor, further parts of a calibration are started by the step scheduler
+ * @param stepper stepper motor to move
+ * @param stage stage of the calibration of the first part, CALIBRATION_FINISHED for a motion with only one part
+ * @param direction FORWARD or BACKWARD
+ * @param steps amount of steps, for a search of an edge of the opto sensor the maximum amount of steps
+ * @param stop_edge value of the opto sensor after the edge which ends the part, NO_EDGE to do all steps
+ * @param interval time in ms between two steps
+ */
+void start_motion(stepper_t *stepper, enum Calibration_Stages stage, int direction, int steps, int stop_edge,
+                  int interval) {
+    bool started = true;
+    // the timer interrupt must not stop the scheduler between setting the motion and checking if it runs
+    uint32_t interrupts = save_and_disable_interrupts();
+    stepper->calibration_stage = stage;
+    set_motion(stepper, direction, steps, stop_edge, interval);
+    if (stepper->steps_remaining > 0) {
+        started = start_scheduler();
+    }
+    restore_interrupts(interrupts);
+    if (!started) {
+        // the motion is not executed, wait_for_run ends with a watchdog reset
+        printf("No timer for the step scheduler\n");
+    }
+}
+
+/**
+ * starts moving the stepper motor by n compartments forward, the steps are executed by the step scheduler
+ * @param stepper stepper motor to move
+ * @param compartments amount of compartments to move forward
+ */
+void start_run(stepper_t *stepper, int compartments) {
+    start_steps(stepper, compartment_steps(stepper, compartments), 0);
+}
+
+/**
+ * starts moving the stepper motor by n steps forward, the steps are executed by the step scheduler
+ * @param stepper stepper motor to move
+ * @param steps total amount of steps of the motion
+ * @param steps_done amount of steps of the motion which have already been done before
+ */
+void start_steps(stepper_t *stepper, int steps, int steps_done) {
+    bool started = true;
+    uint32_t interrupts = save_and_disable_interrupts();
+    stepper->calibration_stage = CALIBRATION_FINISHED;
+    set_motion(stepper, FORWARD, steps, NO_EDGE, 2);
+    stepper->steps_remaining = steps - steps_done;
+    if (stepper->steps_remaining > 0) {
+        started = start_scheduler();
+    }
+    restore_interrupts(interrupts);
+    if (!started) {
+        printf("No timer for the step scheduler\n");
+    }
+}
+
+/**
+ * waits until the step scheduler has finished the current motion of the stepper motor.
+ * Every part of the motion has to end in the time of its steps, otherwise the motor or the scheduler is stuck.
+ * Then the watchdog is not fed anymore, so that it resets the dispenser and the recovery takes over
+ * @param stepper stepper motor to wait for
+ */
+void wait_for_run(stepper_t *stepper) {
+    PROFILE_SCOPE(PROFILE_STEPPER_RUN);
+    uint32_t part = stepper->motion_part - 1;
+    uint64_t deadline = 0;
+    while (stepper->steps_remaining > 0) {
+        uint64_t now = time_us_64();
+        if (stepper->motion_part != part) {
+            part = stepper->motion_part;
+            deadline = now + (uint64_t) stepper->steps_remaining * stepper->step_interval * SCHEDULER_TICK * 1000 +
+                       RUN_MARGIN;
+        }
+        if (now > deadline) {
+            printf("Wheel %d: motion did not finish in time\n", stepper->wheel);
+            while (true) {
+                tight_loop_contents();
+            }
+        }
+        recovery_update();
+    }
+}
+
+/**
+ * starts the rotation of the stepper motor by one compartment and returns immediately,
+ * so that several dispenser wheels can turn at the same time
+ * @param stepper stepper motor to rotate
+ */
+void start_rotation_by_one_compartment(stepper_t *stepper) {
+    // no step of the new rotation is done yet
+    stepper->motion_steps = 0;
+    stepper->stepper_state.stepper_stage = TURNING;
+    save_stepper_state(stepper);
+    start_run(stepper, 1);
+}
+
+/**
+ * waits until the rotation by one compartment is finished and updates the state structure of the stepper motor
+ * @param stepper stepper motor which is rotating
+ */
+void finish_rotation_by_one_compartment(stepper_t *stepper) {
+    wait_for_run(stepper);
+    stepper->stepper_state.current_compartment++;
+    stepper->stepper_state.stepper_stage = NORMAL_OPERATION;
+    save_stepper_state(stepper);
+}
+
+/**
+ * to rotate the stepper motor by one compartment,
+ * whereby the state structure of the stepper motor is changed according to this action
+ * @param stepper stepper motor to rotate
+ */
+void rotate_by_one_compartment(stepper_t *stepper) {
+    start_rotation_by_one_compartment(stepper);
+    finish_rotation_by_one_compartment(stepper);
+}
+
+/**
+ * starts the rotation of the stepper motor by one compartment, whereby the position is aligned again at point zero
+ * before. Used to correct lost steps, the rotation takes longer than a normal rotation
+ * @param stepper stepper motor to rotate
+ */
+void start_recalibration_by_one_compartment(stepper_t *stepper) {
+    start_recalibration(stepper);
+}
+
+/**
+ * waits until the rotation with alignment at point zero is finished
+ * @param stepper stepper motor which is rotating
+ * @return true if the wheel is not empty after the rotation, otherwise false
+ */
+bool finish_recalibration_by_one_compartment(stepper_t *stepper) {
+    return finish_recalibration(stepper);
+}
+
+/**
+ * to rotate the stepper motor by one compartment, whereby the position is aligned again at point zero before.
+ * Used to correct lost steps, the rotation takes longer than a normal rotation
+ * @param stepper stepper motor to rotate
+ * @return true if the wheel is not empty after the rotation, otherwise false
+ */
+bool recalibrate_by_one_compartment(stepper_t *stepper) {
+    start_recalibration_by_one_compartment(stepper);
+    return finish_recalibration_by_one_compartment(stepper);
+}
+
+/**
+ * reset the state of the motor to the initial state with no calibration data
+ */
+void reset_stepper(stepper_t *stepper) {
+    stepper->stepper_state.current_compartment = 0;
+    stepper->stepper_state.stepper_stage = INITIAL;
+    save_stepper_state(stepper);
+}
@@ -1,14 +1,90 @@
-#ifndef UART_IRQ_STEPPER_H
-#define UART_IRQ_STEPPER_H
-
-uint8_t get_current_compartment();
-
-bool initialize_stepper_data();
-
-bool initialize_stepper();
-
-void rotate_by_one_compartment();
-
-void reset_stepper();
-
-#endif //UART_IRQ_STEPPER_H
+#ifndef UART_IRQ_STEPPER_H
+#define UART_IRQ_STEPPER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// amount of compartments of the dispenser wheel, the compartment at point zero is always empty
+#define COMPARTMENTS 8
+// amount of doses which fit into the wheel after filling
+#define DOSES_PER_FILL (COMPARTMENTS - 1)
+// maximum amount of stepper motors which can be driven by the step scheduler
+#define STEPPER_MAX_INSTANCES 4
+
+// structure to describe the current state of stepper motor
+typedef struct stepperstate {
+    uint8_t stepper_stage; // describes the stage as defined in enum stepper stages
+    uint8_t current_compartment; // describes the actual compartment position in relation to the point zero
+} stepperstate;
+
+// structure with the calibrated data of the stepper motor
+typedef struct stepperdata {
+    uint16_t revolution_steps; // steps needed for one total revolution
+    uint16_t sensor_width; // amount of steps within the opto sensor detection
+} stepperdata;
+
+// pins which are connected to one dispenser wheel
+typedef struct stepperpins {
+    uint8_t opto_sensor; // opto sensor which detects point zero of the wheel
+    uint8_t motor_controllers[4]; // motor controller inputs A to D
+} stepperpins;
+
+// structure which describes one stepper motor with its dispenser wheel
+typedef struct stepper_t {
+    stepperpins pins;
+    stepperdata stepper_data;
+    stepperstate stepper_state;
+    uint8_t current_step; // current step in driver sequence
+    uint8_t wheel; // index of the dispenser wheel on the board
+    uint16_t eeprom_address_stepperdata; // eeprom address where the stepper data structure is saved
+    uint16_t eeprom_address_stepperstate; // eeprom address where the stepper state structure is saved
+    int motion_steps; // total amount of steps of the current motion
+    volatile int steps_remaining; // steps which the step scheduler still has to execute
+    int step_interval; // time in ms between two steps of the current motion
+    int ticks_to_step; // scheduler ticks until the next step of the current motion
+    int direction; // 1 for forward, -1 for backward steps of the current motion
+    int stop_edge; // value of the opto sensor after the edge which ends the current motion, -1 for no edge
+    int last_sensor_value; // value of the opto sensor before the last step
+    volatile uint32_t motion_part; // counts the parts of the motions, a calibration consists of several parts
+    volatile uint8_t calibration_stage; // stage of the calibration which is executed by the step scheduler
+    uint8_t calibration_round;
+    int sensor_width_values[2]; // steps of the opto sensor detection of both calibration rounds
+    int revolution_steps_values[2]; // steps of one revolution of both calibration rounds
+} stepper_t;
+
+#ifdef __cplusplus
+extern "C"
+#endif
+void stepper_write_phase(uint8_t wheel, uint8_t step);
+
+void stepper_init(stepper_t *stepper, const stepperpins *pins, uint8_t wheel);
+
+uint8_t get_current_compartment(stepper_t *stepper);
+
+bool initialize_stepper_data(stepper_t *stepper);
+
+bool resume_stepper(stepper_t *stepper);
+
+bool stepper_ready(stepper_t *stepper);
+
+void start_initialize_stepper(stepper_t *stepper);
+
+bool finish_initialize_stepper(stepper_t *stepper);
+
+bool initialize_stepper(stepper_t *stepper);
+
+void start_rotation_by_one_compartment(stepper_t *stepper);
+
+void finish_rotation_by_one_compartment(stepper_t *stepper);
+
+void rotate_by_one_compartment(stepper_t *stepper);
+
+void start_recalibration_by_one_compartment(stepper_t *stepper);
+
+bool finish_recalibration_by_one_compartment(stepper_t *stepper);
+
+bool recalibrate_by_one_compartment(stepper_t *stepper);
+
+void reset_stepper(stepper_t *stepper);
+
+#endif //UART_IRQ_STEPPER_H
@@ -0,0 +1,25 @@
+#include <utility>
+#include "board.hpp"
+#include "stepper_driver.hpp"
+#include "stepper.h"
+
+/**
+ * sets the motor controllers of one wheel with the driver of this wheel. The index of the wheel is compared with
+ * every wheel of the board at compile time, so that the drivers are inlined and no function pointer is called
+ * @param wheel index of the dispenser wheel on the board
+ * @param step step in the driver sequence, 0 to 7
+ */
+template<std::size_t... Wheels>
+static inline void write_phase(uint8_t wheel, uint8_t step, std::index_sequence<Wheels...>) {
+    (void) ((wheel == Wheels && (StepperDriver<Board, Wheels>::write_phase(step), true)) || ...);
+}
+
+/**
+ * sets the motor controllers of a dispenser wheel to a step of the driver sequence,
+ * called by the step scheduler for every step. Wheels which are not part of the board are ignored
+ * @param wheel index of the dispenser wheel on the board
+ * @param step step in the driver sequence, 0 to 7
+ */
+extern "C" void stepper_write_phase(uint8_t wheel, uint8_t step) {
+    write_phase(wheel, step, std::make_index_sequence<Board::wheel_count>());
+}
@@ -0,0 +1,76 @@
+#ifndef UART_IRQ_STEPPER_DRIVER_HPP
+#define UART_IRQ_STEPPER_DRIVER_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "hardware/gpio.h"
+
+// GPIO backend which writes directly to the set and clear registers of the SIO
+struct SioGpio {
+    static inline void set_mask(uint32_t mask) { gpio_set_mask(mask); }
+    static inline void clr_mask(uint32_t mask) { gpio_clr_mask(mask); }
+};
+
+// driver sequence for the motor controllers A to D, bit 0 is controller A
+constexpr uint8_t half_step_sequence[8] = {
+        0b0001,
+        0b0011,
+        0b0010,
+        0b0110,
+        0b0100,
+        0b1100,
+        0b1000,
+        0b1001
+};
+
+/**
+ * Stepper driver for one wheel of a board. The pins, masks and the driver sequence are resolved at compile time,
+ * so that setting a step of the sequence is reduced to one write to the clear and one to the set register.
+ * @tparam BoardT compile-time board description, see board.hpp
+ * @tparam Wheel index of the dispenser wheel on the board
+ * @tparam Gpio backend which writes the pin masks, can be replaced by a fake backend on the host
+ */
+template<typename BoardT, std::size_t Wheel, typename Gpio = SioGpio>
+class StepperDriver {
+    static_assert(Wheel < BoardT::wheel_count, "wheel is not part of the board");
+
+    static constexpr uint32_t controller_mask(std::size_t controller) {
+        return 1u << BoardT::wheels[Wheel].motor_controllers[controller];
+    }
+
+    static constexpr uint32_t step_mask(std::size_t step) {
+        uint32_t mask = 0;
+        for (std::size_t controller = 0; controller < 4; controller++) {
+            if (half_step_sequence[step] & (1u << controller)) {
+                mask |= controller_mask(controller);
+            }
+        }
+        return mask;
+    }
+
+    static constexpr std::array<uint32_t, 8> make_set_masks() {
+        std::array<uint32_t, 8> masks{};
+        for (std::size_t step = 0; step < 8; step++) {
+            masks[step] = step_mask(step);
+        }
+        return masks;
+    }
+
+public:
+    // mask of all motor controller pins of the wheel
+    static constexpr uint32_t pin_mask = controller_mask(0) | controller_mask(1) | controller_mask(2) | controller_mask(3);
+    // pins to set for every step of the driver sequence, all other pins of the wheel are cleared
+    static constexpr std::array<uint32_t, 8> set_masks = make_set_masks();
+
+    /**
+     * sets the motor controllers to a step of the driver sequence
+     * @param step step in the driver sequence, 0 to 7
+     */
+    static inline void write_phase(uint8_t step) {
+        Gpio::clr_mask(pin_mask & ~set_masks[step & 7]);
+        Gpio::set_mask(set_masks[step & 7]);
+    }
+};
+
+#endif //UART_IRQ_STEPPER_DRIVER_HPP
@@ -0,0 +1,64 @@
+#include "telemetry.h"
+
+// sequence number of the next event
+uint16_t telemetry_sequence = 0;
+// time in s since boot of the previous event
+uint64_t telemetry_last_time = 0;
+
+/**
+ * encodes a time as unsigned LEB128
+ * @param seconds time in s
+ * @param buffer buffer where the encoded time is written to
+ * @return length of the encoded time in bytes
+ */
+static int encode_seconds(uint32_t seconds, uint8_t *buffer) {
+    int length = 0;
+    do {
+        buffer[length] = seconds & 0x7F;
+        seconds >>= 7;
+        if (seconds > 0) {
+            buffer[length] |= 0x80;
+        }
+        length++;
+    } while (seconds > 0);
+    return length;
+}
+
+/**
+ * encodes an event into its binary form for the uplink
+ * @param event event code
+ * @param wheel index of the dispenser wheel plus one, 0 for events of the whole dispenser
+ * @param time time of the event in s since boot
+ * @param buffer buffer with at least TELEMETRY_MAX_LENGTH bytes where the encoded event is written to
+ * @return length of the encoded event in bytes
+ */
+int telemetry_encode(uint8_t event, uint8_t wheel, uint64_t time, uint8_t *buffer) {
+    int length = 0;
+
+    buffer[length++] = (event & 0x1F) | (wheel << 5);
+    buffer[length++] = telemetry_sequence >> 8;
+    buffer[length++] = telemetry_sequence & 0xFF;
+    length += encode_seconds(time - telemetry_last_time, &buffer[length]);
+
+    telemetry_sequence++;
+    telemetry_last_time = time;
+    return length;
+}
+
+/**
+ * encodes an entry of the log in the EEPROM into its binary form for the uplink of a log dump.
+ * The sequence number and the time since the previous event are not changed
+ * @param event event code of the entry
+ * @param wheel index of the dispenser wheel plus one, 0 for events of the whole dispenser
+ * @param time time of the entry in s since the boot in which it was written
+ * @param buffer buffer with at least TELEMETRY_MAX_LENGTH bytes where the encoded entry is written to
+ * @return length of the encoded entry in bytes
+ */
+int telemetry_encode_log_entry(uint8_t event, uint8_t wheel, uint64_t time, uint8_t *buffer) {
+    int length = 0;
+
+    buffer[length++] = TELEMETRY_LOG_ENTRY | (wheel << 5);
+    buffer[length++] = event;
+    length += encode_seconds(time, &buffer[length]);
+    return length;
+}
@@ -0,0 +1,32 @@
+#ifndef UART_IRQ_TELEMETRY_H
+#define UART_IRQ_TELEMETRY_H
+
+#include <stdint.h>
+
+/*
+ * Binary encoding of one event in the uplink:
+ * byte 0:    bits 0-4 event code as defined in enum Log_Events,
+ *            bits 5-7 index of the dispenser wheel plus one, 0 for events of the whole dispenser
+ * byte 1-2:  sequence number of the event, big endian, counts up from 0 after every boot
+ * byte 3-:   seconds since the previous event as unsigned LEB128 (7 bits per byte, least significant group first,
+ *            bit 7 set if another byte follows). The first event after boot contains the seconds since boot
+ * Several events are sent back to back in one uplink frame, the receiver splits them at the end of the LEB128 field.
+ * Every frame starts with a 16-bit big endian frame sequence number, which continues after power cycles
+ * and is used by the receiver to drop frames which were sent twice from the backlog
+ *
+ * An entry of the log in the EEPROM which is sent for a log dump has its own encoding:
+ * byte 0:    bits 0-4 TELEMETRY_LOG_ENTRY, bits 5-7 index of the dispenser wheel plus one
+ * byte 1:    event code as defined in enum Log_Events
+ * byte 2-:   seconds since the boot in which the entry was written as unsigned LEB128
+ */
+
+// maximum length of one encoded event
+#define TELEMETRY_MAX_LENGTH 8
+// code in byte 0 which marks an entry of the log dump, it is no event code of enum Log_Events
+#define TELEMETRY_LOG_ENTRY 0x1F
+
+int telemetry_encode(uint8_t event, uint8_t wheel, uint64_t time, uint8_t *buffer);
+
+int telemetry_encode_log_entry(uint8_t event, uint8_t wheel, uint64_t time, uint8_t *buffer);
+
+#endif //UART_IRQ_TELEMETRY_H
@@ -0,0 +1,264 @@
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "provided-libraries/uart.h"
+#include "uart_bench.h"
+
+// the results are always printed, also on the host where the console output of the firmware is only shown on request
+#undef printf
+
+// amount of round trips which are measured for every command
+#define BENCH_ROUNDS 50
+// time in us until a command without answer counts as lost
+#define BENCH_ANSWER_TIMEOUT 1000000
+// a command is not measured further if this many round trips in a row got no answer, e.g. without a module
+#define BENCH_MAX_SILENT 3
+// amount of commands in the scripted batch
+#define BENCH_COMMANDS 4
+// amount of measured speeds of the throughput test
+#define BENCH_SPEEDS 5
+// longest block which is written at once in the throughput test
+#define BENCH_BLOCK 512
+// the throughput test at every speed lasts this fraction of a second of line time
+#define BENCH_LINE_TIME_DIVISOR 2
+// amount of bytes of the overflow test, more than the receive ring of the LoRa module holds
+#define BENCH_OVERFLOW_BYTES 2048
+// bits on the line for every byte: start bit, 8 data bits and stop bit
+#define BENCH_BITS_PER_BYTE 10
+
+// commands which every LoRa-E5 module answers without radio activity
+const char *bench_commands[BENCH_COMMANDS] = {"AT\r\n", "AT+MODE=LWOTAA\r\n", "AT+CLASS=A\r\n", "AT+PORT=8\r\n"};
+const int bench_speeds[BENCH_SPEEDS] = {9600, 57600, 115200, 230400, 921600};
+
+uint32_t bench_samples[BENCH_ROUNDS];
+uint8_t bench_block[BENCH_BLOCK];
+
+/**
+ * byte of the test pattern at a position of the stream, so that lost and reordered bytes are detected
+ * @param position position in the stream
+ * @return value of the byte
+ */
+static uint8_t pattern(uint32_t position) {
+    return (uint8_t) (position * 31 + 7);
+}
+
+/**
+ * sorts the samples, so that the percentiles can be read directly
+ * @param samples measured times
+ * @param count amount of samples
+ */
+static void sort_samples(uint32_t *samples, int count) {
+    for (int i = 1; i < count; i++) {
+        uint32_t sample = samples[i];
+        int j = i;
+        for (; j > 0 && samples[j - 1] > sample; j--) {
+            samples[j] = samples[j - 1];
+        }
+        samples[j] = sample;
+    }
+}
+
+/**
+ * returns a percentile of sorted samples
+ * @param samples sorted times
+ * @param count amount of samples, at least 1
+ * @param percent percentile
+ * @return time of the percentile
+ */
+static uint32_t percentile(const uint32_t *samples, int count, int percent) {
+    return samples[(count - 1) * percent / 100];
+}
+
+/**
+ * drops everything which was received so far, e.g. late answers of a previous command
+ * @param uart_nr UART under test
+ */
+static void drain(int uart_nr) {
+    while (uart_read(uart_nr, bench_block, sizeof(bench_block)) > 0) {}
+}
+
+/**
+ * waits for answer lines of the module. Lines of the module start with +, everything else is ignored
+ * @param uart_nr UART where the module is connected
+ * @param lines amount of answer lines to wait for
+ * @param start time in us when the first command was sent
+ * @return time in us until the last line was received, 0 if the timeout ended the wait
+ */
+static uint32_t wait_for_answers(int uart_nr, int lines, uint32_t start) {
+    rb_line line;
+    while (time_us_32() - start < BENCH_ANSWER_TIMEOUT) {
+        while (lines > 0 && uart_read_line(uart_nr, &line)) {
+            if (line.text[0] == '+') {
+                lines--;
+            }
+            uart_release_line(uart_nr, &line);
+        }
+        if (lines == 0) {
+            return time_us_32() - start;
+        }
+    }
+    return 0;
+}
+
+/**
+ * prints the percentiles of the measured round trips as one JSON line
+ * @param test name of the test
+ * @param command command without line ending
+ * @param count amount of answered round trips
+ * @param timeouts amount of round trips without answer
+ */
+static void print_latency(const char *test, const char *command, int count, int timeouts) {
+    sort_samples(bench_samples, count);
+    printf("{\"test\":\"%s\",\"command\":\"%.*s\",\"samples\":%d,\"timeouts\":%d", test,
+           (int) strcspn(command, "\r\n"), command, count, timeouts);
+    if (count > 0) {
+        printf(",\"p50_us\":%u,\"p90_us\":%u,\"p99_us\":%u,\"max_us\":%u", percentile(bench_samples, count, 50),
+               percentile(bench_samples, count, 90), percentile(bench_samples, count, 99), bench_samples[count - 1]);
+    }
+    printf("}\n");
+}
+
+/**
+ * measures the round trip of every command and of the whole command batch sent at once
+ * @param uart_nr UART where the module is connected
+ */
+static void bench_at_latency(int uart_nr) {
+    for (int c = 0; c < BENCH_COMMANDS; c++) {
+        int count = 0;
+        int timeouts = 0;
+        for (int i = 0; i < BENCH_ROUNDS; i++) {
+            drain(uart_nr);
+            uint32_t start = time_us_32();
+            uart_send_timeout(uart_nr, bench_commands[c], BENCH_ANSWER_TIMEOUT);
+            uint32_t latency = wait_for_answers(uart_nr, 1, start);
+            if (latency > 0) {
+                bench_samples[count++] = latency;
+            } else if (++timeouts >= BENCH_MAX_SILENT && count == 0) {
+                break;
+            }
+        }
+        print_latency("at_latency", bench_commands[c], count, timeouts);
+    }
+
+    int count = 0;
+    int timeouts = 0;
+    for (int i = 0; i < BENCH_ROUNDS; i++) {
+        drain(uart_nr);
+        uint32_t start = time_us_32();
+        for (int c = 0; c < BENCH_COMMANDS; c++) {
+            uart_send_timeout(uart_nr, bench_commands[c], BENCH_ANSWER_TIMEOUT);
+        }
+        uint32_t latency = wait_for_answers(uart_nr, BENCH_COMMANDS, start);
+        if (latency > 0) {
+            bench_samples[count++] = latency;
+        } else if (++timeouts >= BENCH_MAX_SILENT && count == 0) {
+            break;
+        }
+    }
+    print_latency("at_batch", "batch", count, timeouts);
+}
+
+/**
+ * streams the test pattern through the loopback at one speed and checks every received byte
+ * @param uart_nr UART under test, in loopback mode
+ * @param speed speed in baud
+ */
+static void bench_throughput(int uart_nr, int speed) {
+    uint8_t received[BENCH_BLOCK];
+    uint32_t total = speed / BENCH_BITS_PER_BYTE / BENCH_LINE_TIME_DIVISOR;
+    uint32_t sent = 0;
+    uint32_t checked = 0;
+    uint32_t mismatches = 0;
+    // twice the line time plus a second for the driver
+    uint32_t timeout = 2000000 / BENCH_LINE_TIME_DIVISOR + 1000000;
+
+    uart_set_speed(uart_nr, speed);
+    drain(uart_nr);
+    uart_stats before = *uart_get_stats(uart_nr);
+    uint32_t start = time_us_32();
+    while (checked < total && time_us_32() - start < timeout) {
+        if (sent < total) {
+            uint32_t length = total - sent < BENCH_BLOCK ? total - sent : BENCH_BLOCK;
+            for (uint32_t i = 0; i < length; i++) {
+                bench_block[i] = pattern(sent + i);
+            }
+            sent += uart_write(uart_nr, bench_block, (int) length);
+        }
+        int count = uart_read(uart_nr, received, sizeof(received));
+        for (int i = 0; i < count; i++) {
+            if (received[i] != pattern(checked + i)) {
+                mismatches++;
+            }
+        }
+        checked += count;
+    }
+    uint32_t duration = time_us_32() - start;
+    const uart_stats *after = uart_get_stats(uart_nr);
+
+    printf("{\"test\":\"throughput\",\"baud\":%d,\"bytes\":%u,\"received\":%u,\"us\":%u,\"bytes_per_s\":%u,"
+           "\"efficiency_pct\":%u,\"mismatches\":%u,\"rx_dropped\":%u,\"tx_dropped\":%u,\"overruns\":%u,"
+           "\"rx_high_water\":%u,\"tx_high_water\":%u}\n", speed, total, checked, duration,
+           (uint32_t) ((uint64_t) checked * 1000000 / (duration > 0 ? duration : 1)),
+           (uint32_t) ((uint64_t) checked * BENCH_BITS_PER_BYTE * 100000000 / speed / (duration > 0 ? duration : 1)),
+           mismatches, after->rx_dropped - before.rx_dropped, after->tx_dropped - before.tx_dropped,
+           after->overrun_errors - before.overrun_errors, after->rx_high_water, after->tx_high_water);
+}
+
+/**
+ * sends more data through the loopback than the receive ring holds without reading, so that it overflows
+ * @param uart_nr UART under test, in loopback mode
+ * @param speed speed in baud
+ */
+static void bench_overflow(int uart_nr, int speed) {
+    uint32_t sent = 0;
+    uint32_t received = 0;
+    int count;
+
+    uart_set_speed(uart_nr, speed);
+    drain(uart_nr);
+    uart_stats before = *uart_get_stats(uart_nr);
+    for (uint32_t i = 0; i < BENCH_BLOCK; i++) {
+        bench_block[i] = pattern(i);
+    }
+    while (sent < BENCH_OVERFLOW_BYTES) {
+        uint32_t length = BENCH_OVERFLOW_BYTES - sent < BENCH_BLOCK ? BENCH_OVERFLOW_BYTES - sent : BENCH_BLOCK;
+        if (!uart_write_timeout(uart_nr, bench_block, (int) length, BENCH_ANSWER_TIMEOUT)) {
+            break;
+        }
+        sent += length;
+    }
+    // the last bytes are on the line, nothing is read in the meantime
+    sleep_ms(100 + BENCH_BLOCK * BENCH_BITS_PER_BYTE * 1000 / speed);
+    while ((count = uart_read(uart_nr, bench_block, sizeof(bench_block))) > 0) {
+        received += count;
+    }
+    const uart_stats *after = uart_get_stats(uart_nr);
+
+    printf("{\"test\":\"overflow\",\"baud\":%d,\"sent\":%u,\"received\":%u,\"rx_dropped\":%u,\"overruns\":%u}\n",
+           speed, sent, received, after->rx_dropped - before.rx_dropped,
+           after->overrun_errors - before.overrun_errors);
+}
+
+/**
+ * Benchmark of the UART driver and of the AT round trips. Prints one JSON object per line for every result.
+ * The round trips are measured against the LoRa module at the negotiated speed. Then the throughput of the driver
+ * is measured in loopback mode at several speeds, and the receive ring is overflowed on purpose
+ * @param uart_nr UART where the LoRa module is connected
+ * @param link_speed speed of the LoRa module in baud, restored at the end
+ */
+void uart_bench_run(int uart_nr, int link_speed) {
+    printf("{\"test\":\"start\",\"baud\":%d}\n", link_speed);
+    bench_at_latency(uart_nr);
+
+    uart_set_loopback(uart_nr, true);
+    for (int i = 0; i < BENCH_SPEEDS; i++) {
+        bench_throughput(uart_nr, bench_speeds[i]);
+    }
+    bench_overflow(uart_nr, bench_speeds[BENCH_SPEEDS - 1]);
+    uart_set_loopback(uart_nr, false);
+    uart_set_speed(uart_nr, link_speed);
+
+    const uart_stats *stats = uart_get_stats(uart_nr);
+    printf("{\"test\":\"totals\",\"bytes_in\":%u,\"bytes_out\":%u,\"irqs\":%u,\"dma_irqs\":%u}\n", stats->bytes_in,
+           stats->bytes_out, stats->irqs, stats->dma_irqs);
+}
@@ -0,0 +1,6 @@
+#ifndef UART_IRQ_UART_BENCH_H
+#define UART_IRQ_UART_BENCH_H
+
+void uart_bench_run(int uart_nr, int link_speed);
+
+#endif //UART_IRQ_UART_BENCH_H
@@ -0,0 +1,45 @@
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "hardware/i2c.h"
+#include "provided-libraries/uart.h"
+#include "board.h"
+#include "modem_link.h"
+#include "uart_bench.h"
+
+#define BAUD_RATE_EEPROM 100000
+#define BAUD_RATE_UART 9600
+
+/**
+ * Benchmark firmware of the UART driver. The speed of the LoRa module is negotiated like in the dispenser firmware,
+ * then the benchmark runs once every time the button is pressed. The results are printed as JSON lines on the console
+ */
+int main() {
+    stdio_init_all();
+
+    gpio_init(SW0_PIN);
+    gpio_set_dir(SW0_PIN, GPIO_IN);
+    gpio_pull_up(SW0_PIN);
+
+    // the negotiated speed is saved in the EEPROM
+    i2c_init(i2c0, BAUD_RATE_EEPROM);
+    gpio_set_function(EEPROM_SDA_PIN, GPIO_FUNC_I2C);
+    gpio_set_function(EEPROM_SCL_PIN, GPIO_FUNC_I2C);
+
+    uart_setup(UART_NR, UART_TX_PIN, UART_RX_PIN, BAUD_RATE_UART);
+    uart_enable_rx_dma(UART_NR);
+    link_init(UART_NR);
+    while (link_poll() == LINK_BUSY) {
+        tight_loop_contents();
+    }
+
+    while (true) {
+        printf("press the button to run the UART benchmark\n");
+        while (gpio_get(SW0_PIN)) {
+            sleep_ms(50);
+        }
+        uart_bench_run(UART_NR, link_get_stats()->speed);
+        while (!gpio_get(SW0_PIN)) {
+            sleep_ms(50);
+        }
+    }
+}
@@ -2,6 +2,7 @@ import json
 import base64
 import random
 import sys
+from datetime import datetime
 
 from paho.mqtt import client as mqtt_client
 
@@ -20,23 +21,141 @@ default_sub_topic = "application/#"  # 4th parameter
 
 
 
+# texts of the event codes, same order as enum Log_Events in logger.h
+event_texts = [
+    "Boot",
+    "Power off during turning in previous session",
+    "Resumed after watchdog reset",
+    "Calibration started",
+    "Recalibration started",
+    "Pill dispensed",
+    "No pill dispensed",
+    "Dispenser empty",
+    "Missed dose dispensed",
+    "Dose missed",
+    "Remote command executed",
+    "Remote command rejected",
+    "Time set",
+    "Dosing paused, time unknown"
+]
+
+# time in s since boot of the previous event, the events only contain the seconds since the previous one
+device_time = 0
+# amount of recent frame sequence numbers which are remembered to drop frames sent twice from the backlog
+recent_frames_length = 256
+recent_frames = []
+# code in byte 0 which marks an entry of a log dump instead of an event
+log_entry_code = 0x1F
+# event which is sent while the device does not know the time, it is answered with the set time downlink
+time_unknown_code = 13
+# downlink command which sets the time, see remote_config.h
+set_time_command = 0x06
+# port of the downlinks
+downlink_port = 8
+
+
+def read_seconds(data, i):
+    # reads an unsigned LEB128 time, returns the time and the index behind it or None at the end of the frame
+    seconds = 0
+    shift = 0
+    while True:
+        if i >= len(data):
+            print("Truncated event time")
+            return None, i
+        seconds |= (data[i] & 0x7F) << shift
+        shift += 7
+        i += 1
+        if data[i - 1] & 0x80 == 0:
+            return seconds, i
+
+
+def print_event(prefix, time, wheel, code):
+    if code < len(event_texts):
+        text = event_texts[code]
+    else:
+        text = f"Unknown event {code}"
+    if wheel > 0:
+        print(f"{prefix} ({time}) Wheel {wheel}: {text}")
+    else:
+        print(f"{prefix} ({time}) {text}")
+
+
+def decode_events(data):
+    # decodes the binary events of one uplink, see telemetry.h for the format
+    # returns True if the device asked for the time
+    global device_time
+    time_requested = False
+    if len(data) < 2:
+        print("Frame too short:", data.hex().upper())
+        return False
+    frame_sequence = (data[0] << 8) | data[1]
+    # the device sends a frame again if the confirmation of the network was lost
+    if frame_sequence in recent_frames:
+        print("Frame", frame_sequence, "received twice, dropped")
+        return False
+    recent_frames.append(frame_sequence)
+    if len(recent_frames) > recent_frames_length:
+        recent_frames.pop(0)
+    print("Frame", frame_sequence)
+    i = 2
+    while i < len(data):
+        code = data[i] & 0x1F
+        wheel = data[i] >> 5
+        if code == log_entry_code:
+            # entry of a log dump with the event code and the seconds since the boot in which it was written
+            if len(data) - i < 3:
+                print("Truncated log entry:", data[i:].hex().upper())
+                return time_requested
+            code = data[i + 1]
+            time, i = read_seconds(data, i + 2)
+            if time is None:
+                return time_requested
+            print_event("  Log:", time, wheel, code)
+            continue
+        if len(data) - i < 4:
+            print("Truncated event:", data[i:].hex().upper())
+            return time_requested
+        sequence = (data[i + 1] << 8) | data[i + 2]
+        delta, i = read_seconds(data, i + 3)
+        if delta is None:
+            return time_requested
+        # the first event after boot contains the seconds since boot
+        if sequence == 0:
+            device_time = delta
+        else:
+            device_time += delta
+        print_event(f"  #{sequence}", device_time, wheel, code)
+        if code == time_unknown_code:
+            time_requested = True
+    return time_requested
+
+
+def set_time_downlink(device_info):
+    # builds the topic and the message of a downlink with the local time in s since 1.1.2000
+    seconds = int((datetime.now() - datetime(2000, 1, 1)).total_seconds())
+    payload = bytes([set_time_command]) + seconds.to_bytes(4, "big")
+    topic = f"application/{device_info['applicationId']}/device/{device_info['devEui']}/command/down"
+    message = {
+        "devEui": device_info["devEui"],
+        "confirmed": False,
+        "fPort": downlink_port,
+        "data": base64.b64encode(payload).decode()
+    }
+    return topic, json.dumps(message)
+
+
 def find(json_data, name):
+    # returns the device info of the uplink if the device asked for the time, otherwise None
     try:
         list = json.loads(json_data)
-        if list["deviceInfo"]["deviceName"] == name:
-            if "data" in list:
-                data = base64.b64decode(list["data"])
-                try:
-                    text = data.decode()
-                    if text.isprintable():  
-                        print("Text:", data.decode())
-                    else:
-                        print("Binary:", data.hex().upper())
-                except:
-                    print("Binary:", data.hex().upper())
+        # the downlinks which are sent by this script are received too, they have no device info
+        if "deviceInfo" in list and list["deviceInfo"]["deviceName"] == name:
+            if "data" in list and decode_events(base64.b64decode(list["data"])):
+                return list["deviceInfo"]
         #print(json.dumps(list, indent=4))
     except:
         print("Error while parsing JSON")
+    return None
 
         
    
@@ -67,7 +186,12 @@ class LoRaReceiver:
 
     def on_message(self, client, userdata, msg):
         rd = msg.payload.decode()
-        find(rd, self.device_name)
+        device_info = find(rd, self.device_name)
+        if device_info is not None:
+            # the device is class A, the downlink is queued and received after its next uplink
+            topic, message = set_time_downlink(device_info)
+            print("Time sent to", topic)
+            self.client.publish(topic, message)
         
     def run(self):
         self.client.loop_forever()